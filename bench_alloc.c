@@ -0,0 +1,174 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_general.h> /* For apr_initialize */
+#include <apr_file_io.h>
+#include <apr_pools.h>
+#include <apr_time.h>
+#include <apr_thread_proc.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* atexit, atoi */
+#endif
+
+#include "config.h"
+#include "flood_farmer.h"
+#include "flood_mem.h"
+
+/* How much farmers that allocate at the same time hold each other up.
+ * Each thread makes and throws away a request's worth of small pieces
+ * over and over: first with its pool on the global allocator, as farmers
+ * used to, then with a pool from flood_mem_pool_create() as they do now.
+ * Run by "make bench":
+ *
+ *     bench_alloc [threads [iterations]]
+ */
+
+apr_file_t *local_stdout, *local_stderr;
+
+/* flood_mem.c looks up the farmer of a pool; no pool here has one. */
+farmer_ctx_t *farmer_ctx_get(apr_pool_t *pool)
+{
+    return NULL;
+}
+
+/* About what one request and its response take. */
+#define BENCH_PIECES 64
+#define BENCH_PIECE_MAX 2048
+
+typedef struct {
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;
+    int go;                 /* a boolean: start the clock */
+    int own;                /* a boolean: an allocator for each thread */
+    int iterations;
+} bench_t;
+
+static void * APR_THREAD_FUNC bench_worker(apr_thread_t *thd, void *data)
+{
+    bench_t *bench = (bench_t *)data;
+    apr_pool_t *pool, *iterpool;
+    apr_size_t size;
+    char *cp;
+    int i, j;
+
+    if (bench->own) {
+        if (flood_mem_pool_create(&pool) != APR_SUCCESS)
+            return NULL;
+    }
+    else if (apr_pool_create(&pool, NULL) != APR_SUCCESS) {
+        return NULL;
+    }
+
+    apr_thread_mutex_lock(bench->lock);
+    while (!bench->go)
+        apr_thread_cond_wait(bench->cond, bench->lock);
+    apr_thread_mutex_unlock(bench->lock);
+
+    for (i = 0; i < bench->iterations; i++) {
+        apr_pool_create(&iterpool, pool);
+        for (j = 0; j < BENCH_PIECES; j++) {
+            size = 16 + (i * 31 + j * 97) % BENCH_PIECE_MAX;
+            cp = apr_palloc(iterpool, size);
+            cp[0] = cp[size - 1] = (char)j;
+        }
+        apr_pool_destroy(iterpool);
+    }
+
+    apr_pool_destroy(pool);
+    return NULL;
+}
+
+static apr_status_t bench_run(int own, int threads, int iterations,
+                              apr_pool_t *pool)
+{
+    bench_t bench;
+    apr_thread_t **thd;
+    apr_threadattr_t *attr;
+    apr_status_t rv, ret;
+    apr_time_t begin, spent;
+    int i;
+
+    bench.go = 0;
+    bench.own = own;
+    bench.iterations = iterations;
+    apr_thread_mutex_create(&bench.lock, APR_THREAD_MUTEX_DEFAULT, pool);
+    apr_thread_cond_create(&bench.cond, pool);
+    apr_threadattr_create(&attr, pool);
+
+    thd = apr_palloc(pool, threads * sizeof(apr_thread_t *));
+    for (i = 0; i < threads; i++) {
+        if ((rv = apr_thread_create(&thd[i], attr, bench_worker, &bench,
+                                    pool)) != APR_SUCCESS) {
+            apr_file_printf(local_stderr, "Unable to start thread %d.\n", i);
+            return rv;
+        }
+    }
+
+    /* Let them all go at once. */
+    apr_thread_mutex_lock(bench.lock);
+    bench.go = 1;
+    begin = apr_time_now();
+    apr_thread_cond_broadcast(bench.cond);
+    apr_thread_mutex_unlock(bench.lock);
+
+    for (i = 0; i < threads; i++)
+        apr_thread_join(&ret, thd[i]);
+    spent = apr_time_now() - begin;
+
+    apr_file_printf(local_stdout,
+                    "%-18s %4d threads: %8.3f s, %12.0f requests/s\n",
+                    own ? "own allocators" : "global allocator", threads,
+                    (double)spent / APR_USEC_PER_SEC,
+                    (double)threads * iterations * APR_USEC_PER_SEC /
+                    (spent ? spent : 1));
+
+    return APR_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    apr_pool_t *pool;
+    int threads = argc > 1 ? atoi(argv[1]) : 256;
+    int iterations = argc > 2 ? atoi(argv[2]) : 2000;
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    apr_pool_create(&pool, NULL);
+    apr_file_open_stdout(&local_stdout, pool);
+    apr_file_open_stderr(&local_stderr, pool);
+
+#if APR_HAS_THREADS
+    if (threads < 1 || iterations < 1) {
+        apr_file_printf(local_stderr,
+                        "Usage: %s [threads [iterations]]\n", argv[0]);
+        return 1;
+    }
+
+    if (bench_run(0, threads, iterations, pool) != APR_SUCCESS ||
+        bench_run(1, threads, iterations, pool) != APR_SUCCESS)
+        return 1;
+#else
+    apr_file_printf(local_stderr, "APR was built without threads.\n");
+#endif
+
+    return 0;
+}
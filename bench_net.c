@@ -0,0 +1,222 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_general.h> /* For apr_initialize */
+#include <apr_file_io.h>
+#include <apr_network_io.h>
+#include <apr_pools.h>
+#include <apr_strings.h>
+#include <apr_thread_proc.h>
+#include <apr_time.h>
+#include <apr_uri.h>
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* atexit, atoi */
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>     /* strlen */
+#endif
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "config.h"
+#include "flood_net.h"
+
+/* What keepalive requests cost over io_uring, against poll and recv.
+ * A thread serves a small fixed response on loopback; one connection
+ * sends it request after request, each way in turn, and we count the
+ * requests per second of wall time and per second of our own CPU time,
+ * which is how many one core could keep going.  Run by "make bench":
+ *
+ *     bench_net [requests]
+ */
+
+apr_file_t *local_stdout, *local_stderr;
+
+#define BENCH_REQUEST "GET / HTTP/1.1" CRLF "Host: localhost" CRLF CRLF
+#define BENCH_RESPONSE "HTTP/1.1 200 OK" CRLF "Content-Length: 13" CRLF \
+                       CRLF "Hello, world\n"
+
+typedef struct {
+    apr_socket_t *listener;
+    apr_pool_t *pool;
+} bench_server_t;
+
+/* Answer every request on every connection with BENCH_RESPONSE. */
+static void * APR_THREAD_FUNC bench_serve(apr_thread_t *thd, void *data)
+{
+    bench_server_t *server = (bench_server_t *)data;
+    static const char end[] = CRLF CRLF;
+    apr_socket_t *conn;
+    apr_pool_t *pool;
+    char buf[MAX_DOC_LENGTH];
+    apr_size_t len, i, out;
+    int matched;
+
+    apr_pool_create(&pool, server->pool);
+    while (apr_socket_accept(&conn, server->listener, pool) == APR_SUCCESS) {
+        matched = 0;
+        for (;;) {
+            len = sizeof(buf);
+            if (apr_socket_recv(conn, buf, &len) != APR_SUCCESS || !len)
+                break;
+            /* Requests end with an empty line, and may be split. */
+            for (i = 0; i < len; i++) {
+                matched = buf[i] == end[matched] ? matched + 1
+                                                 : buf[i] == end[0];
+                if (matched == 4) {
+                    matched = 0;
+                    out = sizeof(BENCH_RESPONSE) - 1;
+                    apr_socket_send(conn, BENCH_RESPONSE, &out);
+                }
+            }
+        }
+        apr_socket_close(conn);
+        apr_pool_clear(pool);
+    }
+
+    return NULL;
+}
+
+static apr_time_t cpu_now(void)
+{
+    struct rusage ru;
+
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &ru);
+#else
+    getrusage(RUSAGE_SELF, &ru);
+#endif
+    return apr_time_from_sec(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+           ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+static apr_status_t bench_run(int iouring, int requests, apr_uri_t *uri,
+                              apr_pool_t *pool)
+{
+    flood_socket_t *s;
+    request_t r;
+    char buf[MAX_DOC_LENGTH];
+    apr_size_t len, got;
+    apr_time_t begin, cpu, spent;
+    apr_status_t rv;
+    int i;
+
+    memset(&r, 0, sizeof(r));
+    r.parsed_uri = uri;
+    r.iouring = iouring;
+    r.rbuf = BENCH_REQUEST;
+    r.rbufsize = sizeof(BENCH_REQUEST) - 1;
+    r.pool = pool;
+
+    if (!(s = open_socket(pool, &r, &rv))) {
+        apr_file_printf(local_stderr, "Unable to connect.\n");
+        return rv;
+    }
+    if (iouring && !s->uring) {
+        close_socket(s);
+        return APR_ENOTIMPL;
+    }
+
+    begin = apr_time_now();
+    cpu = cpu_now();
+    for (i = 0; i < requests; i++) {
+        if ((rv = write_socket(s, &r)) != APR_SUCCESS)
+            break;
+        for (got = 0; got < sizeof(BENCH_RESPONSE) - 1; got += len) {
+            len = sizeof(buf);
+            if ((rv = read_socket(s, buf, &len)) != APR_SUCCESS)
+                break;
+        }
+        if (rv != APR_SUCCESS)
+            break;
+    }
+    cpu = cpu_now() - cpu;
+    spent = apr_time_now() - begin;
+    close_socket(s);
+
+    if (rv != APR_SUCCESS) {
+        apr_file_printf(local_stderr, "Request %d failed.\n", i);
+        return rv;
+    }
+
+    apr_file_printf(local_stdout,
+                    "%-14s %8d requests: %10.0f requests/s, "
+                    "%10.0f requests per CPU second\n",
+                    iouring ? "io_uring" : "poll and recv", requests,
+                    (double)requests * APR_USEC_PER_SEC / (spent ? spent : 1),
+                    (double)requests * APR_USEC_PER_SEC / (cpu ? cpu : 1));
+
+    return APR_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    apr_pool_t *pool;
+    bench_server_t server;
+    apr_sockaddr_t *sa;
+    apr_thread_t *thd;
+    apr_uri_t uri;
+    apr_status_t rv;
+    int requests = argc > 1 ? atoi(argv[1]) : 100000;
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    apr_pool_create(&pool, NULL);
+    apr_file_open_stdout(&local_stdout, pool);
+    apr_file_open_stderr(&local_stderr, pool);
+
+#if APR_HAS_THREADS
+    if (requests < 1) {
+        apr_file_printf(local_stderr, "Usage: %s [requests]\n", argv[0]);
+        return 1;
+    }
+
+    /* Any free port on loopback. */
+    server.pool = pool;
+    if (apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0,
+                              pool) != APR_SUCCESS ||
+        apr_socket_create(&server.listener, APR_INET, SOCK_STREAM,
+                          APR_PROTO_TCP, pool) != APR_SUCCESS ||
+        apr_socket_bind(server.listener, sa) != APR_SUCCESS ||
+        apr_socket_listen(server.listener, 8) != APR_SUCCESS ||
+        apr_socket_addr_get(&sa, APR_LOCAL, server.listener) != APR_SUCCESS) {
+        apr_file_printf(local_stderr, "Unable to listen on loopback.\n");
+        return 1;
+    }
+    apr_thread_create(&thd, NULL, bench_serve, &server, pool);
+
+    apr_uri_parse(pool, apr_psprintf(pool, "http://127.0.0.1:%d/", sa->port),
+                  &uri);
+
+    if (bench_run(0, requests, &uri, pool) != APR_SUCCESS)
+        return 1;
+    rv = bench_run(1, requests, &uri, pool);
+    if (rv == APR_ENOTIMPL)
+        apr_file_printf(local_stdout, "%-14s not available here\n",
+                        "io_uring");
+    else if (rv != APR_SUCCESS)
+        return 1;
+#else
+    apr_file_printf(local_stderr, "APR was built without threads.\n");
+#endif
+
+    return 0;
+}
@@ -0,0 +1,153 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_general.h> /* For apr_initialize */
+#include <apr_file_io.h>
+#include <apr_pools.h>
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* atexit */
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>     /* strlen */
+#endif
+
+#include "config.h"
+#include "flood_body.h"
+
+/* Checks of the response framing that expectlength and the other body
+ * checks rely on.  Run by "make check". */
+
+apr_file_t *local_stdout, *local_stderr;
+
+typedef struct {
+    const char *response;
+    const char *body;       /* what should be handed on */
+    int status;
+    int done;               /* a boolean: should the framing say so? */
+} body_check_t;
+
+static const body_check_t checks[] = {
+    { "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello",
+      "hello", 200, 1 },
+    /* nothing past Content-Length is body */
+    { "HTTP/1.1 200 OK\r\ncontent-length: 5\r\n\r\nhelloHTTP/1.1 200 OK",
+      "hello", 200, 1 },
+    { "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", "", 200, 1 },
+    { "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort", "short", 200, 0 },
+    /* chunked, with an extension, upper-case hex and a trailer */
+    { "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "5\r\nhello\r\n7;ext=1\r\n, world\r\nA\r\n0123456789\r\n"
+      "0\r\nTrailer: x\r\n\r\n",
+      "hello, world0123456789", 200, 1 },
+    /* chunked wins over Content-Length */
+    { "HTTP/1.1 200 OK\r\nContent-Length: 3\r\n"
+      "Transfer-Encoding: gzip, Chunked\r\n\r\n4\r\nabcd\r\n0\r\n\r\n",
+      "abcd", 200, 1 },
+    { "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "4\r\nabcd\r\n", "abcd", 200, 0 },
+    /* interim responses come before the real one */
+    { "HTTP/1.1 100 Continue\r\n\r\n"
+      "HTTP/1.1 103 Early Hints\r\nLink: </a.css>\r\n\r\n"
+      "HTTP/1.1 201 Created\r\nContent-Length: 2\r\n\r\nok",
+      "ok", 201, 1 },
+    /* no body, whatever the headers say */
+    { "HTTP/1.1 204 No Content\r\n\r\n", "", 204, 1 },
+    { "HTTP/1.1 304 Not Modified\r\nContent-Length: 100\r\n\r\n",
+      "", 304, 1 },
+    /* until the server hangs up */
+    { "HTTP/1.0 200 OK\r\n\r\nabc", "abc", 200, 0 },
+    /* bare newlines */
+    { "HTTP/1.1 200 OK\nContent-Length: 2\n\nhi", "hi", 200, 1 },
+    { NULL }
+};
+
+typedef struct {
+    char buf[256];
+    apr_size_t len;
+} body_out_t;
+
+static void body_keep(void *ctx, const char *data, apr_size_t len)
+{
+    body_out_t *out = (body_out_t *)ctx;
+
+    if (len > sizeof(out->buf) - 1 - out->len)
+        len = sizeof(out->buf) - 1 - out->len;
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+}
+
+/* Feed the response step bytes at a time, so that header lines, chunk
+ * sizes and chunks are split between reads. */
+static int run_check(const body_check_t *c, apr_size_t step)
+{
+    flood_body_t body;
+    body_out_t out;
+    apr_size_t len, off, n;
+
+    out.len = 0;
+    flood_body_init(&body, body_keep, &out);
+    /* Twice over, to see that a reset forgets the first response. */
+    flood_body_feed(&body, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked"
+                           "\r\n\r\n5\r\nst", 51);
+    flood_body_reset(&body);
+    out.len = 0;
+
+    len = strlen(c->response);
+    for (off = 0; off < len; off += n) {
+        n = len - off < step ? len - off : step;
+        flood_body_feed(&body, c->response + off, n);
+    }
+    out.buf[out.len] = '\0';
+
+    if (strcmp(out.buf, c->body) != 0 || body.bodylen != strlen(c->body) ||
+        body.status != c->status || !flood_body_done(&body) != !c->done) {
+        apr_file_printf(local_stderr,
+                        "%s, %" APR_SIZE_T_FMT " bytes at a time: got %d "
+                        "'%s' (%s), wanted %d '%s' (%s)\n",
+                        c->response, step, body.status, out.buf,
+                        flood_body_done(&body) ? "done" : "not done",
+                        c->status, c->body, c->done ? "done" : "not done");
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    apr_pool_t *pool;
+    const body_check_t *c;
+    apr_size_t steps[] = { 1, 4, 7, 1024 };
+    int i, failures = 0;
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    apr_pool_create(&pool, NULL);
+    apr_file_open_stdout(&local_stdout, pool);
+    apr_file_open_stderr(&local_stderr, pool);
+
+    for (c = checks; c->response; c++)
+        for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++)
+            failures += run_check(c, steps[i]);
+
+    apr_file_printf(local_stdout, "check_body: %s\n",
+                    failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
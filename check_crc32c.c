@@ -0,0 +1,152 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_general.h> /* For apr_initialize */
+#include <apr_file_io.h>
+#include <apr_pools.h>
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* atexit */
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>     /* strlen */
+#endif
+
+#include "config.h"
+#include "flood_crc32c.h"
+
+/* Checks of the CRC32C that expectdigest uses.  Run by "make check".
+ *
+ * flood_crc32c() uses SSE4.2 when the CPU has it; the table it falls
+ * back on is built in here as well, under another name, so that both
+ * are checked whatever the CPU. */
+#define FLOOD_CRC32C_SSE42 0
+#define flood_crc32c flood_crc32c_table
+#include "flood_crc32c.c"
+#undef flood_crc32c
+
+apr_uint32_t flood_crc32c_table(apr_uint32_t crc, const void *data,
+                                apr_size_t len);
+
+apr_file_t *local_stdout, *local_stderr;
+
+typedef apr_uint32_t (*crc_func_t)(apr_uint32_t crc, const void *data,
+                                   apr_size_t len);
+
+typedef struct {
+    const char *name;
+    crc_func_t crc;
+} crc_impl_t;
+
+static const crc_impl_t impls[] = {
+    { "flood_crc32c", flood_crc32c },
+    { "table", flood_crc32c_table },
+    { NULL }
+};
+
+typedef struct {
+    const char *data;
+    apr_size_t len;
+    apr_uint32_t crc;
+} crc_check_t;
+
+/* From RFC 3720, B.4, and the usual "123456789". */
+static const crc_check_t checks[] = {
+    { "123456789", 9, 0xe3069283 },
+    { "", 0, 0 },
+    { "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0"
+      "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", 32, 0x8a9136aa },
+    { "\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377"
+      "\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377",
+      32, 0x62a8ab43 },
+    { NULL }
+};
+
+/* The CRC of data fed step bytes at a time. */
+static apr_uint32_t crc_steps(const crc_impl_t *impl, const char *data,
+                              apr_size_t len, apr_size_t step)
+{
+    apr_uint32_t crc = 0;
+    apr_size_t off, n;
+
+    for (off = 0; off < len; off += n) {
+        n = len - off < step ? len - off : step;
+        crc = impl->crc(crc, data + off, n);
+    }
+
+    return crc;
+}
+
+int main(int argc, char **argv)
+{
+    apr_pool_t *pool;
+    const crc_impl_t *impl;
+    const crc_check_t *c;
+    apr_size_t steps[] = { 1, 3, 4, 7, 8, 1024 };
+    char buf[1000];
+    apr_uint32_t crc, want;
+    apr_size_t off;
+    int i, failures = 0;
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    apr_pool_create(&pool, NULL);
+    apr_file_open_stdout(&local_stdout, pool);
+    apr_file_open_stderr(&local_stderr, pool);
+
+    for (impl = impls; impl->name; impl++) {
+        for (c = checks; c->data; c++) {
+            for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+                crc = crc_steps(impl, c->data, c->len, steps[i]);
+                if (crc != c->crc) {
+                    apr_file_printf(local_stderr,
+                                    "%s of %" APR_SIZE_T_FMT " bytes, %"
+                                    APR_SIZE_T_FMT " at a time: %08x, "
+                                    "wanted %08x\n", impl->name, c->len,
+                                    steps[i], crc, c->crc);
+                    failures++;
+                }
+            }
+        }
+    }
+
+    /* Longer and unaligned, where the instruction takes 8 bytes at once:
+     * the two must agree. */
+    for (off = 0; off < sizeof(buf); off++)
+        buf[off] = (char)(off * 131 + 7);
+    for (off = 0; off < 16; off++) {
+        want = flood_crc32c_table(0, buf + off, sizeof(buf) - off);
+        for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+            crc = crc_steps(&impls[0], buf + off, sizeof(buf) - off,
+                            steps[i]);
+            if (crc != want) {
+                apr_file_printf(local_stderr,
+                                "flood_crc32c from offset %" APR_SIZE_T_FMT
+                                ", %" APR_SIZE_T_FMT " at a time: %08x, "
+                                "the table says %08x\n", off, steps[i],
+                                crc, want);
+                failures++;
+            }
+        }
+    }
+
+    apr_file_printf(local_stdout, "check_crc32c: %s\n",
+                    failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
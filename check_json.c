@@ -0,0 +1,167 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_general.h> /* For apr_initialize */
+#include <apr_file_io.h>
+#include <apr_pools.h>
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* atexit */
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>     /* strlen */
+#endif
+
+#include "config.h"
+#include "flood_json.h"
+
+/* Checks of the responsejson reader.  Run by "make check". */
+
+apr_file_t *local_stdout, *local_stderr;
+
+typedef struct {
+    const char *paths;
+    const char *doc;
+    const char *values[4];  /* what each path should find, or NULL */
+} json_check_t;
+
+static const json_check_t checks[] = {
+    { "$.id, $.name", "{\"id\": 42, \"name\": \"flood\"}",
+      { "42", "flood" } },
+    /* the first of two with one name wins */
+    { "$.a", "{\"a\":1,\"a\":2}", { "1" } },
+    { "$.n,$.t,$.f,$.z", "{\"n\":-1.5e+3,\"t\":true,\"f\":false,\"z\":null}",
+      { "-1.5e+3", "true", "false", "null" } },
+    /* escapes */
+    { "$.s", "{\"s\":\"a\\\"b\\\\c\\/d\\n\\t\\u0041\"}",
+      { "a\"b\\c/d\n\tA" } },
+    { "$.s", "{\"s\":\"\\u00e9\\u20AC\"}", { "\xc3\xa9\xe2\x82\xac" } },
+    /* a pair of surrogates is one character; a lone one is none */
+    { "$.s", "{\"s\":\"<\\ud83d\\ude00>\"}", { "<\xf0\x9f\x98\x80>" } },
+    { "$.s", "{\"s\":\"<\\ud83d>\"}", { "<>" } },
+    /* escaped names */
+    { "$['a \"key\"']", "{\"a \\\"key\\\"\":\"v\"}", { "v" } },
+    /* containers no path leads into, with brackets and quotes in strings */
+    { "$.want",
+      "{\"skip\":{\"a\":[1,{\"b\":\"}]\\\"[{\"}],\"c\":{\"d\":{}}},"
+      "\"s\":\"{\",\"want\":\"yes\"}",
+      { "yes" } },
+    { "$.items[1].id,$.items[1].tags[1],$.items[0].id",
+      "{\"items\":[{\"id\":1,\"tags\":[]},"
+      "{\"tags\":[\"x\",\"y\"],\"id\":2}]}",
+      { "2", "y", "1" } },
+    { "$['a key'][1]", "{\"a key\": [0, \"z\"]}", { "z" } },
+    /* objects, arrays and paths that lead nowhere find nothing */
+    { "$.items,$.nope,$.items[5]", "{\"items\":[1,2]}",
+      { NULL, NULL, NULL } },
+    /* a bare literal, which only flood_json_finish() can end */
+    { "$", "true", { "true" } },
+    { "$[1]", "[ \"a\" ,\r\n\t12 ]", { "12" } },
+    /* a broken document finds what came before the break */
+    { "$.a,$.b", "{\"a\":\"x\" \"b\":\"y\"}", { "x", NULL } },
+    { NULL }
+};
+
+/* Paths the compiler should turn down. */
+static const char *bad_paths[] = {
+    "",
+    "a",
+    "$.",
+    "$[x]",
+    "$[-1]",
+    "$['a'",
+    NULL
+};
+
+/* Feed the document step bytes at a time, so that names, strings,
+ * escapes and literals are split between reads. */
+static int run_check(const json_check_t *c, apr_size_t step,
+                     apr_pool_t *pool)
+{
+    flood_json_paths_t *paths;
+    flood_json_t *json;
+    const char *value;
+    apr_size_t len, off, n;
+    int i, failures = 0;
+
+    if (flood_json_compile(&paths, c->paths, pool) != APR_SUCCESS) {
+        apr_file_printf(local_stderr, "Paths '%s' didn't compile\n",
+                        c->paths);
+        return 1;
+    }
+
+    json = flood_json_create(paths, pool);
+    /* Twice over, to see that a reset forgets the first document. */
+    flood_json_feed(json, "{\"a\":\"old\",\"id\":0,\"s\":\"\\u", 26);
+    flood_json_reset(json);
+
+    len = strlen(c->doc);
+    for (off = 0; off < len; off += n) {
+        n = len - off < step ? len - off : step;
+        flood_json_feed(json, c->doc + off, n);
+    }
+    flood_json_finish(json);
+
+    for (i = 0; i < flood_json_count(paths); i++) {
+        value = flood_json_value(json, i);
+        if ((value == NULL) != (c->values[i] == NULL) ||
+            (value && strcmp(value, c->values[i]) != 0)) {
+            apr_file_printf(local_stderr,
+                            "%s in %s, %" APR_SIZE_T_FMT " bytes at a time: "
+                            "got %s, wanted %s\n",
+                            flood_json_path(paths, i), c->doc, step,
+                            value ? value : "nothing",
+                            c->values[i] ? c->values[i] : "nothing");
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    apr_pool_t *pool;
+    flood_json_paths_t *paths;
+    const json_check_t *c;
+    const char **bad;
+    apr_size_t steps[] = { 1, 4, 7, 1024 };
+    int i, failures = 0;
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    apr_pool_create(&pool, NULL);
+    apr_file_open_stdout(&local_stdout, pool);
+    apr_file_open_stderr(&local_stderr, pool);
+
+    for (c = checks; c->paths; c++)
+        for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++)
+            failures += run_check(c, steps[i], pool);
+
+    for (bad = bad_paths; *bad; bad++) {
+        if (flood_json_compile(&paths, *bad, pool) == APR_SUCCESS) {
+            apr_file_printf(local_stderr, "Paths '%s' compiled\n", *bad);
+            failures++;
+        }
+    }
+
+    apr_file_printf(local_stdout, "check_json: %s\n",
+                    failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
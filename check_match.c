@@ -0,0 +1,149 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_general.h> /* For apr_initialize */
+#include <apr_file_io.h>
+#include <apr_pools.h>
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* atexit */
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>     /* strlen */
+#endif
+
+#include "config.h"
+#include "flood_match.h"
+
+/* Checks of the body matcher.  Run by "make check". */
+
+apr_file_t *local_stdout, *local_stderr;
+
+static const char *page =
+    "<html>Welcome back, user. Total: 42 <div id=cart> he she hers his</html>";
+
+typedef struct {
+    const char *expect;
+    const char *reject;
+    const char *body;
+    const char *failed;     /* the pattern that should fail, or NULL */
+    int rejected;           /* a boolean: should it be a rejected one? */
+} match_check_t;
+
+static const match_check_t checks[] = {
+    { "Welcome|id=cart|</html>", "Exception|Service Unavailable", NULL,
+      NULL, 0 },
+    /* patterns that are suffixes and prefixes of each other */
+    { "hers|his|she|he", NULL, NULL, NULL, 0 },
+    { NULL, "shers", NULL, NULL, 0 },
+    { "ushers", NULL, "ushers", NULL, 0 },
+    { "Total: 42|missing", "Exception", NULL, "missing", 0 },
+    { "Welcome", "user", NULL, "user", 1 },
+    { "a|b|c|d|e|f|g|h|i|j|k|l|m|n|o|p|q|r|s|t|u|v|w|x|y|z|A|B|C|D|E|F",
+      NULL, "abcdefghijklmnopqrstuvwxyzABCDE", "F", 0 },
+    { NULL }
+};
+
+/* Lists the matcher should turn down. */
+static const char *bad_lists[] = {
+    "a||b",
+    "",
+    "a|b|c|d|e|f|g|h|i|j|k|l|m|n|o|p|q|r|s|t|u|v|w|x|y|z|A|B|C|D|E|F|G",
+    NULL
+};
+
+/* Feed the body step bytes at a time, so that patterns are split between
+ * reads, and see that the right pattern (if any) fails. */
+static int run_check(const match_check_t *c, apr_size_t step,
+                     apr_pool_t *pool)
+{
+    flood_match_patterns_t *patterns;
+    flood_match_t *match;
+    const char *body = c->body ? c->body : page;
+    const char *failed;
+    apr_size_t len, off, n;
+    int rejected = -1;
+
+    if (flood_match_compile(&patterns, c->expect, c->reject, pool)
+                                                        != APR_SUCCESS) {
+        apr_file_printf(local_stderr, "Patterns '%s' / '%s' didn't compile\n",
+                        c->expect ? c->expect : "",
+                        c->reject ? c->reject : "");
+        return 1;
+    }
+
+    match = flood_match_create(patterns, pool);
+    /* Twice over, to see that a reset forgets the first body. */
+    flood_match_feed(match, "Exception Service Unavailable", 29);
+    flood_match_reset(match);
+
+    len = strlen(body);
+    for (off = 0; off < len; off += n) {
+        n = len - off < step ? len - off : step;
+        flood_match_feed(match, body + off, n);
+    }
+
+    failed = flood_match_failed(match, &rejected);
+    if ((failed == NULL) != (c->failed == NULL) ||
+        (failed && (strcmp(failed, c->failed) || rejected != c->rejected))) {
+        apr_file_printf(local_stderr,
+                        "Patterns '%s' / '%s', %" APR_SIZE_T_FMT
+                        " bytes at a time: got %s '%s', wanted %s '%s'\n",
+                        c->expect ? c->expect : "",
+                        c->reject ? c->reject : "", step,
+                        failed ? (rejected ? "has" : "lacks") : "ok",
+                        failed ? failed : "",
+                        c->failed ? (c->rejected ? "has" : "lacks") : "ok",
+                        c->failed ? c->failed : "");
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    apr_pool_t *pool;
+    flood_match_patterns_t *patterns;
+    const match_check_t *c;
+    const char **bad;
+    apr_size_t steps[] = { 1, 4, 7, 1024 };
+    int i, failures = 0;
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    apr_pool_create(&pool, NULL);
+    apr_file_open_stdout(&local_stdout, pool);
+    apr_file_open_stderr(&local_stderr, pool);
+
+    for (c = checks; c->expect || c->reject; c++)
+        for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++)
+            failures += run_check(c, steps[i], pool);
+
+    for (bad = bad_lists; *bad; bad++) {
+        if (flood_match_compile(&patterns, *bad, NULL, pool) == APR_SUCCESS) {
+            apr_file_printf(local_stderr, "Patterns '%s' compiled\n", *bad);
+            failures++;
+        }
+    }
+
+    apr_file_printf(local_stdout, "check_match: %s\n",
+                    failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
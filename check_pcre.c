@@ -0,0 +1,287 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_general.h> /* For apr_initialize */
+#include <apr_file_io.h>
+#include <apr_pools.h>
+#include <apr_strings.h>
+#include <apr_tables.h>
+#include <apr_time.h>
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* atexit, atoi, malloc */
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>     /* memcpy, strlen */
+#endif
+
+#include "config.h"
+
+/* Checks of the PCRE2 regex wrapper, and what it buys over POSIX regex
+ * on the sort of responses templates pull values out of.  Every pattern
+ * has to match where the system's regexec() does; the timings are only
+ * printed.  Run by "make check":
+ *
+ *     check_pcre [rounds]
+ */
+
+apr_file_t *local_stdout, *local_stderr;
+
+#if FLOOD_USE_PCRE
+
+#include "flood_pcre.h"
+
+/* flood_pcre.h takes over the POSIX names; give them back. */
+#undef regcomp
+#undef regexec
+#undef regerror
+#undef regfree
+#undef regex_t
+#undef regmatch_t
+#undef REG_EXTENDED
+#undef REG_NOTBOL
+#undef REG_STARTEND
+#include <regex.h>
+
+#define CHECK_NMATCH 4
+#define CHECK_ROWS 600
+
+/* What responsetemplates look for: one early in the page, one near the
+ * end and one that isn't there, so the whole page is read. */
+static const char *patterns[] = {
+    "<title>([^<]*)</title>",
+    "name=\"session\" value=\"([^\"]*)\"",
+    "name=\"csrf\" value=\"([^\"]*)\"",
+    "href=\"(/item/[0-9]+)\">Item 59([0-9])<",
+    NULL
+};
+
+/* A listing page of some 50KB, with the session id near the end. */
+static const char *make_body(apr_pool_t *pool)
+{
+    apr_array_header_t *parts;
+    int i;
+
+    parts = apr_array_make(pool, CHECK_ROWS + 2, sizeof(char *));
+    *(const char **)apr_array_push(parts) =
+        "<!DOCTYPE html>\n<html><head><title>Items</title></head>\n"
+        "<body><div class=\"list\">\n";
+    for (i = 0; i < CHECK_ROWS; i++)
+        *(char **)apr_array_push(parts) =
+            apr_psprintf(pool, "<div class=\"row\"><a href=\"/item/%d\">"
+                         "Item %d</a> <span class=\"price\">$%d.99</span>"
+                         "</div>\n", i, i, i % 97);
+    *(const char **)apr_array_push(parts) =
+        "</div><form action=\"/cart\"><input type=\"hidden\" "
+        "name=\"session\" value=\"0f3c9a51d2e84b7c\"></form>\n"
+        "</body></html>\n";
+    return apr_array_pstrcat(pool, parts, '\0');
+}
+
+/* Run each pattern over the body with JIT (where PCRE2 has one), with
+ * PCRE2's interpreter and with POSIX regex, check they agree, and say
+ * how fast each went. */
+static int check_body(const char *body, int rounds)
+{
+    flood_regex_t fre, interp;
+    flood_regmatch_t fm[CHECK_NMATCH];
+    regex_t pre;
+    regmatch_t pm[CHECK_NMATCH];
+    apr_time_t begin, spent[3];
+    apr_size_t len = strlen(body);
+    const char **p;
+    int i, r, frc, prc, failures = 0;
+
+    for (p = patterns; *p; p++) {
+        if (flood_regcomp(&fre, *p, 0) != 0 ||
+            regcomp(&pre, *p, REG_EXTENDED) != 0) {
+            apr_file_printf(local_stderr, "'%s' didn't compile\n", *p);
+            failures++;
+            continue;
+        }
+        interp = fre;
+        interp.re_jit = 0;
+
+        frc = flood_regexec(&fre, body, CHECK_NMATCH, fm, 0);
+        prc = regexec(&pre, body, CHECK_NMATCH, pm, 0);
+        if ((frc == 0) != (prc == 0)) {
+            apr_file_printf(local_stderr, "'%s': PCRE2 %s, POSIX %s\n", *p,
+                            frc ? "didn't match" : "matched",
+                            prc ? "didn't" : "did");
+            failures++;
+        }
+        for (i = 0; frc == 0 && prc == 0 && i < CHECK_NMATCH; i++) {
+            if (fm[i].rm_so != pm[i].rm_so || fm[i].rm_eo != pm[i].rm_eo) {
+                apr_file_printf(local_stderr, "'%s' group %d: PCRE2 "
+                                "(%d, %d), POSIX (%d, %d)\n", *p, i,
+                                fm[i].rm_so, fm[i].rm_eo, (int)pm[i].rm_so,
+                                (int)pm[i].rm_eo);
+                failures++;
+            }
+        }
+
+        begin = apr_time_now();
+        for (r = 0; r < rounds; r++)
+            flood_regexec(&fre, body, CHECK_NMATCH, fm, 0);
+        spent[0] = apr_time_now() - begin;
+
+        begin = apr_time_now();
+        for (r = 0; r < rounds; r++)
+            flood_regexec(&interp, body, CHECK_NMATCH, fm, 0);
+        spent[1] = apr_time_now() - begin;
+
+        begin = apr_time_now();
+        for (r = 0; r < rounds; r++)
+            regexec(&pre, body, CHECK_NMATCH, pm, 0);
+        spent[2] = apr_time_now() - begin;
+
+        apr_file_printf(local_stdout, "  %-40.40s", *p);
+        for (i = 0; i < 3; i++) {
+            if (i == 0 && !fre.re_jit)
+                apr_file_printf(local_stdout, "   (no JIT)");
+            else
+                apr_file_printf(local_stdout, " %7.1fus",
+                                (double)spent[i] / (rounds ? rounds : 1));
+        }
+        apr_file_printf(local_stdout, "\n");
+
+        regfree(&pre);
+        flood_regfree(&fre);
+    }
+
+    apr_file_printf(local_stdout, "  (%" APR_SIZE_T_FMT " byte body; "
+                    "JIT, interpreter, POSIX per search)\n", len);
+    return failures;
+}
+
+typedef struct {
+    const char *pattern;
+    const char *subject;
+    int eflags;
+    int so, eo;                     /* the window, with FLOOD_REG_STARTEND */
+    int groups[CHECK_NMATCH][2];    /* { -2, -2 } for no match at all */
+} match_check_t;
+
+static const match_check_t matches[] = {
+    /* groups that didn't take part, or that the pattern hasn't got */
+    { "(a)|(b)", "b", 0, 0, 0,
+      { { 0, 1 }, { -1, -1 }, { 0, 1 }, { -1, -1 } } },
+    { "x(y)?z", "xz", 0, 0, 0,
+      { { 0, 2 }, { -1, -1 }, { -1, -1 }, { -1, -1 } } },
+    { "q", "abc", 0, 0, 0, { { -2, -2 } } },
+    /* a window finds only what is inside it, and offsets still count
+     * from the start of the string */
+    { "id=([0-9]+)", "id=1 id=22 id=333", FLOOD_REG_STARTEND, 5, 17,
+      { { 5, 10 }, { 8, 10 }, { -1, -1 }, { -1, -1 } } },
+    { "id=([0-9]+)", "id=1 id=22 id=333", FLOOD_REG_STARTEND, 5, 9,
+      { { 5, 9 }, { 8, 9 }, { -1, -1 }, { -1, -1 } } },
+    { "id=([0-9]+)", "id=1 id=22 id=333", FLOOD_REG_STARTEND, 11, 13,
+      { { -2, -2 } } },
+    { "3$", "id=1 id=22 id=333", FLOOD_REG_STARTEND, 0, 16,
+      { { 15, 16 }, { -1, -1 }, { -1, -1 }, { -1, -1 } } },
+    { "^id", "id=1 id=22", FLOOD_REG_STARTEND | FLOOD_REG_NOTBOL, 0, 10,
+      { { -2, -2 } } },
+    { NULL }
+};
+
+/* Each subject is copied into a buffer of its own length, without a
+ * NUL, so that reading past the window would be caught. */
+static int check_match(const match_check_t *c)
+{
+    flood_regex_t re;
+    flood_regmatch_t m[CHECK_NMATCH];
+    apr_size_t len = strlen(c->subject);
+    char *subject;
+    int i, rc, failures = 0;
+
+    if (flood_regcomp(&re, c->pattern, 0) != 0) {
+        apr_file_printf(local_stderr, "'%s' didn't compile\n", c->pattern);
+        return 1;
+    }
+
+    subject = malloc(len ? len : 1);
+    memcpy(subject, c->subject, len);
+
+    for (i = 0; i < CHECK_NMATCH; i++)
+        m[i].rm_so = m[i].rm_eo = 99;
+    m[0].rm_so = c->so;
+    m[0].rm_eo = c->eo;
+
+    rc = flood_regexec(&re, (c->eflags & FLOOD_REG_STARTEND) ? subject
+                                                            : c->subject,
+                       CHECK_NMATCH, m, c->eflags);
+    if ((rc == 0) != (c->groups[0][0] != -2)) {
+        apr_file_printf(local_stderr, "'%s' against '%s': %s\n", c->pattern,
+                        c->subject, rc ? "no match" : "matched");
+        failures++;
+    }
+    for (i = 0; rc == 0 && c->groups[0][0] != -2 && i < CHECK_NMATCH; i++) {
+        if (m[i].rm_so != c->groups[i][0] || m[i].rm_eo != c->groups[i][1]) {
+            apr_file_printf(local_stderr, "'%s' against '%s', group %d: got "
+                            "(%d, %d), wanted (%d, %d)\n", c->pattern,
+                            c->subject, i, m[i].rm_so, m[i].rm_eo,
+                            c->groups[i][0], c->groups[i][1]);
+            failures++;
+        }
+    }
+
+    free(subject);
+    flood_regfree(&re);
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    apr_pool_t *pool;
+    const match_check_t *c;
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    int failures = 0;
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    apr_pool_create(&pool, NULL);
+    apr_file_open_stdout(&local_stdout, pool);
+    apr_file_open_stderr(&local_stderr, pool);
+
+    for (c = matches; c->pattern; c++)
+        failures += check_match(c);
+    failures += check_body(make_body(pool), rounds);
+
+    apr_file_printf(local_stdout, "check_pcre: %s\n",
+                    failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+    apr_pool_t *pool;
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    apr_pool_create(&pool, NULL);
+    apr_file_open_stdout(&local_stdout, pool);
+    apr_file_printf(local_stdout, "check_pcre: skipped, flood was built "
+                    "without PCRE2\n");
+    return 0;
+}
+
+#endif /* FLOOD_USE_PCRE */
@@ -0,0 +1,282 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_general.h> /* For apr_initialize */
+#include <apr_file_io.h>
+#include <apr_pools.h>
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* atexit */
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>     /* strlen */
+#endif
+
+#include "config.h"
+#include "flood_profile.h"
+
+/* Checks of how responses are kept and picked apart.  Run by
+ * "make check". */
+
+apr_file_t *local_stdout, *local_stderr;
+
+static int failures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            apr_file_printf(local_stderr, "%s:%d: %s\n", \
+                            __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+/* A response whose first read was all of text. */
+static response_t *make_resp(const char *text, apr_pool_t *pool)
+{
+    response_t *resp = apr_pcalloc(pool, sizeof(response_t));
+
+    resp->rbuftype = POOL;
+    resp->rbuf = apr_pstrdup(pool, text);
+    resp->rbufsize = strlen(text);
+    return resp;
+}
+
+/* Is the value at v, len bytes long, want? */
+static int is_value(const char *v, apr_size_t len, const char *want)
+{
+    return v && len == strlen(want) && memcmp(v, want, len) == 0;
+}
+
+static void check_status(apr_pool_t *pool)
+{
+    static const char *malformed[] = {
+        "HTTP/1.1 20 OK\r\n",
+        "HTTP/1.1 2x0 OK\r\n",
+        "HTTP/x.1 200 OK\r\n",
+        "HTTP/1.1200 OK\r\n",
+        "HTTP/1.",
+        "ICY 200 OK\r\n",
+        "",
+        NULL
+    };
+    static const char *bad_lists[] = {
+        "99", "1000", "200-", "299-200", "2xxx", "200;304", "abc", NULL
+    };
+    response_t *resp;
+    unsigned char *mask;
+    const char **s;
+
+    resp = make_resp("HTTP/1.1 404 Not Found\r\nServer: x\r\n\r\n", pool);
+    flood_parse_status(resp);
+    CHECK(resp->version == 11 && resp->status == 404);
+    CHECK(resp->reasonlen == 9 && memcmp(resp->reason, "Not Found", 9) == 0);
+
+    resp = make_resp("HTTP/1.0 200 OK\n", pool);
+    flood_parse_status(resp);
+    CHECK(resp->version == 10 && resp->status == 200);
+    CHECK(resp->reasonlen == 2 && memcmp(resp->reason, "OK", 2) == 0);
+
+    /* No minor version, and no reason. */
+    resp = make_resp("HTTP/2 200\r\n\r\n", pool);
+    flood_parse_status(resp);
+    CHECK(resp->version == 20 && resp->status == 200);
+    CHECK(resp->reasonlen == 0);
+
+    /* A status already set by the socket group is left alone. */
+    resp = make_resp("HTTP/1.1 500 Oops\r\n", pool);
+    resp->status = 204;
+    flood_parse_status(resp);
+    CHECK(resp->status == 204);
+
+    for (s = malformed; *s; s++) {
+        resp = make_resp(*s, pool);
+        flood_parse_status(resp);
+        if (resp->status != 0 || resp->version != 0) {
+            apr_file_printf(local_stderr, "Status line '%s' was parsed\n", *s);
+            failures++;
+        }
+    }
+
+    CHECK(flood_parse_status_list(&mask, "2xx, 304 400-404", pool)
+                                                            == APR_SUCCESS);
+    CHECK(flood_status_listed(mask, 200) && flood_status_listed(mask, 299));
+    CHECK(flood_status_listed(mask, 304));
+    CHECK(flood_status_listed(mask, 400) && flood_status_listed(mask, 404));
+    CHECK(!flood_status_listed(mask, 199) && !flood_status_listed(mask, 300));
+    CHECK(!flood_status_listed(mask, 405) && !flood_status_listed(mask, 0));
+    CHECK(!flood_status_listed(mask, 1000));
+
+    for (s = bad_lists; *s; s++) {
+        if (flood_parse_status_list(&mask, *s, pool) == APR_SUCCESS) {
+            apr_file_printf(local_stderr, "Status list '%s' was taken\n", *s);
+            failures++;
+        }
+    }
+}
+
+static void check_headers(apr_pool_t *pool)
+{
+    static const char text[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 5\r\n"
+        "connection:  close \r\n"
+        "Set-Cookie: a=1\r\n"
+        "Set-Cookie: b=2\r\n"
+        "X-Empty:\r\n"
+        "not a header\r\n"
+        "\r\n"
+        "hello";
+    response_t *resp;
+    const char *v;
+    apr_size_t len;
+
+    resp = make_resp(text, pool);
+    CHECK(flood_header_get(resp, "Content-Length", &len) == NULL);
+
+    flood_index_headers(resp, pool);
+    CHECK(resp->indexed);
+    CHECK(resp->nheaders == 5);
+    CHECK(resp->headerlen == strlen(text) - strlen("hello"));
+
+    /* Names are matched without regard to case, values are trimmed. */
+    v = flood_header_known(resp, FLOOD_HEADER_CONNECTION, &len);
+    CHECK(is_value(v, len, "close"));
+    v = flood_header_known(resp, FLOOD_HEADER_CONTENT_LENGTH, &len);
+    CHECK(is_value(v, len, "5"));
+    v = flood_header_known(resp, FLOOD_HEADER_SET_COOKIE, &len);
+    CHECK(is_value(v, len, "a=1"));
+    CHECK(flood_header_known(resp, FLOOD_HEADER_TRANSFER_ENCODING,
+                             &len) == NULL);
+
+    v = flood_header_get(resp, "CONTENT-LENGTH", &len);
+    CHECK(is_value(v, len, "5"));
+    v = flood_header_get(resp, "x-empty", &len);
+    CHECK(is_value(v, len, ""));
+    CHECK(flood_header_get(resp, "Content", &len) == NULL);
+    CHECK(flood_header_get(resp, "not a header", &len) == NULL);
+
+    /* Every Set-Cookie is in the index, in order. */
+    CHECK(resp->header[2].known == FLOOD_HEADER_SET_COOKIE);
+    CHECK(resp->header[3].known == FLOOD_HEADER_SET_COOKIE);
+    CHECK(is_value(resp->rbuf + resp->header[3].value,
+                   resp->header[3].valuelen, "b=2"));
+
+    /* Bare newlines, and no body. */
+    resp = make_resp("HTTP/1.0 204 No Content\n"
+                     "Transfer-Encoding: chunked\n"
+                     "\n", pool);
+    flood_index_headers(resp, pool);
+    CHECK(resp->nheaders == 1);
+    CHECK(resp->headerlen == resp->rbufsize);
+    v = flood_header_known(resp, FLOOD_HEADER_TRANSFER_ENCODING, &len);
+    CHECK(is_value(v, len, "chunked"));
+
+    /* Headers cut off before their end: what is whole is indexed, but
+     * nobody is told where the body starts. */
+    resp = make_resp("HTTP/1.1 200 OK\r\n"
+                     "Connection: keep-alive\r\n"
+                     "Content-Len", pool);
+    flood_index_headers(resp, pool);
+    CHECK(resp->nheaders == 1);
+    CHECK(resp->headerlen == 0);
+    CHECK(flood_header_known(resp, FLOOD_HEADER_CONTENT_LENGTH,
+                             &len) == NULL);
+
+    /* Nothing read at all. */
+    resp = apr_pcalloc(pool, sizeof(response_t));
+    flood_index_headers(resp, pool);
+    CHECK(resp->indexed && resp->nheaders == 0);
+    CHECK(flood_header_known(resp, FLOOD_HEADER_CONNECTION, &len) == NULL);
+}
+
+static void check_segments(apr_pool_t *pool)
+{
+    static const char head[] = "HTTP/1.1 200 OK\r\n\r\n";
+    const apr_size_t bodylen = 2 * FLOOD_SEG_SIZE + 1000;
+    response_t *resp;
+    flood_seg_t *seg;
+    apr_size_t i, n, room, want, segs;
+    char *cp, *rbuf;
+
+    /* Read a body into segments in uneven pieces, as reads come. */
+    resp = make_resp(head, pool);
+    for (i = 0, n = 1; i < bodylen; i += want, n = n * 7 % 3001 + 1) {
+        cp = flood_response_room(resp, &room, pool);
+        CHECK(room > 0 && room <= FLOOD_SEG_SIZE);
+        want = n < room ? n : room;
+        if (want > bodylen - i)
+            want = bodylen - i;
+        memset(cp, 'a' + i % 26, want);
+        flood_response_grow(resp, want);
+    }
+    CHECK(resp->seglen == bodylen);
+    CHECK(resp->rbufsize == strlen(head));
+
+    /* Every segment is full but the last. */
+    segs = 0;
+    for (seg = resp->seg; seg; seg = seg->next) {
+        segs++;
+        CHECK(seg->next ? seg->len == FLOOD_SEG_SIZE : seg->len == 1000);
+    }
+    CHECK(segs == 3);
+    CHECK(resp->lastseg && resp->lastseg->next == NULL);
+
+    flood_response_flatten(resp, pool);
+    CHECK(resp->seg == NULL && resp->lastseg == NULL && resp->seglen == 0);
+    CHECK(resp->rbufsize == strlen(head) + bodylen);
+    CHECK(resp->rbuf[resp->rbufsize] == '\0');
+    CHECK(memcmp(resp->rbuf, head, strlen(head)) == 0);
+    CHECK(resp->rbuf[strlen(head)] == 'a');
+    CHECK(resp->rbuf[resp->rbufsize - 1] != '\0');
+
+    /* Flattening again changes nothing. */
+    rbuf = resp->rbuf;
+    flood_response_flatten(resp, pool);
+    CHECK(resp->rbuf == rbuf && resp->rbufsize == strlen(head) + bodylen);
+
+    /* A response that came in one read is terminated where it is. */
+    resp = apr_pcalloc(pool, sizeof(response_t));
+    resp->rbufsize = strlen(head);
+    resp->rbuf = rbuf = apr_palloc(pool, resp->rbufsize + 1);
+    memcpy(resp->rbuf, head, resp->rbufsize);
+    resp->rbuf[resp->rbufsize] = 'x';
+    flood_response_flatten(resp, pool);
+    CHECK(resp->rbuf == rbuf && resp->rbufsize == strlen(head));
+    CHECK(strcmp(resp->rbuf, head) == 0);
+}
+
+int main(int argc, char **argv)
+{
+    apr_pool_t *pool;
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    apr_pool_create(&pool, NULL);
+    apr_file_open_stdout(&local_stdout, pool);
+    apr_file_open_stderr(&local_stderr, pool);
+
+    check_status(pool);
+    check_headers(pool);
+    check_segments(pool);
+
+    apr_file_printf(local_stdout, "check_response: %s\n",
+                    failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
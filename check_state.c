@@ -0,0 +1,141 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_general.h> /* For apr_initialize */
+#include <apr_file_io.h>
+#include <apr_pools.h>
+#include <apr_strings.h>
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* atexit */
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>     /* strcmp */
+#endif
+
+#include "config.h"
+#include "flood_state.h"
+
+/* Checks of the variables profiles keep between requests.  Run by
+ * "make check". */
+
+apr_file_t *local_stdout, *local_stderr;
+
+#define CHECK_REQUESTS 1000000
+
+/* What one request sets, much as a profile with a responsetemplate, a
+ * responsejson, a responsecoprocess and a ${=random} would. */
+static void one_request(flood_state_t *state, int n, apr_pool_t *pool)
+{
+    char buf[64];
+    const char *line;
+
+    /* a session id whose length comes and goes */
+    apr_snprintf(buf, sizeof(buf), "%0*d", 20 + n % 17, n);
+    flood_state_set(state, "session", APR_HASH_KEY_STRING, buf,
+                    strlen(buf));
+
+    apr_snprintf(buf, sizeof(buf), "%d", n * 7);
+    flood_state_set(state, "cart.total", APR_HASH_KEY_STRING, buf,
+                    strlen(buf));
+
+    /* a co-process's name=value line, set from its own buffer */
+    line = apr_psprintf(pool, "token=%x", n);
+    flood_state_set(state, line, 5, line + 6, strlen(line + 6));
+
+    /* a ${=rand} picked out of the middle of a template */
+    apr_snprintf(buf, sizeof(buf), "%u", (unsigned)(n * 2654435761u));
+    flood_state_set(state, "${=rand}" + 3, 4, buf, strlen(buf));
+}
+
+int main(int argc, char **argv)
+{
+    apr_pool_t *pool, *reqpool;
+    flood_state_t *state;
+    apr_size_t warm = 0;
+    const char *value;
+    int n, failures = 0;
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    apr_pool_create(&pool, NULL);
+    apr_pool_create(&reqpool, pool);
+    apr_file_open_stdout(&local_stdout, pool);
+    apr_file_open_stderr(&local_stderr, pool);
+
+    state = flood_state_create(pool);
+
+    if (flood_state_get(state, "session", APR_HASH_KEY_STRING)) {
+        apr_file_printf(local_stderr, "An empty state has a session\n");
+        failures++;
+    }
+
+    /* Once every variable has had its longest value, nothing more should
+     * be taken however many requests follow. */
+    for (n = 0; n < CHECK_REQUESTS; n++) {
+        one_request(state, n, reqpool);
+        apr_pool_clear(reqpool);
+        if (n == 1000)
+            warm = flood_state_bytes(state);
+    }
+    if (flood_state_bytes(state) != warm) {
+        apr_file_printf(local_stderr,
+                        "State grew from %" APR_SIZE_T_FMT " to %"
+                        APR_SIZE_T_FMT " bytes over %d requests\n",
+                        warm, flood_state_bytes(state), CHECK_REQUESTS);
+        failures++;
+    }
+
+    /* The last values, whichever way the names are given. */
+    n = CHECK_REQUESTS - 1;
+    value = flood_state_get(state, "session", 7);
+    if (!value || strlen(value) != 20 + n % 17 ||
+        atoi(value) != n) {
+        apr_file_printf(local_stderr, "session is %s\n",
+                        value ? value : "unset");
+        failures++;
+    }
+    value = flood_state_get(state, "token", APR_HASH_KEY_STRING);
+    if (!value || strcmp(value, apr_psprintf(pool, "%x", n)) != 0) {
+        apr_file_printf(local_stderr, "token is %s\n",
+                        value ? value : "unset");
+        failures++;
+    }
+    value = flood_state_get(state, "rand}", 4);
+    if (!value || strcmp(value, apr_psprintf(pool, "%u",
+                                     (unsigned)(n * 2654435761u))) != 0) {
+        apr_file_printf(local_stderr, "rand is %s\n",
+                        value ? value : "unset");
+        failures++;
+    }
+
+    /* A longer value still fits. */
+    flood_state_set(state, "session", APR_HASH_KEY_STRING,
+                    "0123456789012345678901234567890123456789", 40);
+    value = flood_state_get(state, "session", APR_HASH_KEY_STRING);
+    if (!value || strlen(value) != 40) {
+        apr_file_printf(local_stderr, "session is %s\n",
+                        value ? value : "unset");
+        failures++;
+    }
+
+    apr_file_printf(local_stdout, "check_state: %s\n",
+                    failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+#!/usr/bin/env python3
+# A responsecoprocess for round-robin-coprocess.xml.  flood starts it once
+# per farmer and hands it responses on stdin, each as a line holding its
+# length and URI followed by the response itself.  It answers each on
+# stdout with a line holding the length of its answer, then the answer:
+# "ok" or "fail <reason>", then name=value lines for flood to set.
+import re
+import sys
+
+inp = sys.stdin.buffer
+out = sys.stdout.buffer
+
+while True:
+    head = inp.readline()
+    if not head:
+        break
+    length, uri = head.decode().split(" ", 1)
+    response = inp.read(int(length))
+
+    docs = re.search(rb'<a href="(/docs/[^/"]*/)"', response)
+    if b"</html>" not in response.lower():
+        answer = "fail truncated page"
+    elif not docs:
+        answer = "fail no link to the docs"
+    else:
+        answer = "ok\ndocs=" + docs.group(1).decode()
+
+    answer = answer.encode()
+    out.write(b"%d\n" % len(answer) + answer)
+    out.flush()
@@ -0,0 +1,59 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+/* An example flood module: a verify_resp handler that counts anything but
+ * a 5xx as valid.  Build it against a configured flood tree with
+ *
+ *     cc -shared -fPIC `apr-1-config --cppflags --cflags --includes` \
+ *        -I/path/to/flood -o flood_mod_example.so flood_mod_example.c
+ *
+ * and name it in the config with <module>./flood_mod_example.so</module>
+ * (see round-robin-module.xml). */
+
+#include <apr_lib.h>
+
+#include "config.h"
+#include "flood_module.h"
+
+static apr_status_t verify_not_5xx(int *verified, profile_t *profile,
+                                   request_t *req, response_t *resp)
+{
+    const char *code;
+
+    /* "HTTP/1.1 503 ..." */
+    code = resp->rbufsize > 9 ? resp->rbuf + 9 : NULL;
+    if (code && apr_isdigit(*code) && *code != '5')
+        *verified = FLOOD_VALID;
+    else
+        *verified = FLOOD_INVALID;
+
+    return APR_SUCCESS;
+}
+
+static profile_event_handler_t example_handlers[] = {
+    {"verify_resp", "verify_not_5xx", &verify_not_5xx},
+    {NULL}
+};
+
+flood_module_t flood_module = {
+    FLOOD_MODULE_STUFF,
+    "example",
+    example_handlers,
+    NULL,
+    NULL
+};
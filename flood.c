@@ -20,6 +20,7 @@
 #include <apr_strings.h>
 #include <apr_file_io.h>
 #include <apr_pools.h>
+#include <apr_signal.h>
 
 #if APR_HAVE_STDLIB_H
 #include <stdlib.h>     /* rand/strtol */
@@ -33,11 +34,20 @@
 #include "flood_farm.h"
 #include "flood_farmer.h"
 #include "flood_config.h"
+#include "flood_mem.h"
 
 #if FLOOD_HAS_OPENSSL
 #include "flood_net_ssl.h" /* For ssl_init_socket */
 #endif /* FLOOD_HAS_OPENSSL */
 
+#if FLOOD_HAS_NGHTTP2
+#include "flood_socket_h2.h" /* For h2_init_socket */
+#endif /* FLOOD_HAS_NGHTTP2 */
+
+#if FLOOD_HAS_QUICHE
+#include "flood_socket_h3.h" /* For h3_init_socket */
+#endif /* FLOOD_HAS_QUICHE */
+
 /* Win32 doesn't have stdout or stderr. */
 apr_file_t *local_stdin, *local_stdout, *local_stderr;
 
@@ -142,6 +152,12 @@ int main(int argc, char** argv)
     apr_initialize();
     atexit(apr_terminate);
 
+#ifdef SIGPIPE
+    /* A server or co-process that goes away should fail the write to it,
+     * not take flood with it. */
+    apr_signal(SIGPIPE, SIG_IGN);
+#endif
+
     apr_pool_create(&local_pool, NULL);
 
 #if FLOOD_HAS_OPENSSL
@@ -149,10 +165,23 @@ int main(int argc, char** argv)
     /* Should be a run-time option with SSL, but Justin hates singleton. */
     ssl_init_socket(local_pool);
 #endif /* FLOOD_HAS_OPENSSL */
+
+#if FLOOD_HAS_NGHTTP2
+    h2_init_socket(local_pool);
+#endif /* FLOOD_HAS_NGHTTP2 */
+
+#if FLOOD_HAS_QUICHE
+    h3_init_socket(local_pool);
+#endif /* FLOOD_HAS_QUICHE */
    
     apr_file_open_stdout(&local_stdout, local_pool);
     apr_file_open_stderr(&local_stderr, local_pool);
 
+    if ((stat = flood_mem_init(local_pool)) != APR_SUCCESS) {
+        apr_file_printf(local_stderr, "Error setting up memory accounting.\n");
+        exit(-1);
+    }
+
     if (argc == 1) {
         apr_file_open_stdin(&local_stdin, local_pool);
     }
@@ -182,6 +211,11 @@ int main(int argc, char** argv)
         exit(-1);
     }
 
+    if ((stat = load_profile_modules(config, local_pool)) != APR_SUCCESS) {
+        apr_file_printf(local_stderr, "Error loading modules.\n");
+        exit(-1);
+    }
+
     if ((stat = run_farm(config, "Bingo", local_pool)) != APR_SUCCESS) {
         char buf[256];
         apr_strerror(stat, (char*) &buf, 256);
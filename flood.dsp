@@ -91,10 +91,22 @@ SOURCE=.\flood.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\flood_body.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\flood_config.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\flood_coproc.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\flood_crc32c.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\flood_easy_reports.c
 # End Source File
 # Begin Source File
@@ -107,6 +119,18 @@ SOURCE=.\flood_farmer.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\flood_json.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\flood_match.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\flood_mem.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\flood_net.c
 # End Source File
 # Begin Source File
@@ -123,6 +147,10 @@ SOURCE=.\flood_report_relative_times.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\flood_response.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\flood_round_robin.c
 # End Source File
 # Begin Source File
@@ -137,16 +165,40 @@ SOURCE=.\flood_socket_generic.c
 
 SOURCE=.\flood_socket_keepalive.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\flood_socket_h2.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\flood_socket_h3.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\flood_state.c
+# End Source File
 # End Group
 # Begin Group "includes"
 
 # PROP Default_Filter "*.h"
 # Begin Source File
 
+SOURCE=.\flood_body.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\flood_config.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\flood_coproc.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\flood_crc32c.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\flood_easy_reports.h
 # End Source File
 # Begin Source File
@@ -159,6 +211,22 @@ SOURCE=.\flood_farmer.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\flood_json.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\flood_match.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\flood_mem.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\flood_module.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\flood_net.h
 # End Source File
 # Begin Source File
@@ -189,6 +257,18 @@ SOURCE=.\flood_socket_generic.h
 
 SOURCE=.\flood_socket_keepalive.h
 # End Source File
+# Begin Source File
+
+SOURCE=.\flood_socket_h2.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\flood_socket_h3.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\flood_state.h
+# End Source File
 # End Group
 # End Target
 # End Project
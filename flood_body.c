@@ -0,0 +1,197 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_lib.h>
+#include <apr_strings.h>
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* atoi */
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>     /* memchr */
+#endif
+
+#include "flood_body.h"
+
+#define BODY_HEADERS 0
+#define BODY_IDENTITY 1
+#define BODY_CHUNK_SIZE 2
+#define BODY_CHUNK_DATA 3
+#define BODY_CHUNK_END 4
+#define BODY_TRAILER 5
+#define BODY_DONE 6
+
+void flood_body_init(flood_body_t *body, flood_body_fn_t fn, void *ctx)
+{
+    body->fn = fn;
+    body->ctx = ctx;
+    flood_body_reset(body);
+}
+
+void flood_body_reset(flood_body_t *body)
+{
+    body->state = BODY_HEADERS;
+    body->status = 0;
+    body->chunked = 0;
+    body->length = -1;
+    body->chunkleft = 0;
+    body->bodylen = 0;
+    body->linelen = 0;
+}
+
+/* Whether the header value holds the given lower-case token. */
+static int header_has(const char *value, const char *token)
+{
+    apr_size_t len = strlen(token);
+
+    for (; *value; value++) {
+        apr_size_t i;
+
+        for (i = 0; i < len && apr_tolower(value[i]) == token[i]; i++)
+            ;
+        if (i == len)
+            return 1;
+    }
+    return 0;
+}
+
+/* Act on the line just read.  Only as much of it as fits is looked at,
+ * which is all we need of the lines we care about. */
+static void body_line(flood_body_t *body)
+{
+    char *line = body->line, *end;
+    apr_size_t len = body->linelen;
+    apr_int64_t size;
+
+    if (len && line[len - 1] == '\r')
+        len--;
+    line[len] = '\0';
+    body->linelen = 0;
+
+    switch (body->state) {
+    case BODY_HEADERS:
+        if (!body->status) {
+            /* The status line: "HTTP/1.1 200 OK". */
+            end = strchr(line, ' ');
+            body->status = end ? atoi(end + 1) : 0;
+            if (body->status <= 0)
+                body->status = -1;
+        }
+        else if (len == 0) {
+            /* A 1xx response is followed by the real one. */
+            if (body->status >= 100 && body->status < 200) {
+                flood_body_reset(body);
+                break;
+            }
+            /* These never have a body, whatever the headers say. */
+            if (body->status == 204 || body->status == 304)
+                body->state = BODY_DONE;
+            else if (body->chunked)
+                body->state = BODY_CHUNK_SIZE;
+            else if (body->length == 0)
+                body->state = BODY_DONE;
+            else
+                body->state = BODY_IDENTITY;
+        }
+        else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0)
+            body->chunked = header_has(line + 18, "chunked");
+        else if (strncasecmp(line, "Content-Length:", 15) == 0)
+            body->length = apr_strtoi64(line + 15, NULL, 10);
+        break;
+    case BODY_CHUNK_SIZE:
+        size = apr_strtoi64(line, &end, 16);
+        if (end == line || size < 0)
+            body->state = BODY_DONE;
+        else if (size == 0)
+            body->state = BODY_TRAILER;
+        else {
+            body->chunkleft = (apr_size_t)size;
+            body->state = BODY_CHUNK_DATA;
+        }
+        break;
+    case BODY_CHUNK_END:
+        body->state = BODY_CHUNK_SIZE;
+        break;
+    case BODY_TRAILER:
+        if (len == 0)
+            body->state = BODY_DONE;
+        break;
+    }
+}
+
+/* Hand len bytes of body on. */
+static void body_pass(flood_body_t *body, const char *data, apr_size_t len)
+{
+    body->bodylen += len;
+    if (body->fn)
+        body->fn(body->ctx, data, len);
+}
+
+void flood_body_feed(flood_body_t *body, const char *data, apr_size_t len)
+{
+    const char *end = data + len, *eol;
+    apr_size_t n;
+
+    while (data < end) {
+        switch (body->state) {
+        case BODY_HEADERS:
+        case BODY_CHUNK_SIZE:
+        case BODY_CHUNK_END:
+        case BODY_TRAILER:
+            eol = memchr(data, '\n', end - data);
+            n = (eol ? eol : end) - data;
+            if (n > sizeof(body->line) - 1 - body->linelen)
+                n = sizeof(body->line) - 1 - body->linelen;
+            memcpy(body->line + body->linelen, data, n);
+            body->linelen += n;
+            if (!eol)
+                return;
+            data = eol + 1;
+            body_line(body);
+            break;
+        case BODY_IDENTITY:
+            n = end - data;
+            if (body->length >= 0 &&
+                (apr_int64_t)n > body->length - (apr_int64_t)body->bodylen)
+                n = (apr_size_t)(body->length - body->bodylen);
+            body_pass(body, data, n);
+            data += n;
+            if (body->length >= 0 &&
+                (apr_int64_t)body->bodylen == body->length)
+                body->state = BODY_DONE;
+            break;
+        case BODY_CHUNK_DATA:
+            n = end - data;
+            if (n > body->chunkleft)
+                n = body->chunkleft;
+            body_pass(body, data, n);
+            data += n;
+            body->chunkleft -= n;
+            if (!body->chunkleft)
+                body->state = BODY_CHUNK_END;
+            break;
+        default:
+            return;
+        }
+    }
+}
+
+int flood_body_done(flood_body_t *body)
+{
+    return body->state == BODY_DONE;
+}
@@ -0,0 +1,67 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#ifndef __flood_body_h
+#define __flood_body_h
+
+#include <apr_general.h>
+
+#include "config.h"
+
+/* Shown the body of a response a piece at a time. */
+typedef void (*flood_body_fn_t)(void *ctx, const char *data, apr_size_t len);
+
+/* Follows a raw HTTP response as it is read, and hands on only its body,
+ * with any chunked transfer coding taken off.  Nothing is kept but the
+ * header line being looked at. */
+typedef struct {
+    int state;
+    int status;               /* from the status line, once it is read */
+    int chunked;              /* a boolean */
+    apr_int64_t length;       /* from Content-Length, or -1 */
+    apr_size_t chunkleft;     /* of the chunk being passed on */
+    apr_size_t bodylen;       /* bytes of body passed on so far */
+    char line[FLOOD_STRLEN_MAX];
+    apr_size_t linelen;
+    flood_body_fn_t fn;
+    void *ctx;
+} flood_body_t;
+
+/**
+ * Set body up to pass what it finds to fn, or just follow the framing if
+ * fn is NULL.
+ */
+void flood_body_init(flood_body_t *body, flood_body_fn_t fn, void *ctx);
+
+/**
+ * Forget the response seen so far, ready for the next.
+ */
+void flood_body_reset(flood_body_t *body);
+
+/**
+ * Take the next len bytes of the response.
+ */
+void flood_body_feed(flood_body_t *body, const char *data, apr_size_t len);
+
+/**
+ * Whether the whole body has been seen, as far as its framing says.  A
+ * body that runs to the end of the connection is never known to be done.
+ */
+int flood_body_done(flood_body_t *body);
+
+#endif  /* __flood_body_h */
@@ -0,0 +1,154 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_errno.h>
+#include <apr_file_io.h>
+#include <apr_strings.h>
+#include <apr_thread_proc.h>
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* strtol */
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>     /* strlen */
+#endif
+
+#include "config.h"
+#include "flood_coproc.h"
+
+extern apr_file_t *local_stderr;
+
+struct flood_coproc_t {
+    const char *cmdline;
+    apr_interval_time_t timeout;
+    apr_pool_t *pool;
+    /* the running process and its pipes, or NULL */
+    apr_pool_t *procpool;
+    apr_proc_t proc;
+};
+
+apr_status_t flood_coproc_create(flood_coproc_t **coproc,
+                                 const char *cmdline,
+                                 apr_interval_time_t timeout,
+                                 apr_pool_t *pool)
+{
+    *coproc = apr_pcalloc(pool, sizeof(flood_coproc_t));
+    (*coproc)->cmdline = apr_pstrdup(pool, cmdline);
+    (*coproc)->timeout = timeout;
+    (*coproc)->pool = pool;
+
+    return APR_SUCCESS;
+}
+
+/* Kill the process, if it is running.  It is killed outright rather than
+ * given time to go, so that its farmer isn't held up waiting on it. */
+static void coproc_stop(flood_coproc_t *coproc)
+{
+    if (coproc->procpool) {
+        apr_pool_destroy(coproc->procpool);
+        coproc->procpool = NULL;
+    }
+}
+
+static apr_status_t coproc_fail(flood_coproc_t *coproc, const char *what,
+                                apr_status_t rv)
+{
+    char buf[120];
+
+    apr_file_printf(local_stderr, "Co-process '%s' %s: %s\n",
+                    coproc->cmdline, what, apr_strerror(rv, buf, sizeof(buf)));
+    coproc_stop(coproc);
+    return rv;
+}
+
+static apr_status_t coproc_start(flood_coproc_t *coproc)
+{
+    apr_procattr_t *procattr;
+    apr_status_t rv;
+    char **args;
+
+    if ((rv = apr_pool_create(&coproc->procpool, coproc->pool))
+                                                        != APR_SUCCESS)
+        return rv;
+
+    if ((rv = apr_procattr_create(&procattr, coproc->procpool))
+                                                        != APR_SUCCESS ||
+        (rv = apr_procattr_io_set(procattr, APR_FULL_BLOCK, APR_FULL_BLOCK,
+                                  APR_NO_PIPE)) != APR_SUCCESS ||
+        (rv = apr_procattr_error_check_set(procattr, 1)) != APR_SUCCESS)
+        return coproc_fail(coproc, "can't be set up", rv);
+
+    apr_tokenize_to_argv(coproc->cmdline, &args, coproc->procpool);
+    if ((rv = apr_proc_create(&coproc->proc, args[0],
+                              (const char * const *)args, NULL, procattr,
+                              coproc->procpool)) != APR_SUCCESS)
+        return coproc_fail(coproc, "can't be spawned", rv);
+    apr_pool_note_subprocess(coproc->procpool, &coproc->proc,
+                             APR_KILL_ALWAYS);
+
+    if ((rv = apr_file_pipe_timeout_set(coproc->proc.in, coproc->timeout))
+                                                        != APR_SUCCESS ||
+        (rv = apr_file_pipe_timeout_set(coproc->proc.out, coproc->timeout))
+                                                        != APR_SUCCESS)
+        return coproc_fail(coproc, "can't be set up", rv);
+
+    return APR_SUCCESS;
+}
+
+apr_status_t flood_coproc_call(flood_coproc_t *coproc, const char *uri,
+                               const char *data, apr_size_t len,
+                               char **answer, apr_size_t *answerlen,
+                               apr_pool_t *pool)
+{
+    apr_status_t rv;
+    char line[64], *endptr;
+    const char *head;
+    long size;
+
+    if (!coproc->procpool && (rv = coproc_start(coproc)) != APR_SUCCESS)
+        return rv;
+
+    head = apr_psprintf(pool, "%" APR_SIZE_T_FMT " %s\n", len, uri);
+    if ((rv = apr_file_write_full(coproc->proc.in, head, strlen(head),
+                                  NULL)) != APR_SUCCESS ||
+        (rv = apr_file_write_full(coproc->proc.in, data, len,
+                                  NULL)) != APR_SUCCESS)
+        return coproc_fail(coproc, "can't be written to", rv);
+
+    if ((rv = apr_file_gets(line, sizeof(line), coproc->proc.out))
+                                                        != APR_SUCCESS)
+        return coproc_fail(coproc, "didn't answer", rv);
+    size = strtol(line, &endptr, 10);
+    if (endptr == line || (*endptr != '\n' && *endptr != '\r') ||
+        size < 0 || size > FLOOD_COPROC_ANSWER_MAX) {
+        apr_file_printf(local_stderr,
+                        "Co-process '%s' answered with a bad length: %s\n",
+                        coproc->cmdline, line);
+        coproc_stop(coproc);
+        return APR_EGENERAL;
+    }
+
+    *answer = apr_palloc(pool, size + 1);
+    if ((rv = apr_file_read_full(coproc->proc.out, *answer, size,
+                                 NULL)) != APR_SUCCESS)
+        return coproc_fail(coproc, "didn't answer", rv);
+    (*answer)[size] = '\0';
+    *answerlen = size;
+
+    return APR_SUCCESS;
+}
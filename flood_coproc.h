@@ -0,0 +1,60 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#ifndef __flood_coproc_h
+#define __flood_coproc_h
+
+#include <apr_pools.h>
+#include <apr_time.h>
+
+/* A script that is started once and then handed response after response
+ * over its stdin, answering each on its stdout, rather than being started
+ * for every response.
+ *
+ * Each response goes to the script as a line holding its length in bytes
+ * and the URI it came from, then the response itself:
+ *
+ *     <length> <uri>\n<length bytes>
+ *
+ * and each answer comes back the same way, without the URI:
+ *
+ *     <length>\n<length bytes>
+ *
+ * What the answer says is up to the caller. */
+typedef struct flood_coproc_t flood_coproc_t;
+
+/**
+ * Set up a co-process for the command line, which is started when it is
+ * first called.  Each wait on it may take up to timeout.
+ */
+apr_status_t flood_coproc_create(flood_coproc_t **coproc,
+                                 const char *cmdline,
+                                 apr_interval_time_t timeout,
+                                 apr_pool_t *pool);
+
+/**
+ * Hand the co-process a response, and wait for its answer, which is
+ * allocated from pool and NUL-terminated.  A co-process that fails to
+ * answer is killed, and started again when it is next called.
+ */
+apr_status_t flood_coproc_call(flood_coproc_t *coproc, const char *uri,
+                               const char *data, apr_size_t len,
+                               char **answer, apr_size_t *answerlen,
+                               apr_pool_t *pool);
+
+#endif  /* __flood_coproc_h */
@@ -0,0 +1,31 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#ifndef __flood_crc32c_h
+#define __flood_crc32c_h
+
+#include <apr_general.h>
+
+/**
+ * Carry the CRC32C (Castagnoli) of some data on over len more bytes.
+ * Start with a crc of 0; the result of one call can be passed to the
+ * next, so the data needn't all be there at once.
+ */
+apr_uint32_t flood_crc32c(apr_uint32_t crc, const void *data, apr_size_t len);
+
+#endif  /* __flood_crc32c_h */
@@ -70,7 +70,8 @@ apr_status_t easy_process_stats(report_t *report, int verified, request_t *req,
         foo = apr_pstrcat(easy->pool, foo, " FAIL", NULL);
         break;
     default:
-        foo = apr_psprintf(easy->pool, "%s %d", foo, verified);
+        foo = apr_psprintf(easy->pool, "%s %s", foo,
+                           flood_error_name(verified));
     }
 
 #if APR_HAS_THREADS
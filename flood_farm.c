@@ -19,6 +19,10 @@
 #include <apr_errno.h>
 #include <apr_thread_proc.h>
 #include <apr_strings.h>
+#if APR_HAS_THREADS
+#include <apr_thread_cond.h>
+#include <apr_thread_mutex.h>
+#endif
 
 #if APR_HAVE_STRINGS_H
 #include <strings.h>    /* strncasecmp */
@@ -32,6 +36,7 @@
 
 #include "config.h"
 #include "flood_farmer.h"
+#include "flood_mem.h"
 
 #include "flood_farm.h"
 
@@ -55,6 +60,32 @@ struct farmer_worker_info_t {
 };
 typedef struct farmer_worker_info_t farmer_worker_info_t;
 
+#if APR_HAS_THREADS
+/* Reports the farmers' memory every interval until the farm is done. */
+struct mem_reporter_t {
+    apr_interval_time_t interval;
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t *cond;
+    int done;
+};
+typedef struct mem_reporter_t mem_reporter_t;
+
+static void * APR_THREAD_FUNC mem_reporter(apr_thread_t *thd, void *data)
+{
+    mem_reporter_t *reporter = (mem_reporter_t *)data;
+
+    apr_thread_mutex_lock(reporter->mutex);
+    while (!reporter->done) {
+        if (apr_thread_cond_timedwait(reporter->cond, reporter->mutex,
+                                      reporter->interval) == APR_TIMEUP)
+            flood_mem_report(local_stderr, "running");
+    }
+    apr_thread_mutex_unlock(reporter->mutex);
+
+    return NULL;
+}
+#endif
+
 #if APR_HAS_THREADS
 /**
  * Worker function that is assigned to a thread. Each worker is
@@ -67,9 +98,13 @@ static void * APR_THREAD_FUNC farmer_worker(apr_thread_t *thd, void *data)
     farmer_worker_info_t *info;
 
     info = (farmer_worker_info_t *)data;
-    pool = apr_thread_pool_get(thd);
+    if ((stat = flood_mem_pool_create(&pool)) != APR_SUCCESS) {
+        apr_file_printf(local_stderr,
+                        "Unable to create a pool for farmer '%s'.\n",
+                        info->farmer_name);
+        return NULL;
+    }
 
-    /* should we create a subpool here? */
 #ifdef FARM_DEBUG
     apr_file_printf(local_stdout, "Starting farmer_worker thread '%s'.\n",
                     info->farmer_name);
@@ -84,6 +119,8 @@ static void * APR_THREAD_FUNC farmer_worker(apr_thread_t *thd, void *data)
         /* just die for now, later try to return status */
     }
 
+    apr_pool_destroy(pool);
+
 #if 0 /* this gets uncommented after apr_thread_exit() fixes are commited */
     apr_thread_exit(thd, APR_SUCCESS);
 #endif
@@ -97,9 +134,13 @@ static void *farmer_worker(void *data)
     farmer_worker_info_t *info;
 
     info = (farmer_worker_info_t *)data;
-    apr_pool_create(&pool, NULL);
+    if ((stat = flood_mem_pool_create(&pool)) != APR_SUCCESS) {
+        apr_file_printf(local_stderr,
+                        "Unable to create a pool for farmer '%s'.\n",
+                        info->farmer_name);
+        return NULL;
+    }
 
-    /* should we create a subpool here? */
 #ifdef FARM_DEBUG
     apr_file_printf(local_stdout, "Starting farmer_worker child '%s'.\n",
                     info->farmer_name);
@@ -114,6 +155,9 @@ static void *farmer_worker(void *data)
         /* just die for now, later try to return status */
     }
 
+    /* each child keeps its own accounts */
+    flood_mem_report(local_stderr, "done");
+
     return NULL;
 }
 #endif
@@ -122,13 +166,16 @@ apr_status_t run_farm(config_t *config, const char *farm_name, apr_pool_t *pool)
 {
 #if APR_HAS_THREADS
     apr_status_t child_stat;
+    apr_thread_t *reporter_thread = NULL;
+    mem_reporter_t *reporter = NULL;
 #endif
     apr_status_t stat;
     int usefarmer_count, i, j;
     long farmer_start_count = 1;
     apr_time_t farmer_start_delay;
+    apr_interval_time_t memreport;
     char *xml_farm, **usefarmer_names;
-    struct apr_xml_elem *e, *root_elem, *farm_elem;
+    struct apr_xml_elem *e, *root_elem, *farm_elem, *memreport_elem;
     struct apr_xml_attr *use_elem;
     farm_t *farm;
     farmer_worker_info_t *infovec;
@@ -148,6 +195,26 @@ apr_status_t run_farm(config_t *config, const char *farm_name, apr_pool_t *pool)
              xml_farm, XML_FARM_NAME, farm_name)) != APR_SUCCESS)
         return stat;
 
+    /* get the memory report interval (optional) */
+    memreport = 0;
+    stat = retrieve_xml_elem_child(&memreport_elem, farm_elem,
+                                   XML_FARM_MEMREPORT);
+    if (stat == APR_SUCCESS && memreport_elem->first_cdata.first &&
+        memreport_elem->first_cdata.first->text) {
+        char *endptr;
+        memreport = strtoll(memreport_elem->first_cdata.first->text,
+                            &endptr, 10);
+        if (*endptr != '\0' || memreport < 0)
+        {
+            apr_file_printf(local_stderr,
+                            "Attribute %s has invalid value %s.\n",
+                            XML_FARM_MEMREPORT,
+                            memreport_elem->first_cdata.first->text);
+            return APR_EGENERAL;
+        }
+        memreport *= APR_USEC_PER_SEC;
+    }
+
     /* count the number of "usefarmer" children */
     usefarmer_count = 0;
     for (e = farm_elem->first_child; e; e = e->next) {
@@ -232,7 +299,26 @@ apr_status_t run_farm(config_t *config, const char *farm_name, apr_pool_t *pool)
     farm->farmers = apr_pcalloc(pool, 
                                 sizeof(apr_thread_t*) * (usefarmer_count + 1));
     apr_thread_mutex_create(&config->mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+
+    if (memreport > 0) {
+        reporter = apr_pcalloc(pool, sizeof(mem_reporter_t));
+        reporter->interval = memreport;
+        if ((stat = apr_thread_mutex_create(&reporter->mutex,
+                                            APR_THREAD_MUTEX_DEFAULT,
+                                            pool)) != APR_SUCCESS ||
+            (stat = apr_thread_cond_create(&reporter->cond,
+                                           pool)) != APR_SUCCESS ||
+            (stat = apr_thread_create(&reporter_thread, NULL, mem_reporter,
+                                      reporter, pool)) != APR_SUCCESS) {
+            return stat;
+        }
+    }
 #else
+    if (memreport > 0) {
+        apr_file_printf(local_stderr,
+                        "Each farmer is a process of its own; "
+                        "memory is reported only as each one finishes.\n");
+    }
     farm->farmers = apr_pcalloc(pool, 
                                 sizeof(apr_proc_t*) * (usefarmer_count + 1));
 
@@ -286,6 +372,18 @@ apr_status_t run_farm(config_t *config, const char *farm_name, apr_pool_t *pool)
         }
     }
 
+#if APR_HAS_THREADS
+    if (reporter_thread) {
+        apr_thread_mutex_lock(reporter->mutex);
+        reporter->done = 1;
+        apr_thread_cond_signal(reporter->cond);
+        apr_thread_mutex_unlock(reporter->mutex);
+        apr_thread_join(&child_stat, reporter_thread);
+    }
+
+    flood_mem_report(local_stderr, "done");
+#endif
+
     return APR_SUCCESS;
 }
 
@@ -41,13 +41,32 @@
 extern apr_file_t *local_stdout;
 extern apr_file_t *local_stderr;
 
+#define FARMER_CTX_KEY "flood_farmer_ctx"
+
+farmer_ctx_t *farmer_ctx_get(apr_pool_t *pool)
+{
+    void *ctx;
+
+    /* The farmer's pool is an ancestor of every pool it hands out. */
+    for (; pool; pool = apr_pool_parent_get(pool)) {
+        apr_pool_userdata_get(&ctx, FARMER_CTX_KEY, pool);
+        if (ctx)
+            return ctx;
+    }
+
+    return NULL;
+}
+
 apr_status_t run_farmer(config_t *config, const char *farmer_name, apr_pool_t *pool)
 {
     apr_status_t stat;
-    int count, i, j, useprofile_count;
+    int count, warmup, i, j, useprofile_count;
     char *xml_farmer, **useprofile_names;
-    struct apr_xml_elem *e, *root_elem, *farmer_elem, *count_elem, *time_elem;
+    struct apr_xml_elem *e, *root_elem, *farmer_elem, *count_elem, *time_elem,
+                        *warmup_elem, *memlimit_elem;
     apr_pool_t *farmer_pool;
+    apr_size_t memlimit;
+    farmer_ctx_t *ctx;
     apr_time_t stop_time;
 
 #ifdef FARMER_DEBUG
@@ -107,6 +126,40 @@ apr_status_t run_farmer(config_t *config, const char *farmer_name, apr_pool_t *p
         stop_time *= APR_USEC_PER_SEC;
     }
 
+    /* get warm-up connection count (optional) */
+    warmup = 0;
+    stat = retrieve_xml_elem_child(&warmup_elem, farmer_elem, XML_FARMER_WARMUP);
+    if (stat == APR_SUCCESS && warmup_elem->first_cdata.first &&
+        warmup_elem->first_cdata.first->text) {
+        char *endptr;
+        warmup = strtol(warmup_elem->first_cdata.first->text, &endptr, 10);
+        if (*endptr != '\0' || warmup < 0)
+        {
+            apr_file_printf(local_stderr,
+                            "Attribute %s has invalid value %s.\n",
+                            XML_FARMER_WARMUP,
+                            warmup_elem->first_cdata.first->text);
+            return APR_EGENERAL;
+        }
+    }
+
+    /* get the most memory this farmer may hold (optional) */
+    memlimit = 0;
+    stat = retrieve_xml_elem_child(&memlimit_elem, farmer_elem,
+                                   XML_FARMER_MEMLIMIT);
+    if (stat == APR_SUCCESS && memlimit_elem->first_cdata.first &&
+        memlimit_elem->first_cdata.first->text) {
+        if (flood_mem_parse(&memlimit,
+                memlimit_elem->first_cdata.first->text) != APR_SUCCESS)
+        {
+            apr_file_printf(local_stderr,
+                            "Attribute %s has invalid value %s.\n",
+                            XML_FARMER_MEMLIMIT,
+                            memlimit_elem->first_cdata.first->text);
+            return APR_EGENERAL;
+        }
+    }
+
     /* count the number of "useprofile" children */
     useprofile_count = count_xml_elem_child(farmer_elem, XML_FARMER_USEPROFILE);
 
@@ -130,6 +183,23 @@ apr_status_t run_farmer(config_t *config, const char *farmer_name, apr_pool_t *p
         }
     }
 
+    ctx = apr_pcalloc(pool, sizeof(farmer_ctx_t));
+    ctx->pool = pool;
+    ctx->conns = apr_hash_make(pool);
+    ctx->coprocs = apr_hash_make(pool);
+    ctx->mem = flood_mem_register(farmer_name, memlimit);
+    apr_pool_userdata_setn(ctx, FARMER_CTX_KEY, NULL, pool);
+
+    /* open our connections before anything is timed */
+    if (warmup > 0) {
+        for (j = 0; j < useprofile_count; j++) {
+            if ((stat = warmup_profile(pool, config,
+                                       useprofile_names[j], warmup)) != APR_SUCCESS) {
+                return stat;
+            }
+        }
+    }
+
     /* now run each of the profiles */
     if (stop_time == -1)
     {
@@ -19,9 +19,31 @@
 #ifndef __flood_farmer_h
 #define __flood_farmer_h
 
+#include <apr_hash.h>
+
 #include "flood_config.h"
+#include "flood_mem.h"
 #include "flood_profile.h"
 
+/**
+ * State that outlives a single run of a profile, kept for the life of a
+ * farmer.  Socket groups park pre-warmed connections in conns, and
+ * profiles keep their running co-processes in coprocs, both allocated
+ * from pool; the farmer's memory is accounted for in mem.
+ */
+typedef struct farmer_ctx_t {
+    apr_pool_t *pool;
+    apr_hash_t *conns;
+    apr_hash_t *coprocs;
+    flood_mem_t *mem;
+} farmer_ctx_t;
+
+/**
+ * Find the context of the farmer that handed out the given pool, or NULL
+ * if the farmer keeps none.
+ */
+farmer_ctx_t *farmer_ctx_get(apr_pool_t *pool);
+
 /**
  * Run the given farmer name with the given config, and allocate any memory
  * needed for this process from the given pool.
@@ -0,0 +1,592 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_lib.h>
+#include <apr_strings.h>
+#include <apr_tables.h>
+#include <apr_file_io.h>
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* strtol */
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>     /* memchr */
+#endif
+
+#include "config.h"
+#include "flood_json.h"
+
+extern apr_file_t *local_stderr;
+
+/* Which paths are still in the running is kept as a bit each. */
+#define FLOOD_JSON_PATHS_MAX 32
+
+/* What the next byte of the document can be. */
+#define JSON_VALUE 0    /* the start of a value */
+#define JSON_ARRAY 1    /* the first value in an array, or its end */
+#define JSON_OBJECT 2   /* a member name, or the end of the object */
+#define JSON_NAME 3     /* more of a member name */
+#define JSON_COLON 4    /* the colon after a member name */
+#define JSON_STRING 5   /* more of a string value */
+#define JSON_LITERAL 6  /* more of a number, true, false or null */
+#define JSON_NEXT 7     /* a comma, or the end of the container */
+#define JSON_SKIP 8     /* more of a container no path leads into */
+#define JSON_DONE 9     /* nothing: we are finished with this document */
+
+typedef struct {
+    const char *name;   /* NULL for an array index */
+    apr_size_t len;
+    int index;
+} json_step_t;
+
+typedef struct {
+    const char *text;
+    json_step_t *step;
+    int steps;
+} json_path_t;
+
+struct flood_json_paths_t {
+    json_path_t *path;
+    int count;
+    int maxsteps;
+};
+
+/* A container that some path leads into. */
+typedef struct {
+    char type;          /* '{' or '[' */
+    apr_uint32_t live;  /* the paths that lead into it */
+    int index;          /* of the element being read, in an array */
+} json_frame_t;
+
+struct flood_json_t {
+    const flood_json_paths_t *paths;
+    apr_pool_t *pool;
+    const char **value;
+    apr_uint32_t pending;   /* the paths that haven't led anywhere yet */
+
+    int state;
+    int depth;              /* of frame[] in use */
+    json_frame_t *frame;
+    apr_size_t skipdepth;   /* how far into a skipped container we are */
+    int skipstring;         /* a boolean: in a string in one */
+
+    /* the string or literal being read */
+    apr_uint32_t want;      /* the paths that end at it */
+    int toolong;            /* a boolean: it didn't all fit */
+    int escape;             /* 1 after a backslash, 2-5 in \uXXXX */
+    unsigned int code;      /* of the \uXXXX */
+    unsigned int high;      /* a high surrogate waiting for its low */
+
+    char name[FLOOD_STRLEN_MAX];
+    apr_size_t namelen;
+    int namelong;           /* a boolean: it didn't all fit */
+    char *buf;              /* FLOOD_JSON_VALUE_MAX of it */
+    apr_size_t len;
+};
+
+static apr_status_t json_path_error(const char *text, const char *at)
+{
+    apr_file_printf(local_stderr, "Invalid JSON path (%s) at '%s'\n",
+                    text, at);
+    return APR_EGENERAL;
+}
+
+apr_status_t flood_json_compile(flood_json_paths_t **paths, const char *text,
+                                apr_pool_t *pool)
+{
+    apr_array_header_t *list, *steps;
+    const char *p = text, *start, *end;
+    json_path_t *path;
+    json_step_t *step;
+
+    *paths = apr_pcalloc(pool, sizeof(flood_json_paths_t));
+    list = apr_array_make(pool, 1, sizeof(json_path_t));
+    for (;;) {
+        while (*p == ',' || apr_isspace(*p))
+            p++;
+        if (!*p)
+            break;
+
+        start = p;
+        if (*p++ != '$')
+            return json_path_error(text, start);
+        steps = apr_array_make(pool, 4, sizeof(json_step_t));
+        while (*p == '.' || *p == '[') {
+            step = apr_array_push(steps);
+            if (*p == '.') {
+                for (end = ++p; *end && *end != '.' && *end != '[' &&
+                                *end != ',' && !apr_isspace(*end); end++)
+                    ;
+                if (end == p)
+                    return json_path_error(text, p);
+                step->name = apr_pstrmemdup(pool, p, end - p);
+                step->len = end - p;
+                p = end;
+            }
+            else if (p[1] == '"' || p[1] == '\'') {
+                end = strchr(p + 2, p[1]);
+                if (!end || end[1] != ']')
+                    return json_path_error(text, p);
+                step->name = apr_pstrmemdup(pool, p + 2, end - (p + 2));
+                step->len = end - (p + 2);
+                p = end + 2;
+            }
+            else {
+                char *endptr;
+                long index = strtol(p + 1, &endptr, 10);
+
+                if (endptr == p + 1 || *endptr != ']' || index < 0)
+                    return json_path_error(text, p);
+                step->name = NULL;
+                step->len = 0;
+                step->index = (int)index;
+                p = endptr + 1;
+            }
+        }
+        if (*p && *p != ',' && !apr_isspace(*p))
+            return json_path_error(text, p);
+
+        path = apr_array_push(list);
+        path->text = apr_pstrmemdup(pool, start, p - start);
+        path->step = (json_step_t *)steps->elts;
+        path->steps = steps->nelts;
+        if (path->steps > (*paths)->maxsteps)
+            (*paths)->maxsteps = path->steps;
+    }
+
+    if (!list->nelts || list->nelts > FLOOD_JSON_PATHS_MAX) {
+        apr_file_printf(local_stderr,
+                        "Give between 1 and %d JSON paths, not %d (%s)\n",
+                        FLOOD_JSON_PATHS_MAX, list->nelts, text);
+        return APR_EGENERAL;
+    }
+    (*paths)->path = (json_path_t *)list->elts;
+    (*paths)->count = list->nelts;
+
+    return APR_SUCCESS;
+}
+
+int flood_json_count(const flood_json_paths_t *paths)
+{
+    return paths->count;
+}
+
+const char *flood_json_path(const flood_json_paths_t *paths, int i)
+{
+    return paths->path[i].text;
+}
+
+flood_json_t *flood_json_create(const flood_json_paths_t *paths,
+                                apr_pool_t *pool)
+{
+    flood_json_t *json = apr_pcalloc(pool, sizeof(flood_json_t));
+
+    json->paths = paths;
+    json->pool = pool;
+    json->value = apr_palloc(pool, paths->count * sizeof(char *));
+    /* A path only leads into containers above its last step. */
+    json->frame = apr_palloc(pool, (paths->maxsteps + 1) *
+                                   sizeof(json_frame_t));
+    json->buf = apr_palloc(pool, FLOOD_JSON_VALUE_MAX);
+    flood_json_reset(json);
+
+    return json;
+}
+
+void flood_json_reset(flood_json_t *json)
+{
+    int i;
+
+    for (i = 0; i < json->paths->count; i++)
+        json->value[i] = NULL;
+    json->pending = json->paths->count == FLOOD_JSON_PATHS_MAX ?
+                    ~(apr_uint32_t)0 :
+                    ((apr_uint32_t)1 << json->paths->count) - 1;
+    json->state = JSON_VALUE;
+    json->depth = 0;
+    json->want = 0;
+}
+
+/* Keep more of the name or wanted value being read. */
+static void json_put(flood_json_t *json, const char *data, apr_size_t len)
+{
+    char *buf;
+    apr_size_t *used, size;
+
+    if (json->state == JSON_NAME) {
+        buf = json->name;
+        used = &json->namelen;
+        size = sizeof(json->name);
+    }
+    else if (json->want) {
+        buf = json->buf;
+        used = &json->len;
+        size = FLOOD_JSON_VALUE_MAX;
+    }
+    else
+        return;
+
+    if (len > size - *used) {
+        len = size - *used;
+        json->toolong = 1;
+    }
+    memcpy(buf + *used, data, len);
+    *used += len;
+}
+
+/* Keep a character given as \uXXXX, in UTF-8. */
+static void json_put_code(flood_json_t *json, unsigned int code)
+{
+    char utf8[4];
+    apr_size_t len;
+
+    if (code < 0x80) {
+        utf8[0] = (char)code;
+        len = 1;
+    }
+    else if (code < 0x800) {
+        utf8[0] = (char)(0xC0 | (code >> 6));
+        utf8[1] = (char)(0x80 | (code & 0x3F));
+        len = 2;
+    }
+    else if (code < 0x10000) {
+        utf8[0] = (char)(0xE0 | (code >> 12));
+        utf8[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (code & 0x3F));
+        len = 3;
+    }
+    else {
+        utf8[0] = (char)(0xF0 | (code >> 18));
+        utf8[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+        utf8[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+        utf8[3] = (char)(0x80 | (code & 0x3F));
+        len = 4;
+    }
+    json_put(json, utf8, len);
+}
+
+/* Take the next character of an escape sequence. */
+static void json_escape(flood_json_t *json, char c)
+{
+    if (json->escape == 1) {
+        switch (c) {
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case 'u':
+            json->escape = 2;
+            json->code = 0;
+            return;
+        }
+        json->escape = 0;
+        json_put(json, &c, 1);
+        return;
+    }
+
+    json->code <<= 4;
+    if (c >= '0' && c <= '9')
+        json->code |= c - '0';
+    else if (apr_isxdigit(c))
+        json->code |= apr_tolower(c) - 'a' + 10;
+    if (++json->escape < 6)
+        return;
+
+    json->escape = 0;
+    if (json->code >= 0xD800 && json->code < 0xDC00) {
+        json->high = json->code;
+        return;
+    }
+    if (json->code >= 0xDC00 && json->code < 0xE000 && json->high)
+        json->code = 0x10000 + ((json->high - 0xD800) << 10) +
+                     (json->code - 0xDC00);
+    json->high = 0;
+    json_put_code(json, json->code);
+}
+
+static void json_string_begin(flood_json_t *json)
+{
+    json->escape = 0;
+    json->high = 0;
+    json->toolong = 0;
+    if (json->state == JSON_NAME)
+        json->namelen = 0;
+    else
+        json->len = 0;
+}
+
+/* Read as much of a string as there is, up to its closing quote.
+ * Returns the bytes used, and says whether the string closed. */
+static apr_size_t json_string(flood_json_t *json, const char *data,
+                              apr_size_t len, int *closed)
+{
+    const char *p = data, *end = data + len, *stop, *b;
+
+    *closed = 0;
+    while (p < end) {
+        if (json->escape) {
+            json_escape(json, *p++);
+            continue;
+        }
+        /* Most of a document is strings, and most of a string is neither
+         * quote nor backslash: let memchr(), which the C library makes
+         * as fast as the machine can go, find them. */
+        stop = memchr(p, '"', end - p);
+        if (!stop)
+            stop = end;
+        if ((b = memchr(p, '\\', stop - p)))
+            stop = b;
+        json_put(json, p, stop - p);
+        p = stop;
+        if (p == end)
+            break;
+        p++;
+        if (*stop == '"') {
+            *closed = 1;
+            break;
+        }
+        json->escape = 1;
+    }
+    return p - data;
+}
+
+/* The paths that end at, or lead through, the value about to start. */
+static apr_uint32_t json_match(flood_json_t *json)
+{
+    json_frame_t *f;
+    apr_uint32_t live, match = 0;
+    int i;
+
+    if (!json->depth)
+        return json->pending;
+
+    f = &json->frame[json->depth - 1];
+    live = f->live & json->pending;
+    for (i = 0; live; i++, live >>= 1) {
+        json_step_t *step;
+
+        if (!(live & 1))
+            continue;
+        step = &json->paths->path[i].step[json->depth - 1];
+        if (f->type == '{' ? step->name && !json->namelong &&
+                             step->len == json->namelen &&
+                             memcmp(step->name, json->name, step->len) == 0
+                           : !step->name && step->index == f->index)
+            match |= (apr_uint32_t)1 << i;
+    }
+    return match;
+}
+
+/* A value has ended: keep it for the paths that wanted it. */
+static void json_end(flood_json_t *json)
+{
+    if (json->want && !json->toolong) {
+        const char *value = apr_pstrmemdup(json->pool, json->buf, json->len);
+        apr_uint32_t want = json->want;
+        int i;
+
+        for (i = 0; want; i++, want >>= 1) {
+            if (want & 1)
+                json->value[i] = value;
+        }
+        json->pending &= ~json->want;
+    }
+    json->want = 0;
+
+    if (!json->depth || !json->pending)
+        json->state = JSON_DONE;
+    else
+        json->state = JSON_NEXT;
+}
+
+/* A value starts with c. */
+static void json_begin(flood_json_t *json, char c)
+{
+    apr_uint32_t match = json_match(json), through = 0;
+    int i;
+
+    json->want = 0;
+    for (i = 0; match >> i; i++) {
+        if (!(match & ((apr_uint32_t)1 << i)))
+            continue;
+        if (json->paths->path[i].steps == json->depth)
+            json->want |= (apr_uint32_t)1 << i;
+        else
+            through |= (apr_uint32_t)1 << i;
+    }
+
+    switch (c) {
+    case '{':
+    case '[':
+        /* Objects and arrays are only ever led through. */
+        json->want = 0;
+        if (through) {
+            json_frame_t *f = &json->frame[json->depth++];
+
+            f->type = c;
+            f->live = through;
+            f->index = 0;
+            json->state = c == '{' ? JSON_OBJECT : JSON_ARRAY;
+        }
+        else {
+            json->skipdepth = 1;
+            json->skipstring = 0;
+            json->state = JSON_SKIP;
+        }
+        break;
+    case '"':
+        json->state = JSON_STRING;
+        json_string_begin(json);
+        break;
+    default:
+        if (!apr_isalnum(c) && c != '-') {
+            json->state = JSON_DONE;
+            break;
+        }
+        json->state = JSON_LITERAL;
+        json->toolong = 0;
+        json->len = 0;
+        json_put(json, &c, 1);
+        break;
+    }
+}
+
+/* A container ends with c. */
+static void json_close(flood_json_t *json, char c)
+{
+    if (c != (json->frame[json->depth - 1].type == '{' ? '}' : ']')) {
+        json->state = JSON_DONE;
+        return;
+    }
+    json->depth--;
+    json->want = 0;
+    json_end(json);
+}
+
+void flood_json_feed(flood_json_t *json, const char *data, apr_size_t len)
+{
+    const char *end = data + len, *p;
+    int closed;
+    char c;
+
+    while (data < end) {
+        switch (json->state) {
+        case JSON_NAME:
+            data += json_string(json, data, end - data, &closed);
+            if (closed) {
+                json->namelong = json->toolong;
+                json->state = JSON_COLON;
+            }
+            continue;
+        case JSON_STRING:
+            data += json_string(json, data, end - data, &closed);
+            if (closed)
+                json_end(json);
+            continue;
+        case JSON_LITERAL:
+            for (p = data; p < end && (apr_isalnum(*p) || *p == '+' ||
+                                       *p == '-' || *p == '.'); p++)
+                ;
+            json_put(json, data, p - data);
+            data = p;
+            if (p < end)
+                json_end(json);
+            continue;
+        case JSON_SKIP:
+            if (json->skipstring) {
+                data += json_string(json, data, end - data, &closed);
+                json->skipstring = !closed;
+                continue;
+            }
+            switch (*data++) {
+            case '"':
+                json->skipstring = 1;
+                json->escape = 0;
+                break;
+            case '{':
+            case '[':
+                json->skipdepth++;
+                break;
+            case '}':
+            case ']':
+                if (!--json->skipdepth)
+                    json_end(json);
+                break;
+            }
+            continue;
+        case JSON_DONE:
+            return;
+        }
+
+        c = *data++;
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+            continue;
+
+        switch (json->state) {
+        case JSON_VALUE:
+            json_begin(json, c);
+            break;
+        case JSON_ARRAY:
+            if (c == ']')
+                json_close(json, c);
+            else
+                json_begin(json, c);
+            break;
+        case JSON_OBJECT:
+            if (c == '"') {
+                json->state = JSON_NAME;
+                json_string_begin(json);
+            }
+            else if (c == '}')
+                json_close(json, c);
+            else
+                json->state = JSON_DONE;
+            break;
+        case JSON_COLON:
+            json->state = c == ':' ? JSON_VALUE : JSON_DONE;
+            break;
+        case JSON_NEXT:
+            if (c == ',') {
+                json_frame_t *f = &json->frame[json->depth - 1];
+
+                if (f->type == '{')
+                    json->state = JSON_OBJECT;
+                else {
+                    f->index++;
+                    json->state = JSON_VALUE;
+                }
+            }
+            else
+                json_close(json, c);
+            break;
+        }
+    }
+}
+
+void flood_json_finish(flood_json_t *json)
+{
+    if (json->state == JSON_LITERAL)
+        json_end(json);
+    json->state = JSON_DONE;
+}
+
+const char *flood_json_value(flood_json_t *json, int i)
+{
+    return json->value[i];
+}
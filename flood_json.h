@@ -0,0 +1,80 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#ifndef __flood_json_h
+#define __flood_json_h
+
+#include <apr_pools.h>
+
+/* Simple JSON paths, like "$.items[0].id" or "$['a key'][2]", compiled
+ * once.  Each step is a member name or an array index; there are no
+ * wildcards, and the first value a path leads to is the one it finds. */
+typedef struct flood_json_paths_t flood_json_paths_t;
+
+/* The state of a search of one JSON document for a set of paths.  The
+ * document is read a piece at a time and nothing is built from it: all
+ * that is kept is the member name or value being read, and where we are
+ * in the containers that some path leads into. */
+typedef struct flood_json_t flood_json_t;
+
+/**
+ * Compile a list of paths, separated by commas or white space.
+ */
+apr_status_t flood_json_compile(flood_json_paths_t **paths, const char *text,
+                                apr_pool_t *pool);
+
+/**
+ * How many paths there are in the list.
+ */
+int flood_json_count(const flood_json_paths_t *paths);
+
+/**
+ * The text of path i, as it was given.
+ */
+const char *flood_json_path(const flood_json_paths_t *paths, int i);
+
+/**
+ * Start a search for the paths, with what it finds allocated from pool.
+ */
+flood_json_t *flood_json_create(const flood_json_paths_t *paths,
+                                apr_pool_t *pool);
+
+/**
+ * Forget the document seen so far, ready for the next.
+ */
+void flood_json_reset(flood_json_t *json);
+
+/**
+ * Take the next len bytes of the document.
+ */
+void flood_json_feed(flood_json_t *json, const char *data, apr_size_t len);
+
+/**
+ * Say that the document has ended, which finishes a bare number or
+ * literal at its end.
+ */
+void flood_json_finish(flood_json_t *json);
+
+/**
+ * The value path i led to, or NULL if it led to none (or to an object or
+ * array, which are not values we extract).  Strings are unescaped; other
+ * values are as they appear in the document.
+ */
+const char *flood_json_value(flood_json_t *json, int i);
+
+#endif  /* __flood_json_h */
@@ -0,0 +1,227 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_strings.h>
+#include <apr_tables.h>
+#include <apr_file_io.h>
+
+#if APR_HAVE_STRING_H
+#include <string.h>     /* strchr */
+#endif
+
+#include "config.h"
+#include "flood_match.h"
+
+extern apr_file_t *local_stderr;
+
+/* Which patterns have been seen is kept as a bit each. */
+#define FLOOD_MATCH_PATTERNS_MAX 32
+
+typedef struct {
+    const char *text;
+    apr_size_t len;
+    int reject;         /* a boolean: must the body not have it? */
+} match_pattern_t;
+
+struct flood_match_patterns_t {
+    match_pattern_t *pattern;
+    int count;
+    /* Bytes that are in no pattern all share column 0 of the table;
+     * each of the others has a column of its own. */
+    unsigned char column[256];
+    int columns;
+    int *next;          /* the state after each state and column */
+    apr_uint32_t *out;  /* the patterns seen on reaching each state */
+};
+
+struct flood_match_t {
+    const flood_match_patterns_t *patterns;
+    int state;
+    apr_uint32_t seen;
+};
+
+static apr_status_t match_split(apr_array_header_t *list, const char *text,
+                                int reject, apr_pool_t *pool)
+{
+    const char *p = text, *bar;
+    match_pattern_t *pat;
+
+    for (;;) {
+        if (!(bar = strchr(p, '|')))
+            bar = p + strlen(p);
+        if (bar == p) {
+            apr_file_printf(local_stderr,
+                            "Empty pattern in '%s'\n", text);
+            return APR_EGENERAL;
+        }
+        pat = (match_pattern_t *)apr_array_push(list);
+        pat->text = apr_pstrmemdup(pool, p, bar - p);
+        pat->len = bar - p;
+        pat->reject = reject;
+        if (!*bar)
+            break;
+        p = bar + 1;
+    }
+
+    return APR_SUCCESS;
+}
+
+apr_status_t flood_match_compile(flood_match_patterns_t **patterns,
+                                 const char *expect, const char *reject,
+                                 apr_pool_t *pool)
+{
+    flood_match_patterns_t *p;
+    apr_array_header_t *list;
+    int *fail, *queue, head, tail;
+    int i, c, s, t, f, states, maxstates, cols;
+    apr_size_t j;
+
+    list = apr_array_make(pool, 4, sizeof(match_pattern_t));
+    if (expect && match_split(list, expect, 0, pool) != APR_SUCCESS)
+        return APR_EGENERAL;
+    if (reject && match_split(list, reject, 1, pool) != APR_SUCCESS)
+        return APR_EGENERAL;
+    if (list->nelts < 1 || list->nelts > FLOOD_MATCH_PATTERNS_MAX) {
+        apr_file_printf(local_stderr,
+                        "Give between 1 and %d body patterns, not %d\n",
+                        FLOOD_MATCH_PATTERNS_MAX, list->nelts);
+        return APR_EGENERAL;
+    }
+
+    p = apr_pcalloc(pool, sizeof(flood_match_patterns_t));
+    p->pattern = (match_pattern_t *)list->elts;
+    p->count = list->nelts;
+
+    /* At worst, a state for every byte of every pattern, and the root. */
+    maxstates = 1;
+    p->columns = 1;
+    for (i = 0; i < p->count; i++) {
+        const unsigned char *text = (const unsigned char *)p->pattern[i].text;
+
+        for (j = 0; j < p->pattern[i].len; j++) {
+            if (!p->column[text[j]])
+                p->column[text[j]] = p->columns++;
+        }
+        maxstates += p->pattern[i].len;
+    }
+    cols = p->columns;
+
+    p->next = apr_palloc(pool, maxstates * cols * sizeof(int));
+    p->out = apr_pcalloc(pool, maxstates * sizeof(apr_uint32_t));
+    for (i = 0; i < maxstates * cols; i++)
+        p->next[i] = -1;
+
+    /* The trie of the patterns. */
+    states = 1;
+    for (i = 0; i < p->count; i++) {
+        const unsigned char *text = (const unsigned char *)p->pattern[i].text;
+
+        s = 0;
+        for (j = 0; j < p->pattern[i].len; j++) {
+            c = p->column[text[j]];
+            if (p->next[s * cols + c] < 0)
+                p->next[s * cols + c] = states++;
+            s = p->next[s * cols + c];
+        }
+        p->out[s] |= (apr_uint32_t)1 << i;
+    }
+
+    /* Breadth first, so that a state's failure link, which is shallower,
+     * has all its moves by the time the state's children need them.  The
+     * moves that leave the trie are filled in from the failure links, so
+     * a search makes exactly one move a byte. */
+    fail = apr_palloc(pool, states * sizeof(int));
+    queue = apr_palloc(pool, states * sizeof(int));
+    head = tail = 0;
+    for (c = 0; c < cols; c++) {
+        if ((t = p->next[c]) < 0) {
+            p->next[c] = 0;
+        }
+        else {
+            fail[t] = 0;
+            queue[tail++] = t;
+        }
+    }
+    while (head < tail) {
+        s = queue[head++];
+        for (c = 0; c < cols; c++) {
+            t = p->next[s * cols + c];
+            f = p->next[fail[s] * cols + c];
+            if (t < 0) {
+                p->next[s * cols + c] = f;
+            }
+            else {
+                fail[t] = f;
+                p->out[t] |= p->out[f];
+                queue[tail++] = t;
+            }
+        }
+    }
+
+    *patterns = p;
+    return APR_SUCCESS;
+}
+
+flood_match_t *flood_match_create(const flood_match_patterns_t *patterns,
+                                  apr_pool_t *pool)
+{
+    flood_match_t *match = apr_pcalloc(pool, sizeof(flood_match_t));
+
+    match->patterns = patterns;
+    return match;
+}
+
+void flood_match_reset(flood_match_t *match)
+{
+    match->state = 0;
+    match->seen = 0;
+}
+
+void flood_match_feed(flood_match_t *match, const char *data,
+                      apr_size_t len)
+{
+    const flood_match_patterns_t *p = match->patterns;
+    const unsigned char *d = (const unsigned char *)data, *end = d + len;
+    int s = match->state, cols = p->columns;
+    apr_uint32_t seen = match->seen;
+
+    while (d < end) {
+        s = p->next[s * cols + p->column[*d++]];
+        seen |= p->out[s];
+    }
+
+    match->state = s;
+    match->seen = seen;
+}
+
+const char *flood_match_failed(const flood_match_t *match, int *rejected)
+{
+    const flood_match_patterns_t *p = match->patterns;
+    int i;
+
+    for (i = 0; i < p->count; i++) {
+        int seen = (match->seen >> i) & 1;
+
+        if (seen == p->pattern[i].reject) {
+            *rejected = p->pattern[i].reject;
+            return p->pattern[i].text;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,66 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#ifndef __flood_match_h
+#define __flood_match_h
+
+#include <apr_pools.h>
+
+/* Literal strings a body must have, and ones it must not, compiled once
+ * into an Aho-Corasick automaton so that one pass over a body looks for
+ * all of them at once. */
+typedef struct flood_match_patterns_t flood_match_patterns_t;
+
+/* The state of a search of one body for a set of patterns.  All that is
+ * kept is where the automaton is and which patterns it has seen, so a
+ * pattern split between two reads is still found. */
+typedef struct flood_match_t flood_match_t;
+
+/**
+ * Compile the patterns a body must have and those it must not, each a
+ * list separated by '|'.  Either may be NULL.
+ */
+apr_status_t flood_match_compile(flood_match_patterns_t **patterns,
+                                 const char *expect, const char *reject,
+                                 apr_pool_t *pool);
+
+/**
+ * Start a search for the patterns.
+ */
+flood_match_t *flood_match_create(const flood_match_patterns_t *patterns,
+                                  apr_pool_t *pool);
+
+/**
+ * Forget the body seen so far, ready for the next.
+ */
+void flood_match_reset(flood_match_t *match);
+
+/**
+ * Take the next len bytes of the body.
+ */
+void flood_match_feed(flood_match_t *match, const char *data,
+                      apr_size_t len);
+
+/**
+ * The first pattern the body has let down, or NULL if none.  *rejected
+ * says whether it was one the body must not have (and did), or one it
+ * must have (and didn't).
+ */
+const char *flood_match_failed(const flood_match_t *match, int *rejected);
+
+#endif  /* __flood_match_h */
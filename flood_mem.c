@@ -0,0 +1,273 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_errno.h>
+#include <apr_allocator.h>
+#include <apr_strings.h>
+#if APR_HAS_THREADS
+#include <apr_thread_mutex.h>
+#endif
+
+#if APR_HAVE_STDIO_H
+#include <stdio.h>      /* sscanf */
+#endif
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* strtoll */
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>     /* strcmp */
+#endif
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>     /* sysconf */
+#endif
+
+#include "config.h"
+#include "flood_farmer.h"
+#include "flood_mem.h"
+
+#if FLOOD_HAS_GETRUSAGE
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+extern apr_file_t *local_stderr;
+
+static const char *mem_names[FLOOD_MEM_MAX] = {
+    "request", "body", "cookies", "state"
+};
+
+/* Every farmer's accounts, so that they can all be reported together. */
+static apr_pool_t *mem_pool;
+static flood_mem_t *mem_list;
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *mem_mutex;
+#endif
+
+/* Each farmer gets a pool from here.  Nobody else may allocate from it:
+ * a socket group whose connections are shared between farmers (h2, h3)
+ * reads for the others into pools of their own, also from here, and each
+ * farmer copies out what is its.  So the allocator needs no mutex, and farmers
+ * don't queue on each other (or on the global allocator) every time they
+ * allocate. */
+apr_status_t flood_mem_pool_create(apr_pool_t **pool)
+{
+    apr_allocator_t *allocator;
+    apr_status_t stat;
+
+    if ((stat = apr_allocator_create(&allocator)) != APR_SUCCESS)
+        return stat;
+    apr_allocator_max_free_set(allocator, FLOOD_FARMER_MAX_FREE);
+
+    if ((stat = apr_pool_create_ex(pool, NULL, NULL,
+                                   allocator)) != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return stat;
+    }
+    apr_allocator_owner_set(allocator, *pool);
+
+    return APR_SUCCESS;
+}
+
+apr_status_t flood_mem_init(apr_pool_t *pool)
+{
+    apr_status_t stat;
+
+    if ((stat = apr_pool_create(&mem_pool, pool)) != APR_SUCCESS)
+        return stat;
+#if APR_HAS_THREADS
+    if ((stat = apr_thread_mutex_create(&mem_mutex, APR_THREAD_MUTEX_DEFAULT,
+                                        mem_pool)) != APR_SUCCESS)
+        return stat;
+#endif
+    mem_list = NULL;
+
+    return APR_SUCCESS;
+}
+
+flood_mem_t *flood_mem_register(const char *farmer, apr_size_t limit)
+{
+    flood_mem_t *mem, **last;
+    int instance = 0;
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(mem_mutex);
+#endif
+    for (last = &mem_list; *last; last = &(*last)->next) {
+        if (strcmp((*last)->farmer, farmer) == 0)
+            instance++;
+    }
+
+    mem = apr_pcalloc(mem_pool, sizeof(flood_mem_t));
+    mem->farmer = apr_pstrdup(mem_pool, farmer);
+    mem->instance = instance;
+    mem->limit = limit;
+    *last = mem;
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(mem_mutex);
+#endif
+
+    return mem;
+}
+
+flood_mem_t *flood_mem_get(apr_pool_t *pool)
+{
+    farmer_ctx_t *ctx = farmer_ctx_get(pool);
+
+    return ctx ? ctx->mem : NULL;
+}
+
+void flood_mem_set(flood_mem_t *mem, int what, apr_size_t bytes)
+{
+    if (!mem)
+        return;
+
+    /* Only the owning farmer writes these; a report that reads them
+     * halfway through an update is off by one request at most. */
+    mem->held -= mem->bytes[what];
+    mem->bytes[what] = bytes;
+    mem->held += bytes;
+    if (mem->held > mem->peak)
+        mem->peak = mem->held;
+}
+
+apr_status_t flood_mem_check(flood_mem_t *mem)
+{
+    if (!mem || !mem->limit || mem->held <= mem->limit)
+        return APR_SUCCESS;
+
+    apr_file_printf(local_stderr,
+                    "Farmer '%s' (%d) holds %" APR_SIZE_T_FMT " bytes, "
+                    "over its limit of %" APR_SIZE_T_FMT " "
+                    "(request %" APR_SIZE_T_FMT ", body %" APR_SIZE_T_FMT
+                    ", cookies %" APR_SIZE_T_FMT ", state %" APR_SIZE_T_FMT
+                    ").\n",
+                    mem->farmer, mem->instance, mem->held, mem->limit,
+                    mem->bytes[FLOOD_MEM_REQUEST], mem->bytes[FLOOD_MEM_BODY],
+                    mem->bytes[FLOOD_MEM_COOKIES], mem->bytes[FLOOD_MEM_STATE]);
+    return APR_ENOMEM;
+}
+
+apr_status_t flood_mem_parse(apr_size_t *bytes, const char *text)
+{
+    char *endptr;
+    apr_int64_t value;
+
+    value = strtoll(text, &endptr, 10);
+    if (endptr == text || value < 0)
+        return APR_EGENERAL;
+
+    switch (*endptr) {
+    case 'k': case 'K':
+        value *= 1024;
+        endptr++;
+        break;
+    case 'm': case 'M':
+        value *= 1024 * 1024;
+        endptr++;
+        break;
+    case 'g': case 'G':
+        value *= APR_INT64_C(1024) * 1024 * 1024;
+        endptr++;
+        break;
+    }
+    if (*endptr != '\0')
+        return APR_EGENERAL;
+
+    *bytes = (apr_size_t)value;
+    return APR_SUCCESS;
+}
+
+/* The resident size of the process now, in bytes, or 0 if the platform
+ * won't say.  Only Linux does, through /proc. */
+static apr_size_t rss_now(apr_pool_t *pool)
+{
+    apr_file_t *f;
+    char buf[64];
+    apr_size_t len = sizeof(buf) - 1;
+    long pages, resident;
+
+    if (apr_file_open(&f, "/proc/self/statm", APR_READ, APR_OS_DEFAULT,
+                      pool) != APR_SUCCESS)
+        return 0;
+    if (apr_file_read(f, buf, &len) != APR_SUCCESS)
+        len = 0;
+    apr_file_close(f);
+    buf[len] = '\0';
+
+    if (sscanf(buf, "%ld %ld", &pages, &resident) != 2)
+        return 0;
+#ifdef _SC_PAGESIZE
+    return resident * sysconf(_SC_PAGESIZE);
+#else
+    return resident * 4096;
+#endif
+}
+
+/* The most the process has ever had resident, in bytes, or 0. */
+static apr_size_t rss_peak(void)
+{
+#if FLOOD_HAS_GETRUSAGE
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return 0;
+#ifdef __APPLE__
+    return ru.ru_maxrss;
+#else
+    return ru.ru_maxrss * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+void flood_mem_report(apr_file_t *out, const char *when)
+{
+    flood_mem_t *mem;
+    apr_pool_t *pool;
+    apr_size_t held = 0;
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(mem_mutex);
+#endif
+    apr_pool_create(&pool, mem_pool);
+    for (mem = mem_list; mem; mem = mem->next) {
+        int i;
+
+        apr_file_printf(out, "Memory (%s): farmer '%s' (%d) holds %"
+                        APR_SIZE_T_FMT " bytes, peak %" APR_SIZE_T_FMT,
+                        when, mem->farmer, mem->instance, mem->held, mem->peak);
+        for (i = 0; i < FLOOD_MEM_MAX; i++)
+            apr_file_printf(out, ", %s %" APR_SIZE_T_FMT,
+                            mem_names[i], mem->bytes[i]);
+        if (mem->limit)
+            apr_file_printf(out, ", limit %" APR_SIZE_T_FMT, mem->limit);
+        apr_file_printf(out, "\n");
+        held += mem->held;
+    }
+
+    apr_file_printf(out, "Memory (%s): farmers hold %" APR_SIZE_T_FMT
+                    " bytes, process resident %" APR_SIZE_T_FMT
+                    " bytes, peak %" APR_SIZE_T_FMT "\n",
+                    when, held, rss_now(pool), rss_peak());
+
+    apr_pool_destroy(pool);
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(mem_mutex);
+#endif
+}
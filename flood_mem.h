@@ -0,0 +1,88 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#ifndef __flood_mem_h
+#define __flood_mem_h
+
+#include <apr_file_io.h>
+#include <apr_pools.h>
+
+/* What a farmer's memory goes on.  The first two are for the request
+ * in flight; the others are kept by the profile from one request to the
+ * next. */
+#define FLOOD_MEM_REQUEST 0
+#define FLOOD_MEM_BODY 1
+#define FLOOD_MEM_COOKIES 2
+#define FLOOD_MEM_STATE 3
+#define FLOOD_MEM_MAX 4
+
+/* The memory one farmer holds, in bytes. */
+typedef struct flood_mem_t {
+    const char *farmer;
+    int instance;             /* which of the farmers by that name */
+    apr_size_t bytes[FLOOD_MEM_MAX];
+    apr_size_t held;          /* the sum of bytes[] */
+    apr_size_t peak;          /* the most held at any one time */
+    apr_size_t limit;         /* 0 for no limit */
+    struct flood_mem_t *next;
+} flood_mem_t;
+
+/**
+ * Make a pool on an allocator of its own, which has no mutex: only one
+ * thread at a time may allocate from it, or from its children.
+ */
+apr_status_t flood_mem_pool_create(apr_pool_t **pool);
+
+/**
+ * Set up memory accounting for the whole run.
+ */
+apr_status_t flood_mem_init(apr_pool_t *pool);
+
+/**
+ * Start accounting for a new farmer, which fails rather than hold more
+ * than limit bytes (unless limit is 0).
+ */
+flood_mem_t *flood_mem_register(const char *farmer, apr_size_t limit);
+
+/**
+ * Find the accounts of the farmer that handed out the given pool, or
+ * NULL if it keeps none.
+ */
+flood_mem_t *flood_mem_get(apr_pool_t *pool);
+
+/**
+ * Record that the farmer now holds bytes for one of FLOOD_MEM_*.
+ */
+void flood_mem_set(flood_mem_t *mem, int what, apr_size_t bytes);
+
+/**
+ * Fail, loudly, if the farmer holds more than its limit.
+ */
+apr_status_t flood_mem_check(flood_mem_t *mem);
+
+/**
+ * Parse a size in bytes, with an optional K, M or G suffix.
+ */
+apr_status_t flood_mem_parse(apr_size_t *bytes, const char *text);
+
+/**
+ * Print the accounts of every farmer, and the process's resident size.
+ */
+void flood_mem_report(apr_file_t *out, const char *when);
+
+#endif  /* __flood_mem_h */
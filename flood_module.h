@@ -0,0 +1,88 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#ifndef __flood_module_h
+#define __flood_module_h
+
+#include <apr_pools.h>
+
+#include "flood_profile.h"
+
+/* A module is a shared object, named by a <module> element of the config,
+ * that adds handlers and groups of handlers to the ones built into flood.
+ * It exports a flood_module_t named "flood_module":
+ *
+ *     static profile_event_handler_t my_handlers[] = {
+ *         {"verify_resp", "my_verify", &my_verify},
+ *         {NULL}
+ *     };
+ *
+ *     flood_module_t flood_module = {
+ *         FLOOD_MODULE_STUFF,
+ *         "my_module",
+ *         my_handlers,
+ *         NULL,
+ *         NULL
+ *     };
+ *
+ * after which a profile can say <verify_resp>my_verify</verify_resp>. */
+
+#define FLOOD_MODULE_MAGIC 0x464c4f44 /* "FLOD" */
+
+/* Bumped whenever something a module sees changes so that one built for
+ * the old version would go wrong: flood_module_t and the tables it points
+ * to, profile_events_t, or request_t and response_t. */
+#define FLOOD_MODULE_ABI 1
+
+/* What every flood_module_t starts with. */
+#define FLOOD_MODULE_STUFF FLOOD_MODULE_MAGIC, FLOOD_MODULE_ABI
+
+/* The symbol a module exports its flood_module_t as. */
+#define FLOOD_MODULE_SYMBOL "flood_module"
+
+/* An implementation of one of the profile events, by name.  handler is
+ * a pointer to a function of that event's type in profile_events_t. */
+struct profile_event_handler_t {
+    const char *handler_name;
+    const char *impl_name;
+    void *handler;
+};
+typedef struct profile_event_handler_t profile_event_handler_t;
+
+/* Implementations that are used together, by the name a profile uses to
+ * choose them all at once, e.g. <socket>keepalive</socket>. */
+struct profile_group_handler_t {
+    const char *class;
+    const char *group_name;
+    const char **handlers;
+};
+typedef struct profile_group_handler_t profile_group_handler_t;
+
+typedef struct {
+    int magic;   /* FLOOD_MODULE_MAGIC */
+    int abi;     /* FLOOD_MODULE_ABI, as the module was built */
+    const char *name;
+    /* Each table ends with an entry that is all NULL; either may be NULL. */
+    profile_event_handler_t *handlers;
+    profile_group_handler_t *groups;
+    /* Called once, before any farmer starts, if not NULL.  The pool lasts
+     * as long as flood does. */
+    apr_status_t (*init)(apr_pool_t *pool);
+} flood_module_t;
+
+#endif  /* __flood_module_h */
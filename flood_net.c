@@ -16,20 +16,362 @@
  * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
  */
 
+#include <apr_file_io.h>
+#include <apr_time.h>
+
 #include "config.h"
 #include "flood_profile.h"
 #include "flood_net.h"
 
-/* Open the TCP connection to the server */
+#if APR_HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
+#endif
+
+/* Client TCP Fast Open, as Linux does it: connect() returns at once and
+ * the first write goes out in the SYN. */
+#if defined(TCP_FASTOPEN_CONNECT) && defined(TCPI_OPT_SYN_DATA)
+#include <sys/socket.h>
+#define FLOOD_HAS_FASTOPEN 1
+#else
+#define FLOOD_HAS_FASTOPEN 0
+#endif
+
+extern apr_file_t *local_stderr;
+
+static void fastopen_unavailable(const char *why)
+{
+    static int warned = 0;
+
+    /* Not worth a mutex; at worst a few threads complain. */
+    if (!warned) {
+        warned = 1;
+        apr_file_printf(local_stderr,
+                        "TCP Fast Open requested but %s, "
+                        "using a full handshake.\n", why);
+    }
+}
+
+static void uring_unavailable(const char *why)
+{
+    static int warned = 0;
+
+    /* Not worth a mutex; at worst a few threads complain. */
+    if (!warned) {
+        warned = 1;
+        apr_file_printf(local_stderr,
+                        "io_uring requested but %s, using poll and recv.\n",
+                        why);
+    }
+}
+
+/* How long the next wait on s may last, and what to report if it runs
+ * out.  Each request checks its own few deadlines on every wait, so
+ * keeping time costs the same however many farmers are running. */
+static apr_interval_time_t deadline_wait(flood_socket_t *s,
+                                         apr_status_t *expired)
+{
+    apr_interval_time_t t = s->wait ? s->wait : LOCAL_SOCKET_TIMEOUT;
+    apr_time_t now;
+
+    *expired = APR_TIMEUP;
+    if (!s->firstbyte && !s->deadline)
+        return t;
+
+    now = apr_time_now();
+    if (s->firstbyte && s->firstbyte - now < t) {
+        t = s->firstbyte - now;
+        *expired = FLOOD_EFIRSTBYTE;
+    }
+    if (s->deadline && s->deadline - now < t) {
+        t = s->deadline - now;
+        *expired = FLOOD_ETOTALTIME;
+    }
+
+    return t;
+}
+
+#if FLOOD_HAS_LIBURING
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <liburing.h>
+
+/* Submission queue depth: a send, a receive and a spare. */
+#define URING_ENTRIES 4
+/* Receive buffers handed to the kernel, per connection.  The count must
+ * be a power of two. */
+#define URING_BUFS 32
+#define URING_BUF_SIZE MAX_DOC_LENGTH
+#define URING_BGID 0
+
+/* user_data tags on our submissions */
+#define URING_SEND 1
+#define URING_RECV 2
+#define URING_CANCEL 3
+
+/* One ring per connection.  A multishot receive stays armed for the life
+ * of the connection, so a read that finds data already completed costs
+ * no system call at all, and a send is submitted together with the
+ * receive that picks up its response. */
+typedef struct flood_uring_t {
+    apr_pool_t *pool;
+    struct io_uring ring;
+    struct io_uring_buf_ring *br;
+    char *bufs;
+    int fd;
+    int armed;                /* A boolean: multishot recv outstanding */
+    int sent;                 /* A boolean: the send has completed */
+    int sendres;
+    int eof;                  /* A boolean */
+    apr_status_t err;
+    /* Completed receives not yet handed out, oldest first. */
+    struct {
+        int bid;
+        apr_size_t len;
+    } ready[URING_BUFS];
+    int head;
+    int count;
+    apr_size_t off;           /* bytes of ready[head] already handed out */
+} flood_uring_t;
+
+static apr_status_t uring_cleanup(void *data)
+{
+    flood_uring_t *u = data;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+
+    /* The kernel may still pick a buffer for the receive, so cancel it
+     * and see it finish before the buffers go. */
+    if (u->armed && (sqe = io_uring_get_sqe(&u->ring))) {
+        io_uring_prep_cancel64(sqe, URING_RECV, 0);
+        io_uring_sqe_set_data64(sqe, URING_CANCEL);
+        io_uring_submit(&u->ring);
+        while (u->armed && io_uring_wait_cqe(&u->ring, &cqe) == 0) {
+            if (io_uring_cqe_get_data64(cqe) == URING_RECV) {
+                if (!(cqe->flags & IORING_CQE_F_MORE))
+                    u->armed = 0;
+            }
+            else if (io_uring_cqe_get_data64(cqe) == URING_CANCEL) {
+                /* Not found means it has already finished, and its last
+                 * completion is behind us or on its way. */
+                if (cqe->res < 0 && cqe->res != -EALREADY &&
+                    cqe->res != -ENOENT)
+                    u->armed = 0;
+            }
+            io_uring_cqe_seen(&u->ring, cqe);
+        }
+    }
+    if (u->br)
+        io_uring_free_buf_ring(&u->ring, u->br, URING_BUFS, URING_BGID);
+    io_uring_queue_exit(&u->ring);
+    return APR_SUCCESS;
+}
+
+static void uring_give_buf(flood_uring_t *u, int bid)
+{
+    io_uring_buf_ring_add(u->br, u->bufs + bid * URING_BUF_SIZE,
+                          URING_BUF_SIZE, bid,
+                          io_uring_buf_ring_mask(URING_BUFS), 0);
+    io_uring_buf_ring_advance(u->br, 1);
+}
+
+/* Set up a ring for fs, or leave fs->uring NULL if the kernel won't. */
+static void uring_open(flood_socket_t *fs, apr_pool_t *pool)
+{
+    flood_uring_t *u;
+    apr_os_sock_t fd;
+    int i, rv;
+
+    u = apr_pcalloc(pool, sizeof(flood_uring_t));
+    u->pool = pool;
+
+    if ((rv = io_uring_queue_init(URING_ENTRIES, &u->ring, 0)) < 0) {
+        uring_unavailable("the kernel refused a ring");
+        return;
+    }
+    u->br = io_uring_setup_buf_ring(&u->ring, URING_BUFS, URING_BGID, 0, &rv);
+    if (!u->br) {
+        io_uring_queue_exit(&u->ring);
+        uring_unavailable("the kernel lacks buffer rings");
+        return;
+    }
+
+    u->bufs = apr_palloc(pool, URING_BUFS * URING_BUF_SIZE);
+    for (i = 0; i < URING_BUFS; i++)
+        uring_give_buf(u, i);
+
+    apr_os_sock_get(&fd, fs->socket);
+    u->fd = fd;
+
+    apr_pool_cleanup_register(pool, u, uring_cleanup, apr_pool_cleanup_null);
+    fs->uring = u;
+}
+
+static void uring_arm(flood_uring_t *u)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&u->ring);
+
+    io_uring_prep_recv_multishot(sqe, u->fd, NULL, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    io_uring_sqe_set_data64(sqe, URING_RECV);
+    u->armed = 1;
+}
+
+/* Take whatever has completed off the ring, without blocking. */
+static void uring_reap(flood_uring_t *u)
+{
+    struct io_uring_cqe *cqe;
+
+    while (io_uring_peek_cqe(&u->ring, &cqe) == 0) {
+        if (io_uring_cqe_get_data64(cqe) == URING_SEND) {
+            u->sent = 1;
+            u->sendres = cqe->res;
+        }
+        else {
+            if (!(cqe->flags & IORING_CQE_F_MORE))
+                u->armed = 0;
+            if (cqe->res > 0) {
+                int tail = (u->head + u->count) % URING_BUFS;
+
+                u->ready[tail].bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                u->ready[tail].len = cqe->res;
+                u->count++;
+            }
+            else if (cqe->res == 0) {
+                u->eof = 1;
+            }
+            else if (cqe->res != -ENOBUFS) {
+                /* Out of buffers just means rearm once we give some
+                 * back; anything else is the connection's problem. */
+                u->err = APR_FROM_OS_ERROR(-cqe->res);
+            }
+        }
+        io_uring_cqe_seen(&u->ring, cqe);
+    }
+}
+
+/* Submit what's queued and wait for at least one completion. */
+static apr_status_t uring_wait(flood_socket_t *s)
+{
+    flood_uring_t *u = s->uring;
+    struct __kernel_timespec ts;
+    struct io_uring_cqe *cqe;
+    apr_interval_time_t t;
+    apr_status_t expired;
+    int rv;
+
+    if ((t = deadline_wait(s, &expired)) <= 0)
+        return expired;
+    ts.tv_sec = apr_time_sec(t);
+    ts.tv_nsec = apr_time_usec(t) * 1000;
+
+    rv = io_uring_submit_and_wait_timeout(&u->ring, &cqe, 1, &ts, NULL);
+    if (rv == -ETIME)
+        return expired;
+    if (rv < 0 && rv != -EINTR)
+        return APR_FROM_OS_ERROR(-rv);
+
+    uring_reap(u);
+    return APR_SUCCESS;
+}
+
+static apr_status_t uring_write(flood_socket_t *s, request_t *r)
+{
+    flood_uring_t *u = s->uring;
+    struct io_uring_sqe *sqe;
+    apr_status_t rv;
+
+    sqe = io_uring_get_sqe(&u->ring);
+    io_uring_prep_send(sqe, u->fd, r->rbuf, r->rbufsize, MSG_WAITALL);
+    io_uring_sqe_set_data64(sqe, URING_SEND);
+    /* The receive for the response rides along in the same enter. */
+    if (!u->armed && !u->count)
+        uring_arm(u);
+
+    u->sent = 0;
+    while (!u->sent) {
+        if ((rv = uring_wait(s)) != APR_SUCCESS)
+            return rv;
+    }
+
+    if (u->sendres < 0)
+        return APR_FROM_OS_ERROR(-u->sendres);
+    /* FIXME: Better error and allow restarts? */
+    if (u->sendres != r->rbufsize)
+        return APR_EGENERAL;
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t uring_read(flood_socket_t *s, char *buf,
+                               apr_size_t *buflen)
+{
+    flood_uring_t *u = s->uring;
+    apr_size_t len;
+    apr_status_t rv;
+    int bid;
+
+    uring_reap(u);
+    while (!u->count) {
+        if (u->err != APR_SUCCESS || u->eof) {
+            *buflen = 0;
+            return u->err != APR_SUCCESS ? u->err : APR_EOF;
+        }
+        if (!u->armed)
+            uring_arm(u);
+        if ((rv = uring_wait(s)) != APR_SUCCESS) {
+            *buflen = 0;
+            return rv;
+        }
+    }
+
+    bid = u->ready[u->head].bid;
+    len = u->ready[u->head].len - u->off;
+    if (len > *buflen)
+        len = *buflen;
+    memcpy(buf, u->bufs + bid * URING_BUF_SIZE + u->off, len);
+    u->off += len;
+
+    if (u->off == u->ready[u->head].len) {
+        uring_give_buf(u, bid);
+        u->head = (u->head + 1) % URING_BUFS;
+        u->count--;
+        u->off = 0;
+    }
+
+    s->firstbyte = 0;
+    *buflen = len;
+    return APR_SUCCESS;
+}
+
+/* Has the server said anything (or hung up) since the last response? */
+static apr_status_t uring_check(flood_uring_t *u)
+{
+    io_uring_get_events(&u->ring);
+    uring_reap(u);
+
+    if (u->count || u->eof || u->err != APR_SUCCESS)
+        return APR_EGENERAL;
+
+    return APR_SUCCESS;
+}
+
+#endif /* FLOOD_HAS_LIBURING */
+
+/* Open the TCP (or Unix domain) connection to the server */
 flood_socket_t* open_socket(apr_pool_t *pool, request_t *r,
                             apr_status_t *status)
 {
-    apr_status_t rv = 0;
+    apr_status_t rv = 0, expired = APR_TIMEUP;
     apr_sockaddr_t *destsa;
     flood_socket_t* fs;
     apr_uri_t *u;
+    int family = APR_INET, protocol = APR_PROTO_TCP;
     
-    fs = apr_palloc(pool, sizeof(flood_socket_t));
+    fs = apr_pcalloc(pool, sizeof(flood_socket_t));
     if (r->parsed_proxy_uri) {
         u = r->parsed_proxy_uri;
     }
@@ -37,25 +379,78 @@ flood_socket_t* open_socket(apr_pool_t *pool, request_t *r,
         u = r->parsed_uri;
     }
 
-    if ((rv = apr_sockaddr_info_get(&destsa, u->hostname, APR_INET,
-                                    u->port, 0, pool)) 
-                                    != APR_SUCCESS) {
+    if (r->unixsocket) {
+#if APR_HAVE_SOCKADDR_UN
+        family = APR_UNIX;
+        protocol = 0;
+        rv = apr_sockaddr_info_get(&destsa, r->unixsocket, APR_UNIX, 0, 0,
+                                   pool);
+#else
+        rv = APR_ENOTIMPL;
+#endif
+    }
+    else {
+        rv = apr_sockaddr_info_get(&destsa, u->hostname, APR_INET,
+                                   u->port, 0, pool);
+        if (rv != APR_SUCCESS)
+            r->error = FLOOD_ERR_DNS;
+    }
+    if (rv != APR_SUCCESS) {
         if (status) {
             *status = rv;
         }
         return NULL;
     }
 
-    if ((rv = apr_socket_create(&fs->socket, APR_INET, SOCK_STREAM,
-                                APR_PROTO_TCP, pool)) != APR_SUCCESS) {
+    if ((rv = apr_socket_create(&fs->socket, family, SOCK_STREAM,
+                                protocol, pool)) != APR_SUCCESS) {
         if (status) {
             *status = rv;
         }
         return NULL;
     }
 
+    if (r->fastopen && family == APR_INET) {
+#if FLOOD_HAS_FASTOPEN
+        apr_os_sock_t fd;
+        int on = 1;
+
+        apr_os_sock_get(&fd, fs->socket);
+        if (setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &on,
+                       sizeof(on)) == 0)
+            fs->fastopen = 1;
+        else
+            fastopen_unavailable("the kernel refused it");
+#else
+        fastopen_unavailable("this platform lacks TCP_FASTOPEN_CONNECT");
+#endif
+    }
+
+    /* Until a request goes out, waits are part of connecting. */
+    fs->deadline = r->deadline;
+    fs->wait = r->timeouts.connect;
+    if (fs->wait || fs->deadline) {
+        apr_interval_time_t t = deadline_wait(fs, &expired);
+
+        if (t <= 0) {
+            close_socket(fs);
+            if (status) {
+                *status = expired;
+            }
+            return NULL;
+        }
+        apr_socket_timeout_set(fs->socket, t);
+    }
+
     if ((rv = apr_socket_connect(fs->socket, destsa)) != APR_SUCCESS) {
-        if (APR_STATUS_IS_EINPROGRESS(rv)) {
+        if (APR_STATUS_IS_TIMEUP(rv)) {
+            close_socket(fs);
+            if (status) {
+                *status = expired;
+            }
+            return NULL;
+        }
+        else if (APR_STATUS_IS_EINPROGRESS(rv)) {
             /* FIXME: Handle better */
             close_socket(fs);
             if (status) {
@@ -63,7 +458,7 @@ flood_socket_t* open_socket(apr_pool_t *pool, request_t *r,
             }
             return NULL;
         }
-        else if (APR_STATUS_IS_EAGAIN(rv))
+        else if (APR_STATUS_IS_EAGAIN(rv) && family == APR_INET)
         {
             /* We have run out of ports available due to TIME_WAIT exhaustion.
              * Sleep for four minutes, and try again. 
@@ -89,6 +484,14 @@ flood_socket_t* open_socket(apr_pool_t *pool, request_t *r,
     fs->read_pollset.desc.s = fs->socket;
     fs->read_pollset.reqevents = APR_POLLIN;
     fs->read_pollset.p = pool;
+
+    if (r->iouring) {
+#if FLOOD_HAS_LIBURING
+        uring_open(fs, pool);
+#else
+        uring_unavailable("flood was built without liburing");
+#endif
+    }
     
     return fs;
 }
@@ -97,18 +500,32 @@ flood_socket_t* open_socket(apr_pool_t *pool, request_t *r,
 void close_socket(flood_socket_t *s)
 {
     /* FIXME: recording and other stuff here? */
+#if FLOOD_HAS_LIBURING
+    if (s->uring)
+        apr_pool_cleanup_run(s->uring->pool, s->uring, uring_cleanup);
+#endif
     apr_socket_close(s->socket);
 }
 
 apr_status_t read_socket(flood_socket_t *s, char *buf, apr_size_t *buflen)
 {
     apr_status_t e;
-    apr_int32_t socketsRead;
 
-    e = apr_poll(&s->read_pollset, 1, &socketsRead, LOCAL_SOCKET_TIMEOUT);
-    if (e != APR_SUCCESS)
+#if FLOOD_HAS_LIBURING
+    if (s->uring)
+        return uring_read(s, buf, buflen);
+#endif
+
+    e = wait_socket(s, &s->read_pollset);
+    if (e != APR_SUCCESS) {
+        /* Nothing was read, as apr_socket_recv() would say. */
+        *buflen = 0;
         return e;
-    return apr_socket_recv(s->socket, buf, buflen);
+    }
+    e = apr_socket_recv(s->socket, buf, buflen);
+    if (e == APR_SUCCESS)
+        s->firstbyte = 0;
+    return e;
 }
 
 apr_status_t write_socket(flood_socket_t *s, request_t *r)
@@ -116,10 +533,32 @@ apr_status_t write_socket(flood_socket_t *s, request_t *r)
     apr_size_t l;
     apr_status_t e;
 
+    arm_socket(s, r);
+
+#if FLOOD_HAS_LIBURING
+    if (s->uring)
+        return uring_write(s, r);
+#endif
+
     l = r->rbufsize;
 
     e = apr_socket_send(s->socket, r->rbuf, &l);
 
+    if (APR_STATUS_IS_EINPROGRESS(e) && s->fastopen) {
+        /* No cookie yet, so the SYN went out bare; send once the
+         * handshake completes. */
+        apr_pollfd_t pout;
+
+        pout = s->read_pollset;
+        pout.reqevents = APR_POLLOUT;
+        e = wait_socket(s, &pout);
+        if (e != APR_SUCCESS)
+            return e;
+
+        l = r->rbufsize;
+        e = apr_socket_send(s->socket, r->rbuf, &l);
+    }
+
     /* FIXME: Better error and allow restarts? */
     if (l != r->rbufsize)
         return APR_EGENERAL;
@@ -134,6 +573,15 @@ apr_status_t check_socket(flood_socket_t *s, apr_pool_t *pool)
     apr_pollfd_t pout;
     apr_int16_t event;
 
+#if FLOOD_HAS_LIBURING
+    /* While the ring holds a receive, only the ring can tell. */
+    if (s->uring) {
+        e = uring_check(s->uring);
+        if (e != APR_SUCCESS || s->uring->armed)
+            return e;
+    }
+#endif
+
     pout.desc_type = APR_POLL_SOCKET;
     pout.desc.s = s->socket;
     pout.reqevents = APR_POLLIN | APR_POLLPRI | APR_POLLERR | APR_POLLHUP | APR_POLLNVAL;
@@ -146,3 +594,51 @@ apr_status_t check_socket(flood_socket_t *s, apr_pool_t *pool)
     
     return APR_SUCCESS;
 }
+
+/* Start the clock on r, which is about to be written to s.  Waits on s
+ * keep to r's deadlines until the next request comes along. */
+void arm_socket(flood_socket_t *s, request_t *r)
+{
+    s->deadline = r->deadline;
+    s->firstbyte = r->timeouts.firstbyte ?
+                   apr_time_now() + r->timeouts.firstbyte : 0;
+    s->wait = r->timeouts.idle;
+}
+
+/* Wait for the events pfd asks for, or until s's time is up. */
+apr_status_t wait_socket(flood_socket_t *s, apr_pollfd_t *pfd)
+{
+    apr_interval_time_t t;
+    apr_status_t e, expired;
+    apr_int32_t socketsReady;
+
+    if ((t = deadline_wait(s, &expired)) <= 0)
+        return expired;
+
+    e = apr_poll(pfd, 1, &socketsReady, t);
+    if (APR_STATUS_IS_TIMEUP(e) || (e == APR_SUCCESS && socketsReady != 1))
+        return expired;
+    return e;
+}
+
+/* Did the server accept the data we put in the SYN? */
+int fastopen_status(flood_socket_t *s)
+{
+#if FLOOD_HAS_FASTOPEN
+    struct tcp_info ti;
+    socklen_t len = sizeof(ti);
+    apr_os_sock_t fd;
+
+    if (!s->fastopen)
+        return FLOOD_FASTOPEN_NONE;
+
+    apr_os_sock_get(&fd, s->socket);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len) == 0 &&
+        (ti.tcpi_options & TCPI_OPT_SYN_DATA))
+        return FLOOD_FASTOPEN_USED;
+
+    return FLOOD_FASTOPEN_MISSED;
+#else
+    return FLOOD_FASTOPEN_NONE;
+#endif
+}
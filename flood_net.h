@@ -19,22 +19,41 @@
 #ifndef __flood_socket_h
 #define __flood_socket_h
 
+#include <apr_errno.h>      /* APR_OS_START_USERERR */
 #include <apr_network_io.h> /* apr_socket_t */
 #include <apr_poll.h>       /* apr_pollfd_t */
 #include <apr_pools.h>      /* apr_pool_t */
+#include <apr_time.h>       /* apr_time_t */
 
 #include "flood_profile.h"
 
 typedef struct flood_socket_t {
     apr_socket_t *socket;
     apr_pollfd_t read_pollset;
+    /* Set when sends and receives go through io_uring. */
+    struct flood_uring_t *uring;
+    /* Set when the connect was deferred for TCP Fast Open. */
+    int fastopen;
+    /* The deadlines of the request in flight, as absolute times (0 when
+     * there is none), and the longest any one wait may take. */
+    apr_time_t deadline;
+    apr_time_t firstbyte;
+    apr_interval_time_t wait;
 } flood_socket_t;
 
+/* Returned by reads and waits that outlive a request's deadlines.  A
+ * wait that runs out on its own returns APR_TIMEUP. */
+#define FLOOD_EFIRSTBYTE (APR_OS_START_USERERR + 1)
+#define FLOOD_ETOTALTIME (APR_OS_START_USERERR + 2)
+
 flood_socket_t* open_socket(apr_pool_t *pool, request_t *r,
                             apr_status_t *status);
 void close_socket(flood_socket_t *s);
 apr_status_t write_socket(flood_socket_t *s, request_t *r);
 apr_status_t read_socket(flood_socket_t *s, char *buf, apr_size_t *buflen);
 apr_status_t check_socket(flood_socket_t *s, apr_pool_t *pool);
+int fastopen_status(flood_socket_t *s);
+void arm_socket(flood_socket_t *s, request_t *r);
+apr_status_t wait_socket(flood_socket_t *s, apr_pollfd_t *pfd);
 
 #endif  /* __flood_socket_h */
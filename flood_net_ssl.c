@@ -18,6 +18,7 @@
 
 #include <apr_portable.h>
 #include <apr_strings.h>
+#include <apr_hash.h>
 
 #if APR_HAVE_UNISTD_H
 #include <unistd.h>
@@ -34,17 +35,54 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/rand.h>
+#include <openssl/bio.h>
+
+/* Kernel TLS offload needs OpenSSL 3.0 built with ktls support.  Whether
+ * the kernel actually takes the connection is only known once the
+ * handshake has completed; until then (or forever, if the tls module
+ * isn't loaded) we stay on the userspace SSL_read() path. */
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define FLOOD_HAS_KTLS 1
+#else
+#define FLOOD_HAS_KTLS 0
+#endif
+
+/* TLS 1.3 early data (0-RTT) appeared in OpenSSL 1.1.1. */
+#ifdef SSL_EARLY_DATA_ACCEPTED
+#define FLOOD_HAS_EARLY_DATA 1
+#else
+#define FLOOD_HAS_EARLY_DATA 0
+#endif
+
+/* How many resumable sessions we keep around for each server. */
+#define SSL_SESSION_CACHE_DEPTH 16
 
 struct ssl_socket_t {
     SSL_CTX *ssl_context;
     SSL *ssl_connection;
     flood_socket_t *socket;
+    int ktls;          /* A boolean: kTLS was requested */
+    int ktls_recv;     /* A boolean: the kernel decrypts for us */
+    const char *session_key; /* "host:port" if we cache sessions */
+    request_t *early_req;    /* Request to be sent as early data */
+    int early_pending;       /* A boolean: handshake still to finish */
 };
 
+typedef struct {
+    int count;
+    SSL_SESSION *session[SSL_SESSION_CACHE_DEPTH];
+} ssl_session_list_t;
+
+extern apr_file_t *local_stderr;
+
 apr_pool_t *ssl_pool;
 
+/* Resumable client sessions, keyed by "host:port". */
+static apr_hash_t *ssl_sessions;
+
 #if APR_HAS_THREADS
 apr_thread_mutex_t **ssl_locks;
+static apr_thread_mutex_t *ssl_sessions_lock;
 
 typedef struct CRYPTO_dynlock_value { 
     apr_thread_mutex_t *lock; 
@@ -167,13 +205,187 @@ apr_status_t ssl_init_socket(apr_pool_t *pool)
     CRYPTO_set_dynlock_create_callback(ssl_dyn_create);
     CRYPTO_set_dynlock_lock_callback(ssl_dyn_lock);
     CRYPTO_set_dynlock_destroy_callback(ssl_dyn_destroy);
+
+    apr_thread_mutex_create(&ssl_sessions_lock, APR_THREAD_MUTEX_DEFAULT,
+                            ssl_pool);
 #endif
 
+    ssl_sessions = apr_hash_make(ssl_pool);
+
     return APR_SUCCESS;
 }
 
 void ssl_read_socket_handshake(ssl_socket_t *s);
 
+static void ssl_ktls_unavailable(const char *why)
+{
+    static int warned = 0;
+
+    /* Not worth a mutex; at worst a few threads complain. */
+    if (!warned) {
+        warned = 1;
+        apr_file_printf(local_stderr,
+                        "kTLS requested but %s, using userspace TLS.\n", why);
+    }
+}
+
+/* Once the handshake is done, find out whether OpenSSL managed to hand the
+ * receive side of the connection to the kernel. */
+static void ssl_ktls_check(ssl_socket_t *s)
+{
+#if FLOOD_HAS_KTLS
+    if (s->ktls && !s->ktls_recv && SSL_is_init_finished(s->ssl_connection)) {
+        s->ktls_recv = BIO_get_ktls_recv(SSL_get_rbio(s->ssl_connection));
+        if (!s->ktls_recv) {
+            ssl_ktls_unavailable("the kernel did not accept the connection");
+        }
+        /* Don't ask again. */
+        s->ktls = 0;
+    }
+#endif
+}
+
+static void ssl_sessions_lock_acquire(void)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(ssl_sessions_lock);
+#endif
+}
+
+static void ssl_sessions_lock_release(void)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(ssl_sessions_lock);
+#endif
+}
+
+/* OpenSSL hands us every session ticket the server issues.  TLS 1.3
+ * tickets are meant to be used once, so we keep a short stack per server
+ * and drop the oldest when it overflows. */
+static int ssl_new_session(SSL *ssl, SSL_SESSION *session)
+{
+    ssl_socket_t *s = SSL_get_app_data(ssl);
+    ssl_session_list_t *list;
+
+    if (!s || !s->session_key)
+        return 0;
+#if FLOOD_HAS_EARLY_DATA
+    if (!SSL_SESSION_is_resumable(session))
+        return 0;
+#endif
+
+    ssl_sessions_lock_acquire();
+    list = apr_hash_get(ssl_sessions, s->session_key, APR_HASH_KEY_STRING);
+    if (!list) {
+        list = apr_pcalloc(ssl_pool, sizeof(ssl_session_list_t));
+        apr_hash_set(ssl_sessions, apr_pstrdup(ssl_pool, s->session_key),
+                     APR_HASH_KEY_STRING, list);
+    }
+    if (list->count == SSL_SESSION_CACHE_DEPTH) {
+        SSL_SESSION_free(list->session[0]);
+        memmove(list->session, list->session + 1,
+                sizeof(SSL_SESSION*) * (SSL_SESSION_CACHE_DEPTH - 1));
+        list->count--;
+    }
+    list->session[list->count++] = session;
+    ssl_sessions_lock_release();
+
+    /* We keep the reference OpenSSL gave us. */
+    return 1;
+}
+
+/* Take the freshest session for this server out of the cache.  The caller
+ * owns the returned reference. */
+static SSL_SESSION *ssl_take_session(const char *key)
+{
+    ssl_session_list_t *list;
+    SSL_SESSION *session = NULL;
+
+    ssl_sessions_lock_acquire();
+    list = apr_hash_get(ssl_sessions, key, APR_HASH_KEY_STRING);
+    if (list && list->count) {
+        session = list->session[--list->count];
+    }
+    ssl_sessions_lock_release();
+
+    return session;
+}
+
+/* Wait until the socket is ready for the given events. */
+static apr_status_t ssl_wait_socket(ssl_socket_t *s, apr_int16_t events)
+{
+    apr_pollfd_t pfd;
+
+    pfd = s->socket->read_pollset;
+    pfd.reqevents = events;
+    return wait_socket(s->socket, &pfd);
+}
+
+#if FLOOD_HAS_EARLY_DATA
+/* Send the request along with the ClientHello. */
+static apr_status_t ssl_write_early_data(ssl_socket_t *s, request_t *r)
+{
+    size_t written;
+    apr_status_t e;
+
+    while (!SSL_write_early_data(s->ssl_connection, r->rbuf, r->rbufsize,
+                                 &written)) {
+        switch (SSL_get_error(s->ssl_connection, 0))
+        {
+        case SSL_ERROR_WANT_READ:
+            e = ssl_wait_socket(s, APR_POLLIN);
+            break;
+        case SSL_ERROR_WANT_WRITE:
+            e = ssl_wait_socket(s, APR_POLLOUT);
+            break;
+        default:
+            ERR_print_errors_fp(stderr);
+            return APR_EGENERAL;
+        }
+        if (e != APR_SUCCESS)
+            return e;
+    }
+
+    return APR_SUCCESS;
+}
+
+/* Complete a handshake that was started with early data, and find out
+ * whether the server took it.  If it didn't, send the request again, this
+ * time as ordinary application data. */
+static apr_status_t ssl_finish_early_data(ssl_socket_t *s)
+{
+    apr_status_t e;
+    int rv;
+
+    s->early_pending = 0;
+
+    while ((rv = SSL_do_handshake(s->ssl_connection)) != 1) {
+        switch (SSL_get_error(s->ssl_connection, rv))
+        {
+        case SSL_ERROR_WANT_READ:
+            e = ssl_wait_socket(s, APR_POLLIN);
+            break;
+        case SSL_ERROR_WANT_WRITE:
+            e = ssl_wait_socket(s, APR_POLLOUT);
+            break;
+        default:
+            ERR_print_errors_fp(stderr);
+            return APR_EGENERAL;
+        }
+        if (e != APR_SUCCESS)
+            return e;
+    }
+
+    if (SSL_get_early_data_status(s->ssl_connection) == SSL_EARLY_DATA_ACCEPTED) {
+        s->early_req->earlydatastatus = FLOOD_EARLY_DATA_ACCEPTED;
+        return APR_SUCCESS;
+    }
+
+    s->early_req->earlydatastatus = FLOOD_EARLY_DATA_REJECTED;
+    return ssl_write_socket(s, s->early_req);
+}
+#endif
+
 ssl_socket_t* ssl_open_socket(apr_pool_t *pool, request_t *r,
                               apr_status_t *status) 
 {
@@ -181,12 +393,20 @@ ssl_socket_t* ssl_open_socket(apr_pool_t *pool, request_t *r,
     int e, sslError;
 
     ssl_socket_t *ssl_socket = apr_pcalloc(pool, sizeof(ssl_socket_t));
-
-    /* Open our TCP-based connection */
-    ssl_socket->socket = open_socket(pool, r, status);
+    request_t plain;
+
+    /* Open our TCP-based connection.  OpenSSL reads the descriptor
+     * itself, so it must not go through io_uring, and it doesn't expect
+     * the EINPROGRESS a deferred Fast Open connect gives its first write. */
+    plain = *r;
+    plain.iouring = 0;
+    plain.fastopen = 0;
+    ssl_socket->socket = open_socket(pool, &plain, status);
     
-    if (!ssl_socket->socket)
+    if (!ssl_socket->socket) {
+        r->error = plain.error;
         return NULL;
+    }
 
     /* Get the native OS socket. */
     apr_os_sock_get(&ossock, ssl_socket->socket->socket);
@@ -205,8 +425,59 @@ ssl_socket_t* ssl_open_socket(apr_pool_t *pool, request_t *r,
     ssl_socket->ssl_connection = SSL_new(ssl_socket->ssl_context);
     SSL_set_connect_state(ssl_socket->ssl_connection);
 
+    if (r->ktls) {
+#if FLOOD_HAS_KTLS
+        /* Must be set before the handshake derives the keys. */
+        SSL_set_options(ssl_socket->ssl_connection, SSL_OP_ENABLE_KTLS);
+        ssl_socket->ktls = 1;
+#else
+        ssl_ktls_unavailable("OpenSSL lacks kTLS support");
+#endif
+    }
+
+    if (r->alpn) {
+#ifdef TLSEXT_TYPE_application_layer_protocol_negotiation
+        SSL_set_alpn_protos(ssl_socket->ssl_connection,
+                            (const unsigned char *)r->alpn, strlen(r->alpn));
+#endif
+    }
+
     /* Set the descriptors */
     SSL_set_fd(ssl_socket->ssl_connection, ossock);
+
+    if (r->earlydata) {
+        apr_uri_t *u;
+        SSL_SESSION *session;
+
+        u = r->parsed_proxy_uri ? r->parsed_proxy_uri : r->parsed_uri;
+        ssl_socket->session_key = apr_psprintf(pool, "%s:%d", u->hostname,
+                                               u->port);
+
+        SSL_set_app_data(ssl_socket->ssl_connection, ssl_socket);
+        SSL_CTX_set_session_cache_mode(ssl_socket->ssl_context,
+                                       SSL_SESS_CACHE_CLIENT |
+                                       SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ssl_socket->ssl_context, ssl_new_session);
+
+        session = ssl_take_session(ssl_socket->session_key);
+        if (session) {
+            SSL_set_session(ssl_socket->ssl_connection, session);
+#if FLOOD_HAS_EARLY_DATA
+            /* Only requests that are safe to replay go out as 0-RTT, and
+             * only if they fit in what the server said it would take. */
+            if ((r->method == GET || r->method == HEAD) &&
+                SSL_SESSION_get_max_early_data(session) > 0) {
+                ssl_socket->early_pending = 1;
+            }
+#endif
+            SSL_SESSION_free(session);
+        }
+
+        /* The handshake is finished once the request has been sent. */
+        if (ssl_socket->early_pending)
+            return ssl_socket;
+    }
+
     e = SSL_connect(ssl_socket->ssl_connection);
 
     if (e)
@@ -222,16 +493,27 @@ ssl_socket_t* ssl_open_socket(apr_pool_t *pool, request_t *r,
             break;
         default:
             ERR_print_errors_fp(stderr);
+            r->error = FLOOD_ERR_TLS;
+            if (status)
+                *status = APR_EGENERAL;
             return NULL; 
         }
     }
 
+    ssl_ktls_check(ssl_socket);
+
     return ssl_socket;
 }
 
 /* close down TCP socket */
 void ssl_close_socket(ssl_socket_t *s)
 {
+    /* Without this, SSL_free() decides the session is bad and spoils the
+     * tickets we have cached from this connection. */
+    if (s->session_key) {
+        SSL_set_shutdown(s->ssl_connection,
+                         SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    }
     SSL_free(s->ssl_connection);
     SSL_CTX_free(s->ssl_context);
     close_socket(s->socket);
@@ -241,15 +523,43 @@ apr_status_t ssl_read_socket(ssl_socket_t *s, char *buf, apr_size_t *buflen)
 {
     apr_status_t e;
     int sslError;
-    apr_int32_t socketsRead;
+
+#if FLOOD_HAS_EARLY_DATA
+    if (s->early_pending) {
+        e = ssl_finish_early_data(s);
+        if (e != APR_SUCCESS) {
+            *buflen = 0;
+            return e;
+        }
+    }
+#endif
+
+    ssl_ktls_check(s);
+
+#if FLOOD_HAS_KTLS
+    /* With kTLS the socket hands us plaintext, so a plain recv() will do as
+     * long as OpenSSL has nothing buffered.  Records other than application
+     * data (alerts, tickets) make recv() fail; SSL_read() knows how to pick
+     * those up, so fall through to it. */
+    if (s->ktls_recv && !SSL_has_pending(s->ssl_connection)) {
+        apr_size_t len = *buflen;
+
+        e = read_socket(s->socket, buf, &len);
+        if (e == APR_SUCCESS || e == APR_EOF || e == APR_TIMEUP ||
+            e == FLOOD_EFIRSTBYTE || e == FLOOD_ETOTALTIME) {
+            *buflen = len;
+            return e;
+        }
+    }
+#endif
 
     /* Wait until there is something to read. */
     if (SSL_pending(s->ssl_connection) < *buflen) {
-        e = apr_poll(&s->socket->read_pollset, 1, &socketsRead,
-                     LOCAL_SOCKET_TIMEOUT);
-
-        if (socketsRead != 1)
-            return APR_TIMEUP;
+        e = wait_socket(s->socket, &s->socket->read_pollset);
+        if (e != APR_SUCCESS) {
+            *buflen = 0;
+            return e;
+        }
     }
 
     e = SSL_read(s->ssl_connection, buf, *buflen);
@@ -259,18 +569,22 @@ apr_status_t ssl_read_socket(ssl_socket_t *s, char *buf, apr_size_t *buflen)
     {
     case SSL_ERROR_NONE:
         *buflen = e;
+        s->socket->firstbyte = 0;
         break;
     case SSL_ERROR_WANT_READ:
-        ssl_read_socket(s, buf, buflen);
-        break;
+        /* Only part of a record, or none of the data; keep waiting. */
+        return ssl_read_socket(s, buf, buflen);
     case SSL_ERROR_ZERO_RETURN: /* Peer closed connection. */
+        *buflen = 0;
         return APR_EOF; 
     case SSL_ERROR_SYSCALL: /* Look at errno. */
+        *buflen = 0;
         if (errno == 0)
             return APR_EOF;
         /* Continue through with the error case. */   
     case SSL_ERROR_WANT_WRITE:  /* Technically, not an error. */
     default:
+        *buflen = 0;
         ERR_print_errors_fp(stderr);
         return APR_EGENERAL; 
     }
@@ -283,10 +597,8 @@ void ssl_read_socket_handshake(ssl_socket_t *s)
     char buf[1];
     int buflen = 1; 
     /* Wait until there is something to read. */
-    apr_int32_t socketsRead;
     apr_status_t e;
-    e = apr_poll(&s->socket->read_pollset, 1, &socketsRead,
-                 LOCAL_SOCKET_TIMEOUT);
+    e = wait_socket(s->socket, &s->socket->read_pollset);
     e = SSL_read(s->ssl_connection, buf, buflen);
 }
 
@@ -296,6 +608,20 @@ apr_status_t ssl_write_socket(ssl_socket_t *s, request_t *r)
     apr_status_t e;
     int sslError;
 
+    arm_socket(s->socket, r);
+
+#if FLOOD_HAS_EARLY_DATA
+    if (s->early_pending) {
+        if (r->rbufsize <= SSL_SESSION_get_max_early_data(
+                               SSL_get_session(s->ssl_connection))) {
+            s->early_req = r;
+            return ssl_write_early_data(s, r);
+        }
+        /* Too big for 0-RTT; SSL_write() does an ordinary resumption. */
+        s->early_pending = 0;
+    }
+#endif
+
     /* Returns an error. */
     e = SSL_write(s->ssl_connection, r->rbuf, r->rbufsize);
 
@@ -323,6 +649,29 @@ apr_status_t ssl_check_socket(ssl_socket_t *s, apr_pool_t *pool)
     return check_socket(s->socket, pool);
 }
 
+flood_socket_t *ssl_get_socket(ssl_socket_t *s)
+{
+    return s->socket;
+}
+
+apr_size_t ssl_pending_socket(ssl_socket_t *s)
+{
+    return SSL_pending(s->ssl_connection);
+}
+
+const char *ssl_get_alpn(ssl_socket_t *s, apr_pool_t *pool)
+{
+#ifdef TLSEXT_TYPE_application_layer_protocol_negotiation
+    const unsigned char *proto;
+    unsigned int len;
+
+    SSL_get0_alpn_selected(s->ssl_connection, &proto, &len);
+    if (len)
+        return apr_pstrmemdup(pool, (const char *)proto, len);
+#endif
+    return NULL;
+}
+
 #else /* FLOOD_HAS_OPENSSL */
 
 apr_status_t ssl_init_socket(apr_pool_t *pool)
@@ -355,4 +704,19 @@ apr_status_t ssl_check_socket(ssl_socket_t *s, apr_pool_t *pool)
     return APR_ENOTIMPL;
 }
 
+flood_socket_t *ssl_get_socket(ssl_socket_t *s)
+{
+    return NULL;
+}
+
+apr_size_t ssl_pending_socket(ssl_socket_t *s)
+{
+    return 0;
+}
+
+const char *ssl_get_alpn(ssl_socket_t *s, apr_pool_t *pool)
+{
+    return NULL;
+}
+
 #endif /* FLOOD_HAS_OPENSSL */
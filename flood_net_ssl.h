@@ -22,6 +22,8 @@
 #include <apr_network_io.h> /* apr_socket_t */
 #include <apr_pools.h>      /* apr_pool_t */
 
+#include "flood_net.h"      /* flood_socket_t */
+
 typedef struct ssl_socket_t ssl_socket_t;
 
 apr_status_t ssl_init_socket(apr_pool_t *pool);
@@ -31,5 +33,8 @@ void ssl_close_socket(ssl_socket_t *s);
 apr_status_t ssl_write_socket(ssl_socket_t *s, request_t *r);
 apr_status_t ssl_read_socket(ssl_socket_t *s, char *buf, apr_size_t *buflen);
 apr_status_t ssl_check_socket(ssl_socket_t *s, apr_pool_t *pool);
+flood_socket_t *ssl_get_socket(ssl_socket_t *s);
+apr_size_t ssl_pending_socket(ssl_socket_t *s);
+const char *ssl_get_alpn(ssl_socket_t *s, apr_pool_t *pool);
 
 #endif  /* __flood_net_socket_h */
@@ -43,17 +43,19 @@ POSSIBILITY OF SUCH DAMAGE.
 -----------------------------------------------------------------------------
 */
 
+#include "config.h"
+
+#if FLOOD_USE_PCRE
+
+#define PCRE2_CODE_UNIT_WIDTH 8
+
 #include "flood_pcre.h"
 #include "apr_strings.h"
-#include "pcre.h"
+#include "pcre2.h"
 
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
 
-#ifndef POSIX_MALLOC_THRESHOLD
-#define POSIX_MALLOC_THRESHOLD (10)
-#endif
-
 /* Table of error strings corresponding to POSIX error codes; must be
  * kept in synch with include/flood_regex.h's FLOOD_REG_E* definitions. */
 
@@ -82,7 +84,7 @@ addlength = (preg != NULL && (int)preg->re_erroffset != -1)?
 if (errbuf_size > 0)
   {
   if (addlength > 0 && errbuf_size >= length + addlength)
-      apr_snprintf(errbuf, sizeof errbuf,
+      apr_snprintf(errbuf, errbuf_size,
                    "%s%s%-6d", message, addmessage, (int)preg->re_erroffset);
   else
     {
@@ -103,7 +105,10 @@ return length + addlength;
 
 void flood_regfree(flood_regex_t *preg)
 {
-(pcre_free)(preg->re_pcre);
+pcre2_match_data_free((pcre2_match_data *)preg->re_match);
+pcre2_code_free((pcre2_code *)preg->re_pcre);
+preg->re_match = NULL;
+preg->re_pcre = NULL;
 }
 
 
@@ -121,23 +126,43 @@ Arguments:
 
 Returns:      0 on success
               various non-zero codes on failure
+
+The pattern is handed to the JIT compiler as well when PCRE2 was built
+with it.  If it wasn't, or it can't handle the pattern, matches go
+through the interpreter as before. The match data block every match needs
+is made here, big enough for all the pattern's captures, and reused.
 */
 
 int flood_regcomp(flood_regex_t *preg, const char *pattern, int cflags)
 {
-const char *errorptr;
-int erroffset;
-int options = 0;
+int errorcode;
+PCRE2_SIZE erroffset;
+uint32_t options = 0, capturecount = 0;
+pcre2_code *re;
+
+if ((cflags & FLOOD_REG_ICASE) != 0) options |= PCRE2_CASELESS;
+if ((cflags & FLOOD_REG_NEWLINE) != 0) options |= PCRE2_MULTILINE;
+
+re = pcre2_compile((PCRE2_SPTR)pattern, PCRE2_ZERO_TERMINATED, options,
+  &errorcode, &erroffset, NULL);
+preg->re_pcre = re;
+preg->re_match = NULL;
+preg->re_erroffset = erroffset;
 
-if ((cflags & FLOOD_REG_ICASE) != 0) options |= PCRE_CASELESS;
-if ((cflags & FLOOD_REG_NEWLINE) != 0) options |= PCRE_MULTILINE;
+if (re == NULL) return FLOOD_REG_INVARG;
 
-preg->re_pcre = pcre_compile(pattern, options, &errorptr, &erroffset, NULL);
-preg->re_erroffset = erroffset;
+preg->re_match = pcre2_match_data_create_from_pattern(re, NULL);
+if (preg->re_match == NULL)
+  {
+  pcre2_code_free(re);
+  preg->re_pcre = NULL;
+  return FLOOD_REG_ESPACE;
+  }
 
-if (preg->re_pcre == NULL) return FLOOD_REG_INVARG;
+preg->re_jit = pcre2_jit_compile(re, PCRE2_JIT_COMPLETE) == 0;
 
-preg->re_nsub = pcre_info((const pcre *)preg->re_pcre, NULL, NULL);
+pcre2_pattern_info(re, PCRE2_INFO_CAPTURECOUNT, &capturecount);
+preg->re_nsub = capturecount;
 return 0;
 }
 
@@ -148,83 +173,80 @@ return 0;
 *              Match a regular expression        *
 *************************************************/
 
-/* Unfortunately, PCRE requires 3 ints of working space for each captured
-substring, so we have to get and release working store instead of just using
-the POSIX structures as was done in earlier releases when PCRE needed only 2
-ints. However, if the number of possible capturing brackets is small, use a
-block of store on the stack, to reduce the use of malloc/free. The threshold is
-in a macro that can be changed at configure time. */
+/* PCRE2 hands back offsets in the regex's match data block rather than the
+POSIX structures, so we copy them across. With FLOOD_REG_STARTEND, pmatch[0] gives the part of the
+string to search, as with the BSD and glibc REG_STARTEND, so the string
+needn't be NUL-terminated and nobody has to strlen() a large body. */
 
 int flood_regexec(const flood_regex_t *preg, const char *string,
                   apr_size_t nmatch, flood_regmatch_t pmatch[],
                   int eflags)
 {
 int rc;
-int options = 0;
-int *ovector = NULL;
-int small_ovector[POSIX_MALLOC_THRESHOLD * 3];
-int allocated_ovector = 0;
+uint32_t options = 0;
+PCRE2_SIZE start = 0, length;
+PCRE2_SIZE *ovector;
+pcre2_match_data *md;
+apr_size_t i;
 
-if ((eflags & FLOOD_REG_NOTBOL) != 0) options |= PCRE_NOTBOL;
-if ((eflags & FLOOD_REG_NOTEOL) != 0) options |= PCRE_NOTEOL;
+if ((eflags & FLOOD_REG_NOTBOL) != 0) options |= PCRE2_NOTBOL;
+if ((eflags & FLOOD_REG_NOTEOL) != 0) options |= PCRE2_NOTEOL;
 
 ((flood_regex_t *)preg)->re_erroffset = (apr_size_t)(-1);  /* Only has meaning after compile */
 
-if (nmatch > 0)
+if ((eflags & FLOOD_REG_STARTEND) != 0)
   {
-  if (nmatch <= POSIX_MALLOC_THRESHOLD)
-    {
-    ovector = &(small_ovector[0]);
-    }
-  else
-    {
-    ovector = (int *)malloc(sizeof(int) * nmatch * 3);
-    if (ovector == NULL) return FLOOD_REG_ESPACE;
-    allocated_ovector = 1;
-    }
+  start = pmatch[0].rm_so;
+  length = pmatch[0].rm_eo;
   }
+else
+  length = strlen(string);
+
+md = (pcre2_match_data *)preg->re_match;
 
-rc = pcre_exec((const pcre *)preg->re_pcre, NULL, string, (int)strlen(string),
-  0, options, ovector, nmatch * 3);
+if (preg->re_jit)
+  rc = pcre2_jit_match((const pcre2_code *)preg->re_pcre, (PCRE2_SPTR)string,
+    length, start, options, md, NULL);
+else
+  rc = pcre2_match((const pcre2_code *)preg->re_pcre, (PCRE2_SPTR)string,
+    length, start, options, md, NULL);
 
 if (rc == 0) rc = nmatch;    /* All captured slots were filled in */
 
 if (rc >= 0)
   {
-  apr_size_t i;
-  for (i = 0; i < (apr_size_t)rc; i++)
+  ovector = pcre2_get_ovector_pointer(md);
+  for (i = 0; i < (apr_size_t)rc && i < nmatch; i++)
     {
-    pmatch[i].rm_so = ovector[i*2];
-    pmatch[i].rm_eo = ovector[i*2+1];
+    if (ovector[i*2] == PCRE2_UNSET)
+      pmatch[i].rm_so = pmatch[i].rm_eo = -1;
+    else
+      {
+      pmatch[i].rm_so = (int)ovector[i*2];
+      pmatch[i].rm_eo = (int)ovector[i*2+1];
+      }
     }
-  if (allocated_ovector) free(ovector);
   for (; i < nmatch; i++) pmatch[i].rm_so = pmatch[i].rm_eo = -1;
   return 0;
   }
 
 else
   {
-  if (allocated_ovector) free(ovector);
   switch(rc)
     {
-    case PCRE_ERROR_NOMATCH: return FLOOD_REG_NOMATCH;
-    case PCRE_ERROR_NULL: return FLOOD_REG_INVARG;
-    case PCRE_ERROR_BADOPTION: return FLOOD_REG_INVARG;
-    case PCRE_ERROR_BADMAGIC: return FLOOD_REG_INVARG;
-    case PCRE_ERROR_UNKNOWN_NODE: return FLOOD_REG_ASSERT;
-    case PCRE_ERROR_NOMEMORY: return FLOOD_REG_ESPACE;
-#ifdef PCRE_ERROR_MATCHLIMIT
-    case PCRE_ERROR_MATCHLIMIT: return FLOOD_REG_ESPACE;
-#endif
-#ifdef PCRE_ERROR_BADUTF8
-    case PCRE_ERROR_BADUTF8: return FLOOD_REG_INVARG;
-#endif
-#ifdef PCRE_ERROR_BADUTF8_OFFSET
-    case PCRE_ERROR_BADUTF8_OFFSET: return FLOOD_REG_INVARG;
-#endif
+    case PCRE2_ERROR_NOMATCH: return FLOOD_REG_NOMATCH;
+    case PCRE2_ERROR_NULL: return FLOOD_REG_INVARG;
+    case PCRE2_ERROR_BADOPTION: return FLOOD_REG_INVARG;
+    case PCRE2_ERROR_BADMAGIC: return FLOOD_REG_INVARG;
+    case PCRE2_ERROR_BADOFFSET: return FLOOD_REG_INVARG;
+    case PCRE2_ERROR_NOMEMORY: return FLOOD_REG_ESPACE;
+    case PCRE2_ERROR_MATCHLIMIT: return FLOOD_REG_ESPACE;
+    case PCRE2_ERROR_JIT_STACKLIMIT: return FLOOD_REG_ESPACE;
     default: return FLOOD_REG_ASSERT;
     }
   }
 }
 
+#endif  /* FLOOD_USE_PCRE */
+
 /* End of pcreposix.c */
@@ -69,6 +69,7 @@ extern "C" {
 #define FLOOD_REG_NEWLINE  0x02 /** don't match newlines against '.' etc */
 #define FLOOD_REG_NOTBOL   0x04 /** ^ will not match against start-of-string */
 #define FLOOD_REG_NOTEOL   0x08 /** $ will not match against end-of-string */
+#define FLOOD_REG_STARTEND 0x10 /** search only from pmatch[0].rm_so to rm_eo */
 
 #define FLOOD_REG_EXTENDED (0)  /** unused */
 #define FLOOD_REG_NOSUB    (0)  /** unused */
@@ -81,11 +82,15 @@ enum {
   FLOOD_REG_NOMATCH      /** match failed */
 };
 
-/* The structure representing a compiled regular expression. */
+/* The structure representing a compiled regular expression.  It keeps
+ * the match data its matches are made in, so only one thread at a time
+ * may match against it. */
 typedef struct {
     void *re_pcre;
+    void *re_match; /* pcre2_match_data, made with the pattern */
     apr_size_t re_nsub;
     apr_size_t re_erroffset;
+    int re_jit; /* a boolean: was the pattern JIT-compiled? */
 } flood_regex_t;
 
 /* The structure in which a captured offset is returned. */
@@ -107,7 +112,8 @@ int flood_regcomp(flood_regex_t *preg, const char *regex,
                   int cflags);
 
 /**
- * Match a NUL-terminated string against a pre-compiled regex.
+ * Match a string against a pre-compiled regex.  The string must be
+ * NUL-terminated unless FLOOD_REG_STARTEND is given.
  * @param preg The pre-compiled regex
  * @param string The string to match
  * @param nmatch Provide information regarding the location of any matches
@@ -136,10 +142,13 @@ void flood_regfree(flood_regex_t *preg);
 /* Expose our API as the POSIX compatibility layer */
 #define regcomp flood_regcomp
 #define regexec flood_regexec
+#define regerror flood_regerror
 #define regfree flood_regfree
 #define regex_t flood_regex_t
 #define regmatch_t flood_regmatch_t
 #define REG_EXTENDED FLOOD_REG_EXTENDED
+#define REG_NOTBOL FLOOD_REG_NOTBOL
+#define REG_STARTEND FLOOD_REG_STARTEND
 
 #ifdef __cplusplus
 }   /* extern "C" */
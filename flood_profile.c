@@ -19,6 +19,9 @@
 #include <apr_file_io.h>
 #include <apr_strings.h>
 #include <apr_errno.h>
+#include <apr_dso.h>
+#include <apr_tables.h>
+#include <apr_lib.h>
 
 #if APR_HAVE_STRING_H
 #include <string.h>    /* strncasecmp */
@@ -30,6 +33,8 @@
 #include "config.h"
 #include "flood_profile.h"
 #include "flood_config.h"
+#include "flood_mem.h"
+#include "flood_module.h"
 #include "flood_net.h"
 
 #if FLOOD_HAS_OPENSSL
@@ -41,25 +46,13 @@
 #include "flood_easy_reports.h"
 #include "flood_socket_generic.h"
 #include "flood_socket_keepalive.h"
+#include "flood_socket_h2.h"
+#include "flood_socket_h3.h"
 #include "flood_report_relative_times.h"
 
 extern apr_file_t *local_stdout;
 extern apr_file_t *local_stderr;
 
-struct profile_event_handler_t {
-    const char *handler_name;
-    const char *impl_name;
-    void *handler;
-};
-typedef struct profile_event_handler_t profile_event_handler_t;
-
-struct profile_group_handler_t {
-    const char *class;
-    const char *group_name;
-    const char **handlers;
-};
-typedef struct profile_group_handler_t profile_group_handler_t;
-
 /**
  * Generic implementation for profile_init.
  */
@@ -81,7 +74,8 @@ static apr_status_t generic_report_init(report_t **report, config_t *config, con
 /**
  * Generic implementation for get_next_url.
  */
-static apr_status_t generic_get_next_url(request_t **request, profile_t *profile)
+static apr_status_t generic_get_next_url(request_t **request, profile_t *profile,
+                                         apr_pool_t *pool)
 {
     return APR_ENOTIMPL;
 }
@@ -174,6 +168,7 @@ const char *profile_event_handler_names[] = {
     "get_next_url",
     "socket_init",
     "begin_conn",
+    "warmup_conn",
     "create_req",
     "send_req",
     "recv_resp",
@@ -197,6 +192,7 @@ profile_event_handler_t profile_event_handlers[] = {
     {"get_next_url",     "generic_get_next_url",         &generic_get_next_url},
     {"socket_init",      "generic_socket_init",          &generic_socket_init},
     {"begin_conn",       "generic_begin_conn",           &generic_begin_conn},
+    {"warmup_conn",      "generic_warmup_conn",          &generic_warmup_conn},
     {"create_req",       "generic_create_req",           &generic_create_req},
     {"send_req",         "generic_send_req",             &generic_send_req},
     {"recv_resp",        "generic_recv_resp",            &generic_recv_resp},
@@ -220,11 +216,26 @@ profile_event_handler_t profile_event_handlers[] = {
     /* Keep-Alive support */
     {"socket_init",      "keepalive_socket_init",    &keepalive_socket_init},
     {"begin_conn",       "keepalive_begin_conn",     &keepalive_begin_conn},
+    {"warmup_conn",      "keepalive_warmup_conn",    &keepalive_warmup_conn},
     {"send_req",         "keepalive_send_req",       &keepalive_send_req},
     {"recv_resp",        "keepalive_recv_resp",      &keepalive_recv_resp},
     {"end_conn",         "keepalive_end_conn",       &keepalive_end_conn},
     {"socket_destroy",   "keepalive_socket_destroy", &keepalive_socket_destroy},
 
+    /* HTTP/2 support */
+    {"socket_init",      "h2_socket_init",           &h2_socket_init},
+    {"begin_conn",       "h2_begin_conn",            &h2_begin_conn},
+    {"send_req",         "h2_send_req",              &h2_send_req},
+    {"recv_resp",        "h2_recv_resp",             &h2_recv_resp},
+    {"end_conn",         "h2_end_conn",              &h2_end_conn},
+    {"socket_destroy",   "h2_socket_destroy",        &h2_socket_destroy},
+    {"socket_init",      "h3_socket_init",           &h3_socket_init},
+    {"begin_conn",       "h3_begin_conn",            &h3_begin_conn},
+    {"send_req",         "h3_send_req",              &h3_send_req},
+    {"recv_resp",        "h3_recv_resp",             &h3_recv_resp},
+    {"end_conn",         "h3_end_conn",              &h3_end_conn},
+    {"socket_destroy",   "h3_socket_destroy",        &h3_socket_destroy},
+
     /* Round Robin */
     {"profile_init",     "round_robin_profile_init", &round_robin_profile_init},
     {"get_next_url",     "round_robin_get_next_url", &round_robin_get_next_url},
@@ -236,6 +247,7 @@ profile_event_handler_t profile_event_handlers[] = {
     /* Verification by OK/200 */
     {"verify_resp",      "verify_200",                   &verify_200},
     {"verify_resp",      "verify_status_code",           &verify_status_code},
+    {"verify_resp",      "verify_expect",                &verify_expect},
 
     /* Simple Reports */
     {"report_init",      "simple_report_init",           &simple_report_init},
@@ -268,7 +280,9 @@ const char * profile_group_handler_names[] = {
 const char * report_easy_group[] = { "easy_report_init", "easy_process_stats", "easy_report_stats", "easy_destroy_report", NULL };
 const char * report_simple_group[] = { "simple_report_init", "simple_process_stats", "simple_report_stats", "simple_destroy_report", NULL };
 const char * socket_generic_group[] = { "generic_socket_init", "generic_begin_conn", "generic_send_req", "generic_recv_resp", "generic_end_conn", "generic_socket_destroy", NULL };
-const char * socket_keepalive_group[] = { "keepalive_socket_init", "keepalive_begin_conn", "keepalive_send_req", "keepalive_recv_resp", "keepalive_end_conn", "keepalive_socket_destroy", NULL };
+const char * socket_keepalive_group[] = { "keepalive_socket_init", "keepalive_begin_conn", "keepalive_warmup_conn", "keepalive_send_req", "keepalive_recv_resp", "keepalive_end_conn", "keepalive_socket_destroy", NULL };
+const char * socket_h2_group[] = { "h2_socket_init", "h2_begin_conn", "h2_send_req", "h2_recv_resp", "h2_end_conn", "h2_socket_destroy", NULL };
+const char * socket_h3_group[] = { "h3_socket_init", "h3_begin_conn", "h3_send_req", "h3_recv_resp", "h3_end_conn", "h3_socket_destroy", NULL };
 const char * profile_round_robin_group[] = { "round_robin_profile_init", "round_robin_get_next_url", "round_robin_create_req", "round_robin_postprocess", "round_robin_loop_condition", "round_robin_profile_destroy", NULL };
 const char * report_relative_times_group[] = { "relative_times_report_init", "relative_times_process_stats", "relative_times_report_stats", "relative_times_destroy_report", NULL };
 
@@ -277,11 +291,135 @@ profile_group_handler_t profile_group_handlers[] = {
     {"report", "simple", report_simple_group },
     {"socket", "generic", socket_generic_group },
     {"socket", "keepalive", socket_keepalive_group },
+    {"socket", "h2", socket_h2_group },
+    {"socket", "h3", socket_h3_group },
     {"profiletype", "round_robin", profile_round_robin_group },
     {"report", "relative_times", report_relative_times_group },
     {NULL}
 };
 
+/* The modules named in the config, whose tables are searched after the
+ * built-in ones above. */
+static apr_array_header_t *profile_modules;
+
+static profile_event_handler_t no_event_handlers[] = { {NULL} };
+static profile_group_handler_t no_group_handlers[] = { {NULL} };
+
+/**
+ * The i'th table of handlers to search, or NULL when there are no more:
+ * first the built-in one, then each module's in the order they were
+ * loaded.
+ */
+static profile_event_handler_t *event_handler_table(int i)
+{
+    flood_module_t *module;
+
+    if (i == 0)
+        return profile_event_handlers;
+    if (!profile_modules || i > profile_modules->nelts)
+        return NULL;
+    module = ((flood_module_t **)profile_modules->elts)[i - 1];
+    return module->handlers ? module->handlers : no_event_handlers;
+}
+
+/**
+ * The same for the tables of groups.
+ */
+static profile_group_handler_t *group_handler_table(int i)
+{
+    flood_module_t *module;
+
+    if (i == 0)
+        return profile_group_handlers;
+    if (!profile_modules || i > profile_modules->nelts)
+        return NULL;
+    module = ((flood_module_t **)profile_modules->elts)[i - 1];
+    return module->groups ? module->groups : no_group_handlers;
+}
+
+/**
+ * Load the shared object at path, and add the handlers and groups it
+ * exports to those a profile can choose from.
+ */
+static apr_status_t load_profile_module(const char *path, apr_pool_t *pool)
+{
+#if APR_HAS_DSO
+    apr_dso_handle_t *dso;
+    apr_dso_handle_sym_t sym;
+    flood_module_t *module;
+    apr_status_t stat;
+    char buf[256];
+
+    if ((stat = apr_dso_load(&dso, path, pool)) != APR_SUCCESS) {
+        apr_file_printf(local_stderr, "Can't load module '%s': %s\n",
+                        path, apr_dso_error(dso, buf, sizeof(buf)));
+        return stat;
+    }
+    if ((stat = apr_dso_sym(&sym, dso, FLOOD_MODULE_SYMBOL)) != APR_SUCCESS) {
+        apr_file_printf(local_stderr, "Module '%s' has no %s: %s\n",
+                        path, FLOOD_MODULE_SYMBOL,
+                        apr_dso_error(dso, buf, sizeof(buf)));
+        return stat;
+    }
+
+    module = (flood_module_t *)sym;
+    if (module->magic != FLOOD_MODULE_MAGIC) {
+        apr_file_printf(local_stderr, "'%s' is not a flood module.\n", path);
+        return APR_EGENERAL;
+    }
+    if (module->abi != FLOOD_MODULE_ABI) {
+        apr_file_printf(local_stderr, "Module '%s' was built for version %d "
+                        "of the module ABI, not %d.\n",
+                        path, module->abi, FLOOD_MODULE_ABI);
+        return APR_EGENERAL;
+    }
+    if (module->init && (stat = module->init(pool)) != APR_SUCCESS) {
+        apr_file_printf(local_stderr, "Module '%s' (%s) failed to "
+                        "initialize.\n", path, module->name);
+        return stat;
+    }
+
+    if (!profile_modules)
+        profile_modules = apr_array_make(pool, 1, sizeof(flood_module_t *));
+    *(flood_module_t **)apr_array_push(profile_modules) = module;
+
+#ifdef PROFILE_DEBUG
+    apr_file_printf(local_stdout, "Loaded module '%s' from %s.\n",
+                    module->name, path);
+#endif /* PROFILE_DEBUG */
+
+    return APR_SUCCESS;
+#else
+    apr_file_printf(local_stderr, "Can't load module '%s': this platform "
+                    "has no shared objects.\n", path);
+    return APR_ENOTIMPL;
+#endif
+}
+
+apr_status_t load_profile_modules(config_t *config, apr_pool_t *pool)
+{
+    apr_status_t stat;
+    struct apr_xml_elem *root_elem, *e;
+
+    if ((stat = retrieve_root_xml_elem(&root_elem, config)) != APR_SUCCESS)
+        return stat;
+
+    for (e = root_elem->first_child; e; e = e->next) {
+        if (strncasecmp(e->name, XML_MODULE, FLOOD_STRLEN_MAX) != 0)
+            continue;
+        if (!e->first_cdata.first || !e->first_cdata.first->text) {
+            apr_file_printf(local_stderr, "<%s> names no module.\n",
+                            XML_MODULE);
+            return APR_EGENERAL;
+        }
+        if ((stat = load_profile_module(e->first_cdata.first->text,
+                                        pool)) != APR_SUCCESS)
+            return stat;
+    }
+
+    return APR_SUCCESS;
+}
+
 /**
  * Assign the appropriate implementation to the profile_events_t handler
  * for the given function name and overriden function name.
@@ -293,71 +431,83 @@ static apr_status_t assign_profile_event_handler(profile_events_t *events,
                                                  const char *impl_name)
 {
     profile_event_handler_t *p;
+    int t;
 
-    for (p = &profile_event_handlers[0]; p && (*p).handler_name; p++) {
-        /* these are case insensitive (both key and value) for the sake of simplicity */
-        if (strncasecmp(impl_name, (*p).impl_name, FLOOD_STRLEN_MAX) == 0) {
-            if (strncasecmp(handler_name, (*p).handler_name, FLOOD_STRLEN_MAX) == 0) {
-                /* we got a match, assign it */
-
-                /* stupid cascading if, no big deal since it only happens at startup */
-                if (strncasecmp(handler_name, "profile_init", FLOOD_STRLEN_MAX) == 0) {
-                    events->profile_init = (*p).handler;
-                } else if (strncasecmp(handler_name, "report_init", FLOOD_STRLEN_MAX) == 0){ 
-                    events->report_init = (*p).handler;
-                } else if (strncasecmp(handler_name, "socket_init", FLOOD_STRLEN_MAX) == 0){ 
-                    events->socket_init = (*p).handler;
-                } else if (strncasecmp(handler_name, "get_next_url", FLOOD_STRLEN_MAX) == 0){ 
-                    events->get_next_url = (*p).handler;
-                } else if (strncasecmp(handler_name, "begin_conn", FLOOD_STRLEN_MAX) == 0) {
-                    events->begin_conn = (*p).handler;
-                } else if (strncasecmp(handler_name, "create_req", FLOOD_STRLEN_MAX) == 0) {
-                    events->create_req = (*p).handler;
-                } else if (strncasecmp(handler_name, "send_req", FLOOD_STRLEN_MAX) == 0) {
-                    events->send_req = (*p).handler;
-                } else if (strncasecmp(handler_name, "recv_resp", FLOOD_STRLEN_MAX) == 0) {
-                    events->recv_resp = (*p).handler;
-                } else if (strncasecmp(handler_name, "postprocess", FLOOD_STRLEN_MAX) == 0) {
-                    events->postprocess = (*p).handler;
-                } else if (strncasecmp(handler_name, "verify_resp", FLOOD_STRLEN_MAX) == 0) {
-                    events->verify_resp = (*p).handler;
-                } else if (strncasecmp(handler_name, "process_stats", FLOOD_STRLEN_MAX) == 0) {
-                    events->process_stats = (*p).handler;
-                } else if (strncasecmp(handler_name, "loop_condition", FLOOD_STRLEN_MAX) == 0) {
-                    events->loop_condition = (*p).handler;
-                } else if (strncasecmp(handler_name, "end_conn", FLOOD_STRLEN_MAX) == 0) {
-                    events->end_conn = (*p).handler;
-                } else if (strncasecmp(handler_name, "request_destroy", FLOOD_STRLEN_MAX) == 0) {
-                    events->request_destroy = (*p).handler;
-                } else if (strncasecmp(handler_name, "response_destroy", FLOOD_STRLEN_MAX) == 0) {
-                    events->response_destroy = (*p).handler;
-                } else if (strncasecmp(handler_name, "socket_destroy", FLOOD_STRLEN_MAX) == 0) {
-                    events->socket_destroy = (*p).handler;
-                } else if (strncasecmp(handler_name, "report_stats", FLOOD_STRLEN_MAX) == 0) {
-                    events->report_stats = (*p).handler;
-                } else if (strncasecmp(handler_name, "destroy_report", FLOOD_STRLEN_MAX) == 0) {
-                    events->destroy_report = (*p).handler;
-                } else if (strncasecmp(handler_name, "profile_destroy", FLOOD_STRLEN_MAX) == 0) {
-                    events->profile_destroy = (*p).handler;
-                } else {
-                    /* some internal error, our static structs don't match up */
-                    return APR_EGENERAL;
-                }
-                return APR_SUCCESS;
-            } else {
-                /* invalid implementation for this handler */
-                apr_file_printf(local_stderr, "Invalid handler (%s) "
-                                "specified.\n",
-                                handler_name ? handler_name : "NULL");
-                return APR_ENOTIMPL; /* XXX: There's probably a better return val than this? */
-            }
+    /* these are case insensitive (both key and value) for the sake of simplicity */
+    for (t = 0; (p = event_handler_table(t)); t++) {
+        for (; p->handler_name; p++) {
+            if (strncasecmp(impl_name, p->impl_name, FLOOD_STRLEN_MAX) == 0)
+                break;
         }
+        if (p->handler_name)
+            break;
+    }
+
+    if (!p) {
+        apr_file_printf(local_stderr, "Invalid implementation (%s) for "
+                        "this handler (%s)\n",
+                        impl_name ? impl_name : "NULL",
+                        handler_name ? handler_name : "NULL");
+        return APR_ENOTIMPL; /* no implementation found */
     }
-    apr_file_printf(local_stderr, "Invalid implementation (%s) for "
-                    "this handler (%s)\n",
-                    impl_name ? impl_name : "NULL",
-                    handler_name ? handler_name : "NULL");
-    return APR_ENOTIMPL; /* no implementation found */
+    if (strncasecmp(handler_name, p->handler_name, FLOOD_STRLEN_MAX) != 0) {
+        /* invalid implementation for this handler */
+        apr_file_printf(local_stderr, "Invalid handler (%s) "
+                        "specified.\n",
+                        handler_name ? handler_name : "NULL");
+        return APR_ENOTIMPL; /* XXX: There's probably a better return val than this? */
+    }
+
+    /* we got a match, assign it */
+
+    /* stupid cascading if, no big deal since it only happens at startup */
+    if (strncasecmp(handler_name, "profile_init", FLOOD_STRLEN_MAX) == 0) {
+        events->profile_init = (*p).handler;
+    } else if (strncasecmp(handler_name, "report_init", FLOOD_STRLEN_MAX) == 0){ 
+        events->report_init = (*p).handler;
+    } else if (strncasecmp(handler_name, "socket_init", FLOOD_STRLEN_MAX) == 0){ 
+        events->socket_init = (*p).handler;
+    } else if (strncasecmp(handler_name, "get_next_url", FLOOD_STRLEN_MAX) == 0){ 
+        events->get_next_url = (*p).handler;
+    } else if (strncasecmp(handler_name, "begin_conn", FLOOD_STRLEN_MAX) == 0) {
+        events->begin_conn = (*p).handler;
+    } else if (strncasecmp(handler_name, "warmup_conn", FLOOD_STRLEN_MAX) == 0) {
+        events->warmup_conn = (*p).handler;
+    } else if (strncasecmp(handler_name, "create_req", FLOOD_STRLEN_MAX) == 0) {
+        events->create_req = (*p).handler;
+    } else if (strncasecmp(handler_name, "send_req", FLOOD_STRLEN_MAX) == 0) {
+        events->send_req = (*p).handler;
+    } else if (strncasecmp(handler_name, "recv_resp", FLOOD_STRLEN_MAX) == 0) {
+        events->recv_resp = (*p).handler;
+    } else if (strncasecmp(handler_name, "postprocess", FLOOD_STRLEN_MAX) == 0) {
+        events->postprocess = (*p).handler;
+    } else if (strncasecmp(handler_name, "verify_resp", FLOOD_STRLEN_MAX) == 0) {
+        events->verify_resp = (*p).handler;
+    } else if (strncasecmp(handler_name, "process_stats", FLOOD_STRLEN_MAX) == 0) {
+        events->process_stats = (*p).handler;
+    } else if (strncasecmp(handler_name, "loop_condition", FLOOD_STRLEN_MAX) == 0) {
+        events->loop_condition = (*p).handler;
+    } else if (strncasecmp(handler_name, "end_conn", FLOOD_STRLEN_MAX) == 0) {
+        events->end_conn = (*p).handler;
+    } else if (strncasecmp(handler_name, "request_destroy", FLOOD_STRLEN_MAX) == 0) {
+        events->request_destroy = (*p).handler;
+    } else if (strncasecmp(handler_name, "response_destroy", FLOOD_STRLEN_MAX) == 0) {
+        events->response_destroy = (*p).handler;
+    } else if (strncasecmp(handler_name, "socket_destroy", FLOOD_STRLEN_MAX) == 0) {
+        events->socket_destroy = (*p).handler;
+    } else if (strncasecmp(handler_name, "report_stats", FLOOD_STRLEN_MAX) == 0) {
+        events->report_stats = (*p).handler;
+    } else if (strncasecmp(handler_name, "destroy_report", FLOOD_STRLEN_MAX) == 0) {
+        events->destroy_report = (*p).handler;
+    } else if (strncasecmp(handler_name, "profile_destroy", FLOOD_STRLEN_MAX) == 0) {
+        events->profile_destroy = (*p).handler;
+    } else {
+        /* our static structs don't match up, or a module's is wrong */
+        apr_file_printf(local_stderr, "Implementation (%s) is for an "
+                        "unknown handler (%s)\n", impl_name, handler_name);
+        return APR_EGENERAL;
+    }
+    return APR_SUCCESS;
 }
 
 /**
@@ -372,16 +522,20 @@ static apr_status_t assign_profile_group_handler(profile_events_t *events,
     profile_event_handler_t *p;
     profile_group_handler_t *g;
     const char **handlers;
+    int t;
 
     /* Find our group. */
-    for (g = &profile_group_handlers[0]; g && g->class; g++) 
-    {
-        if (!strncasecmp(class_name, g->class, FLOOD_STRLEN_MAX) &&
-            !strncasecmp(group_name, g->group_name, FLOOD_STRLEN_MAX))
+    for (t = 0; (g = group_handler_table(t)); t++) {
+        for (; g->class; g++) {
+            if (!strncasecmp(class_name, g->class, FLOOD_STRLEN_MAX) &&
+                !strncasecmp(group_name, g->group_name, FLOOD_STRLEN_MAX))
+                break;
+        }
+        if (g->class)
             break;
     }
 
-    if (!g->class) {
+    if (!g) {
         apr_file_printf(local_stderr, "Invalid class '%s' or groupname '%s'.\n",
                         class_name, group_name);
         return APR_EGENERAL;
@@ -390,10 +544,12 @@ static apr_status_t assign_profile_group_handler(profile_events_t *events,
     /* For all of the handlers, set them. */
     for (handlers = g->handlers; *handlers; handlers++)
     {
-        for (p = profile_event_handlers; p && p->handler_name; p++) {
-            if (!strncasecmp(p->impl_name, *handlers, FLOOD_STRLEN_MAX))
-                assign_profile_event_handler(events, p->handler_name, 
-                                             p->impl_name);
+        for (t = 0; (p = event_handler_table(t)); t++) {
+            for (; p->handler_name; p++) {
+                if (!strncasecmp(p->impl_name, *handlers, FLOOD_STRLEN_MAX))
+                    assign_profile_event_handler(events, p->handler_name, 
+                                                 p->impl_name);
+            }
         }
     }
     return APR_SUCCESS;
@@ -435,6 +591,10 @@ static apr_status_t create_profile_events(profile_events_t **events, apr_pool_t
                                              "begin_conn",
                                              "generic_begin_conn")) != APR_SUCCESS)
         return stat;
+    if ((stat = assign_profile_event_handler(new_events,
+                                             "warmup_conn",
+                                             "generic_warmup_conn")) != APR_SUCCESS)
+        return stat;
     if ((stat = assign_profile_event_handler(new_events,
                                              "send_req",
                                              "generic_send_req")) != APR_SUCCESS)
@@ -576,6 +736,123 @@ static apr_status_t initialize_events(profile_events_t **events, const char * pr
     return APR_SUCCESS;
 }
 
+/* How far a transaction got before it failed. */
+#define STAGE_CONNECT 0
+#define STAGE_SEND 1
+#define STAGE_RECV 2
+
+static const char *stage_names[] = {
+    "open request",
+    "send request",
+    "receive request"
+};
+
+static const char *error_names[FLOOD_ERR_MAX] = {
+    "OK",
+    "FAIL",
+    "DNS",
+    "REFUSED",
+    "CONNECT_TIMEOUT",
+    "RESET",
+    "READ_TIMEOUT",
+    "TLS",
+    "PROTOCOL",
+    "ERROR",
+    "FIRST_BYTE_TIMEOUT",
+    "TOTAL_TIMEOUT",
+    "BODY"
+};
+
+/**
+ * Name the given verification result, for reports.
+ */
+const char *flood_error_name(int verified)
+{
+    if (verified < 0 || verified >= FLOOD_ERR_MAX)
+        return "UNKNOWN";
+    return error_names[verified];
+}
+
+/* Work out why a transaction failed at the given stage. */
+static int classify_error(request_t *req, apr_status_t rv, int stage)
+{
+    if (req->error)
+        return req->error;
+
+    if (APR_STATUS_IS_ECONNREFUSED(rv))
+        return FLOOD_ERR_REFUSED;
+    if (APR_STATUS_IS_ECONNRESET(rv) || APR_STATUS_IS_ECONNABORTED(rv) ||
+        APR_STATUS_IS_EPIPE(rv) || APR_STATUS_IS_EOF(rv))
+        return FLOOD_ERR_RESET;
+    if (rv == FLOOD_EFIRSTBYTE)
+        return FLOOD_ERR_FIRST_BYTE_TIMEOUT;
+    if (rv == FLOOD_ETOTALTIME)
+        return FLOOD_ERR_TOTAL_TIMEOUT;
+    if (APR_STATUS_IS_TIMEUP(rv) || APR_STATUS_IS_ETIMEDOUT(rv))
+        return stage == STAGE_CONNECT ? FLOOD_ERR_CONNECT_TIMEOUT
+                                      : FLOOD_ERR_READ_TIMEOUT;
+
+    /* The response didn't make sense. */
+    if (stage == STAGE_RECV)
+        return FLOOD_ERR_PROTOCOL;
+
+    return FLOOD_ERR_OTHER;
+}
+
+/* Find out how often, and how patiently, the profile retries a failed
+ * transaction.  By default it doesn't. */
+static apr_status_t retrieve_profile_retries(int *retries,
+                                             apr_interval_time_t *backoff,
+                                             config_t *config,
+                                             const char *profile_name,
+                                             apr_pool_t *pool)
+{
+    apr_status_t stat;
+    struct apr_xml_elem *root_elem, *profile_elem, *e;
+    char *endptr;
+
+    *retries = 0;
+    *backoff = FLOOD_RETRY_BACKOFF;
+
+    if ((stat = retrieve_root_xml_elem(&root_elem, config)) != APR_SUCCESS)
+        return stat;
+
+    if ((stat = retrieve_xml_elem_with_childmatch(
+             &profile_elem, root_elem,
+             XML_PROFILE, "name", profile_name)) != APR_SUCCESS)
+        return stat;
+
+    if (retrieve_xml_elem_child(&e, profile_elem,
+                                XML_PROFILE_RETRIES) == APR_SUCCESS &&
+        e->first_cdata.first && e->first_cdata.first->text) {
+        *retries = strtol(e->first_cdata.first->text, &endptr, 10);
+        if (*endptr != '\0' || *retries < 0) {
+            apr_file_printf(local_stderr,
+                            "Profile '%s' has invalid <%s> %s.\n",
+                            profile_name, XML_PROFILE_RETRIES,
+                            e->first_cdata.first->text);
+            return APR_EGENERAL;
+        }
+    }
+
+    /* in milliseconds, doubling with each retry */
+    if (retrieve_xml_elem_child(&e, profile_elem,
+                                XML_PROFILE_RETRY_BACKOFF) == APR_SUCCESS &&
+        e->first_cdata.first && e->first_cdata.first->text) {
+        *backoff = strtol(e->first_cdata.first->text, &endptr, 10);
+        if (*endptr != '\0' || *backoff < 0) {
+            apr_file_printf(local_stderr,
+                            "Profile '%s' has invalid <%s> %s.\n",
+                            profile_name, XML_PROFILE_RETRY_BACKOFF,
+                            e->first_cdata.first->text);
+            return APR_EGENERAL;
+        }
+        *backoff *= 1000;
+    }
+
+    return APR_SUCCESS;
+}
+
 /**
  * Essential guts of the main test loop -- a single run of a test profile:
  */
@@ -588,8 +865,11 @@ apr_status_t run_profile(apr_pool_t *pool, config_t *config, const char * profil
     response_t *resp;
     socket_t *socket;
     flood_timer_t *timer;
-    apr_status_t stat;
-    int verified;
+    flood_mem_t *mem;
+    apr_pool_t *iterpool;
+    apr_status_t stat, rv;
+    apr_interval_time_t backoff;
+    int verified, retries, attempt, created, stage;
 
     /* init to NULL for the sake of our error checking */
     events = NULL;
@@ -621,83 +901,155 @@ apr_status_t run_profile(apr_pool_t *pool, config_t *config, const char * profil
     if ((stat = events->socket_init(&socket, pool)) != APR_SUCCESS)
         return stat;
 
+    if ((stat = retrieve_profile_retries(&retries, &backoff, config,
+                                         profile_name, pool)) != APR_SUCCESS)
+        return stat;
+
     timer = apr_palloc(pool, sizeof(flood_timer_t));
+    mem = flood_mem_get(pool);
+
+    /* Everything to do with one pass goes here, and is thrown away at
+     * the end of it, so long runs don't grow without bound. */
+    if ((stat = apr_pool_create(&iterpool, pool)) != APR_SUCCESS)
+        return stat;
 
     do {
-        if ((stat = events->get_next_url(&req, profile)) != APR_SUCCESS)
+        if ((stat = events->get_next_url(&req, profile, iterpool)) != APR_SUCCESS)
             return stat;
 
-        /* sample timer "begin" */
-        timer->begin = apr_time_now();
+        created = 0;
+        for (attempt = 0; ; attempt++) {
+            req->error = 0;
+
+            /* sample timer "begin" */
+            timer->begin = apr_time_now();
+            req->deadline = req->timeouts.total ?
+                            timer->begin + req->timeouts.total : 0;
+
+            stage = STAGE_CONNECT;
+            if ((rv = events->begin_conn(socket, req, iterpool)) == APR_SUCCESS) {
+                /* connect()ion was just made, sample it */
+                timer->connect = apr_time_now();
+
+                /* FIXME: I don't like doing this after we've opened the socket.
+                 * But, I'm not sure how to do it otherwise.
+                 */
+                if (!created) {
+                    if ((stat = events->create_req(profile, req)) != APR_SUCCESS) {
+                        apr_file_printf(local_stderr, "create request failed (%s).\n", 
+                                        req->uri);
+                        return stat;
+                    }
+                    created = 1;
+                }
 
-        if ((stat = events->begin_conn(socket, req, pool)) != APR_SUCCESS) {
-            apr_file_printf(local_stderr, "open request failed (%s).\n", 
-                            req->uri);
-            return stat;
-        }
+                /* If we wanted to keep track of our request generation overhead,
+                 * we could take a timer sample here */
 
-        /* connect()ion was just made, sample it */
-        timer->connect = apr_time_now();
+                stage = STAGE_SEND;
+                rv = events->send_req(socket, req, iterpool);
+            }
 
-        /* FIXME: I don't like doing this after we've opened the socket.
-         * But, I'm not sure how to do it otherwise.
-         */
-        if ((stat = events->create_req(profile, req)) != APR_SUCCESS) {
-            apr_file_printf(local_stderr, "create request failed (%s).\n", 
-                            req->uri);
-            return stat;
-        }
+            if (rv == APR_SUCCESS) {
+                /* record the time at which we finished sending the entire request */
+                timer->write = apr_time_now();
 
-        /* If we wanted to keep track of our request generation overhead,
-         * we could take a timer sample here */
+                stage = STAGE_RECV;
+                rv = events->recv_resp(&resp, socket, iterpool);
+            }
 
-        if ((stat = events->send_req(socket, req, pool)) != APR_SUCCESS) {
-            apr_file_printf(local_stderr, "send request failed (%s).\n", 
-                            req->uri);
-            return stat;
-        }
+            if (rv == APR_SUCCESS)
+                break;
 
-        /* record the time at which we finished sending the entire request */
-        timer->write = apr_time_now();
+            /* Missing support is a configuration problem, not the
+             * server's. */
+            if (APR_STATUS_IS_ENOTIMPL(rv)) {
+                apr_file_printf(local_stderr, "%s failed (%s).\n",
+                                stage_names[stage], req->uri);
+                return rv;
+            }
 
-        if ((stat = events->recv_resp(&resp, socket, pool)) != APR_SUCCESS) {
-            apr_file_printf(local_stderr, "receive request failed (%s).\n", 
-                            req->uri);
-            return stat;
-        }
+            /* The server let us down.  Record a failed transaction and
+             * carry on; this is when the numbers matter most. */
+            verified = classify_error(req, rv, stage);
+            apr_file_printf(local_stderr, "%s failed (%s): %s.\n",
+                            stage_names[stage], req->uri,
+                            flood_error_name(verified));
+
+            timer->close = apr_time_now();
+            if (stage < STAGE_SEND)
+                timer->connect = timer->close;
+            if (stage < STAGE_RECV)
+                timer->write = timer->close;
+            timer->read = timer->close;
+
+            /* Whatever the connection was doing, it's done now. */
+            resp = apr_pcalloc(iterpool, sizeof(response_t));
+            resp->keepalive = 0;
+            if (stage > STAGE_CONNECT &&
+                (stat = events->end_conn(socket, req, resp)) != APR_SUCCESS) {
+                apr_file_printf(local_stderr, 
+                                "Unable to end the connection (%s).\n", req->uri);
+                return stat;
+            }
 
-        /* record the time at which we received the first chunk of response data */
-        timer->read = apr_time_now();
+            if ((stat = events->process_stats(report, verified, req, resp, timer)) != APR_SUCCESS) {
+                apr_file_printf(local_stderr, 
+                                "Unable to process statistics (%s).\n", req->uri);
+                return stat;
+            }
 
-        if ((stat = events->postprocess(profile, req, resp)) != APR_SUCCESS) {
-            apr_file_printf(local_stderr, "postprocessing failed (%s).\n", 
-                            req->uri);
-            return stat;
-        }
+            if (attempt >= retries)
+                break;
 
-        if ((stat = events->verify_resp(&verified, profile, req, resp)) != APR_SUCCESS) {
-            apr_file_printf(local_stderr, 
-                            "Error while verifying query (%s).\n", req->uri);
-            return stat;
+            apr_sleep(backoff << (attempt < 10 ? attempt : 10));
         }
 
-        if ((stat = events->end_conn(socket, req, resp)) != APR_SUCCESS) {
-            apr_file_printf(local_stderr, 
-                            "Unable to end the connection (%s).\n", req->uri);
-            return stat;
-        }
+        if (rv == APR_SUCCESS) {
+            /* record the time at which we received the first chunk of response data */
+            timer->read = resp->firstbyte ? resp->firstbyte : apr_time_now();
 
-        /* record the time at which we had finished reading the entire response.
-         * Note: this sample includes overhead from postprocessing and verification
-         * and is not a good representation of raw server response speed. */
-        timer->close = apr_time_now();
+            /* Once, for everything that looks at it from here on. */
+            flood_parse_status(resp);
+            flood_index_headers(resp, iterpool);
 
-        if ((stat = events->process_stats(report, verified, req, resp, timer)) != APR_SUCCESS) {
-            apr_file_printf(local_stderr, 
-                            "Unable to process statistics (%s).\n", req->uri);
-            return stat;
-        }
+            /* A farmer over its memory limit stops here, rather than
+             * take the machine (and every other farmer) down with it. */
+            flood_mem_set(mem, FLOOD_MEM_REQUEST, req->rbufsize);
+            flood_mem_set(mem, FLOOD_MEM_BODY,
+                          resp->rbufsize + resp->seglen);
+            if ((stat = flood_mem_check(mem)) != APR_SUCCESS)
+                return stat;
+
+            if ((stat = events->postprocess(profile, req, resp)) != APR_SUCCESS) {
+                apr_file_printf(local_stderr, "postprocessing failed (%s).\n", 
+                                req->uri);
+                return stat;
+            }
+
+            if ((stat = events->verify_resp(&verified, profile, req, resp)) != APR_SUCCESS) {
+                apr_file_printf(local_stderr, 
+                                "Error while verifying query (%s).\n", req->uri);
+                return stat;
+            }
+
+            if ((stat = events->end_conn(socket, req, resp)) != APR_SUCCESS) {
+                apr_file_printf(local_stderr, 
+                                "Unable to end the connection (%s).\n", req->uri);
+                return stat;
+            }
 
+            /* record the time at which we had finished reading the entire response.
+             * Note: this sample includes overhead from postprocessing and verification
+             * and is not a good representation of raw server response speed. */
+            timer->close = apr_time_now();
+
+            if ((stat = events->process_stats(report, verified, req, resp, timer)) != APR_SUCCESS) {
+                apr_file_printf(local_stderr, 
+                                "Unable to process statistics (%s).\n", req->uri);
+                return stat;
+            }
+        }
 
         if ((stat = events->request_destroy(req)) != APR_SUCCESS) {
             apr_file_printf(local_stderr, "Error cleaning up request.\n");
@@ -714,6 +1066,10 @@ apr_status_t run_profile(apr_pool_t *pool, config_t *config, const char * profil
             return stat;
         }
 
+        apr_pool_clear(iterpool);
+        flood_mem_set(mem, FLOOD_MEM_REQUEST, 0);
+        flood_mem_set(mem, FLOOD_MEM_BODY, 0);
+
     } while (events->loop_condition(profile));
 
     if ((stat = events->report_stats(report)) != APR_SUCCESS) {
@@ -733,3 +1089,80 @@ apr_status_t run_profile(apr_pool_t *pool, config_t *config, const char * profil
 
     return APR_SUCCESS;
 }
+
+/**
+ * Open count connections for the given profile before anything is timed,
+ * so that the first requests of the run don't pay for DNS, TCP and TLS
+ * setup.  What the setup cost is reported here, apart from the request
+ * latencies.
+ */
+apr_status_t warmup_profile(apr_pool_t *pool, config_t *config, const char *profile_name, int count)
+{
+    profile_events_t *events;
+    profile_t *profile;
+    request_t *req;
+    socket_t *socket;
+    apr_pool_t *warmup_pool;
+    apr_time_t begin, spent;
+    apr_status_t stat;
+    int i, opened;
+
+    events = NULL;
+
+    if ((stat = apr_pool_create(&warmup_pool, pool)) != APR_SUCCESS)
+        return stat;
+
+    if ((stat = initialize_events(&events, profile_name, config, warmup_pool)) != APR_SUCCESS)
+        return stat;
+
+    if (events == NULL) {
+        apr_file_printf(local_stderr, "Error initializing test profile.\n");
+        return APR_EGENERAL;
+    }
+
+    if ((stat = events->profile_init(&profile, config, profile_name, warmup_pool)) != APR_SUCCESS)
+        return stat;
+
+    if ((stat = events->socket_init(&socket, warmup_pool)) != APR_SUCCESS)
+        return stat;
+
+    /* Warm up connections to the server of the first URL. */
+    if ((stat = events->get_next_url(&req, profile, warmup_pool)) != APR_SUCCESS)
+        return stat;
+
+    spent = 0;
+    opened = 0;
+    for (i = 0; i < count; i++) {
+        begin = apr_time_now();
+        stat = events->warmup_conn(socket, req, warmup_pool);
+        if (stat == APR_ENOTIMPL) {
+            apr_file_printf(local_stderr,
+                            "Profile '%s' uses a socket group that can't "
+                            "warm up connections.\n", profile_name);
+            break;
+        }
+        if (stat != APR_SUCCESS) {
+            apr_file_printf(local_stderr, "warm-up connection failed (%s).\n",
+                            req->uri);
+            continue;
+        }
+        spent += apr_time_now() - begin;
+        opened++;
+    }
+
+    if (opened) {
+        apr_file_printf(local_stdout,
+                        "Warm-up '%s': %d of %d connections, "
+                        "avg setup %" APR_TIME_T_FMT " usec\n",
+                        profile_name, opened, count, spent / opened);
+    }
+
+    if (events->profile_destroy(profile) != APR_SUCCESS) {
+        apr_file_printf(local_stderr, "Error cleaning up profile '%s'.\n", profile_name);
+        return APR_EGENERAL;
+    }
+
+    apr_pool_destroy(warmup_pool);
+
+    return APR_SUCCESS;
+}
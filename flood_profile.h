@@ -22,6 +22,7 @@
 #include <apr_network_io.h> /* Required for apr_socket_t */
 #include <apr_tables.h>     /* Required for apr_table_t */
 #include <apr_pools.h>
+#include <apr_time.h>
 #include <apr_uri.h>
 
 #include "flood_config.h" /* Required for config_t */
@@ -31,6 +32,40 @@
  */
 #define FLOOD_VALID 0
 #define FLOOD_INVALID 1
+/* Transactions that failed before there was a response to verify are
+ * reported with one of these in place of FLOOD_INVALID, as are responses
+ * whose body was not the one expected (FLOOD_ERR_BODY). */
+#define FLOOD_ERR_DNS 2
+#define FLOOD_ERR_REFUSED 3
+#define FLOOD_ERR_CONNECT_TIMEOUT 4
+#define FLOOD_ERR_RESET 5
+#define FLOOD_ERR_READ_TIMEOUT 6
+#define FLOOD_ERR_TLS 7
+#define FLOOD_ERR_PROTOCOL 8
+#define FLOOD_ERR_OTHER 9
+#define FLOOD_ERR_FIRST_BYTE_TIMEOUT 10
+#define FLOOD_ERR_TOTAL_TIMEOUT 11
+#define FLOOD_ERR_BODY 12
+#define FLOOD_ERR_MAX 13
+
+/* What became of a request that was sent as TLS 1.3 early data. */
+#define FLOOD_EARLY_DATA_NONE 0
+#define FLOOD_EARLY_DATA_ACCEPTED 1
+#define FLOOD_EARLY_DATA_REJECTED 2
+
+/* Whether a request that asked for TCP Fast Open went out in the SYN. */
+#define FLOOD_FASTOPEN_NONE 0
+#define FLOOD_FASTOPEN_USED 1
+#define FLOOD_FASTOPEN_MISSED 2
+
+/* How long each phase of a request may take.  Zero leaves the phase to
+ * the default, LOCAL_SOCKET_TIMEOUT for each wait. */
+typedef struct {
+    apr_interval_time_t connect;   /* each wait while connecting */
+    apr_interval_time_t firstbyte; /* from sending to the first byte back */
+    apr_interval_time_t idle;      /* each wait for more of the response */
+    apr_interval_time_t total;     /* from connecting to the last byte */
+} flood_timeouts_t;
 
 /* The type of buffers that are allowable internally in the flood
  * architecture.  Normally, test clients will not be concerned with
@@ -58,6 +93,11 @@ typedef enum method_e method_e;
  */ 
 typedef void socket_t;
 
+/* Shown the response to a request a piece at a time, as it is read.
+ * A NULL data means a new response is starting, and anything seen so
+ * far should be forgotten. */
+typedef void (*response_sink_t)(void *ctx, const char *data, apr_size_t len);
+
 /* Define a single request that can be transmitted with the flood
  * architecture. */
 struct request_t {
@@ -76,6 +116,43 @@ struct request_t {
     
     apr_uri_t *parsed_uri;
     apr_uri_t *parsed_proxy_uri;
+    /* If this is set, connect to this Unix domain socket instead of
+     * the host in the URL, which still supplies the Host header. */
+    const char *unixsocket;
+
+    /* If this is set, ask OpenSSL to hand the connection to kernel TLS. */
+    int ktls;
+
+    /* If this is set, plain (non-SSL) connections do their sends and
+     * receives through io_uring when the kernel allows it. */
+    int iouring;
+
+    /* If this is set, plain connections use TCP Fast Open, so the
+     * request rides in the SYN once the server has given us a cookie. */
+    int fastopen;
+    /* One of FLOOD_FASTOPEN_*, filled in by the generic socket group. */
+    int fastopenstatus;
+
+    /* Limits on how long the request may take, and when the current
+     * attempt at it must be over (0 if it needn't). */
+    flood_timeouts_t timeouts;
+    apr_time_t deadline;
+
+    /* One of FLOOD_ERR_*, set by the network layer when it knows better
+     * than the apr_status_t it returns why the connection failed. */
+    int error;
+
+    /* If this is set, resume TLS sessions and send GET/HEAD requests
+     * as 0-RTT early data when we hold a ticket for the server. */
+    int earlydata;
+    /* One of FLOOD_EARLY_DATA_*, filled in by the SSL layer. */
+    int earlydatastatus;
+
+    /* Protocols to offer with ALPN, in wire format, or NULL. */
+    const char *alpn;
+    /* The most streams the h2 and h3 socket groups may open on one
+     * connection. */
+    int maxstreams;
 
     /* Raw buffer connection 
      * FIXME: apr_bucket_t? */ 
@@ -86,6 +163,11 @@ struct request_t {
     /* If this is set, we want to keep the *entire* response. */
     int wantresponse;
 
+    /* If this is set, the socket group shows it the response as it is
+     * read, so that it needn't be kept to be looked at. */
+    response_sink_t sink;
+    void *sinkctx;
+
     /* Mandatory for keepalives - although we aren't handling keepalives
      * just yet... */
     socket_t *rsock;
@@ -94,6 +176,29 @@ struct request_t {
 };
 typedef struct request_t request_t;
 
+/* A header line of a response, as offsets into its rbuf. */
+typedef struct {
+    apr_size_t name;
+    apr_size_t namelen;
+    apr_size_t value;
+    apr_size_t valuelen;
+    int known;              /* one of FLOOD_HEADER_*, or -1 */
+} flood_header_t;
+
+/* A piece of a response kept whole, read into directly and never moved. */
+typedef struct flood_seg_t {
+    struct flood_seg_t *next;
+    apr_size_t len;
+    char *data;             /* FLOOD_SEG_SIZE bytes */
+} flood_seg_t;
+
+/* The headers flood looks at itself, picked out as they are indexed. */
+#define FLOOD_HEADER_CONNECTION 0
+#define FLOOD_HEADER_TRANSFER_ENCODING 1
+#define FLOOD_HEADER_CONTENT_LENGTH 2
+#define FLOOD_HEADER_SET_COOKIE 3
+#define FLOOD_HEADER_KNOWN 4
+
 /* Define a single response that may be returned with the flood
  * architecture. */
 struct response_t {
@@ -106,10 +211,39 @@ struct response_t {
     /* Raw buffer connection 
      * FIXME: apr_bucket_t? */ 
     buffer_type_e rbuftype;
+    /* rbufsize bytes, with room after them for a terminating NUL */
     char *rbuf;
     apr_size_t rbufsize;
 
-    apr_table_t *headers;
+    /* The rest of a response that is kept whole, when it didn't come in
+     * the first read: seglen bytes in a chain of segments.  Whatever
+     * needs all of it in one piece calls flood_response_flatten(). */
+    flood_seg_t *seg;
+    flood_seg_t *lastseg;
+    apr_size_t seglen;
+
+    /* The header lines, once flood_index_headers() has been called.
+     * known[] is the first of each FLOOD_HEADER_* in header[], or -1.
+     * headerlen is where in rbuf the body starts, or 0 if rbuf doesn't
+     * hold all of the headers. */
+    int indexed;            /* a boolean */
+    flood_header_t *header;
+    int nheaders;
+    int known[FLOOD_HEADER_KNOWN];
+    apr_size_t headerlen;
+
+    /* The status line, parsed once the response is in: the version as
+     * 10 * major + minor (11 for HTTP/1.1), the code, and where in rbuf
+     * the reason phrase is.  status is 0 if there was no status line. */
+    int version;
+    int status;
+    const char *reason;
+    apr_size_t reasonlen;
+
+    /* When the first byte of the response arrived.  Socket groups that
+     * read the whole response before returning fill this in; 0 means the
+     * time recv_resp returned is good enough. */
+    apr_time_t firstbyte;
 };
 typedef struct response_t response_t;
 
@@ -151,10 +285,13 @@ struct profile_events_t {
     /**
      * Reads the profile state (profile_t), retrieves the next request
      * (really the next URL) in this test profile, and prepares a
-     * request.
+     * request.  The request is allocated from pool, which is cleared
+     * once the request is done with; anything that must outlast it
+     * (cookies, extracted values) belongs in the profile's own pool.
      * Returns: A prepared HTTP Request object, ready to send.
      */
-    apr_status_t (*get_next_url)(request_t **request, profile_t *profile);
+    apr_status_t (*get_next_url)(request_t **request, profile_t *profile,
+                                 apr_pool_t *pool);
 
     /**
      * Construct the request to be sent to the server.
@@ -232,10 +369,20 @@ struct profile_events_t {
     apr_status_t (*socket_init)(socket_t **sock, apr_pool_t *pool);
 
     /**
-     * Opens the communication channel to the server.
+     * Opens the communication channel to the server.  This and the
+     * send_req and recv_resp events get the pool of the current pass,
+     * which is cleared afterwards; connections kept open from one pass
+     * to the next must be allocated from the pool given to socket_init.
      */
     apr_status_t (*begin_conn)(socket_t *sock, request_t *req, apr_pool_t *pool);
 
+    /**
+     * Opens a connection to the server before the timed run starts, and
+     * keeps it for a later begin_conn. Socket groups that have nothing
+     * worth keeping return APR_ENOTIMPL.
+     */
+    apr_status_t (*warmup_conn)(socket_t *sock, request_t *req, apr_pool_t *pool);
+
     /**
      * Actually sends the request to the server. Implementation will fit
      * an HTTP function or some OS performance capability.
@@ -294,6 +441,21 @@ struct profile_events_t {
 };
 typedef struct profile_events_t profile_events_t;
 
+apr_status_t load_profile_modules(config_t *config, apr_pool_t *pool);
 apr_status_t run_profile(apr_pool_t *pool, config_t *config, const char *profile_name);
+const char *flood_error_name(int verified);
+void flood_parse_status(response_t *resp);
+apr_status_t flood_parse_status_list(unsigned char **mask,
+                                     const char *value, apr_pool_t *pool);
+int flood_status_listed(const unsigned char *mask, int status);
+void flood_index_headers(response_t *resp, apr_pool_t *pool);
+const char *flood_header_get(response_t *resp, const char *name,
+                             apr_size_t *len);
+const char *flood_header_known(response_t *resp, int which, apr_size_t *len);
+char *flood_response_room(response_t *resp, apr_size_t *room,
+                          apr_pool_t *pool);
+void flood_response_grow(response_t *resp, apr_size_t len);
+void flood_response_flatten(response_t *resp, apr_pool_t *pool);
+apr_status_t warmup_profile(apr_pool_t *pool, config_t *config, const char *profile_name, int count);
 
 #endif  /* __profile_h */
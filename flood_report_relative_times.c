@@ -68,7 +68,8 @@ apr_status_t relative_times_process_stats(report_t *report, int verified, reques
         apr_snprintf(buf+buflen, FLOOD_PRINT_BUF-buflen, " FAIL ");
         break;
     default:
-        apr_snprintf(buf+buflen, FLOOD_PRINT_BUF-buflen, " %d ", verified);
+        apr_snprintf(buf+buflen, FLOOD_PRINT_BUF-buflen, " %s ",
+                     flood_error_name(verified));
     }
 
 #if APR_HAS_THREADS
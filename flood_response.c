@@ -0,0 +1,319 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_pools.h>
+#include <apr_lib.h>
+#include <apr_file_io.h>
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>     /* strtol */
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>    /* memchr, memcpy, strncasecmp */
+#endif
+
+#include "config.h"
+#include "flood_profile.h"
+
+/* Keeping a response, and picking it apart, without copying it: the
+ * segments it is read into past its first read, its status line, and the
+ * index of its headers kept by flood_index_headers(). */
+
+extern apr_file_t *local_stderr;
+
+/**
+ * Fill in resp's version, status and reason from its status line, unless
+ * the socket group already has.
+ */
+void flood_parse_status(response_t *resp)
+{
+    const char *p = resp->rbuf, *end, *eol;
+    int i, version, status = 0;
+
+    if (resp->status || !p)
+        return;
+    end = p + resp->rbufsize;
+
+    /* "HTTP/1.1 200 OK", or "HTTP/2 200" */
+    if (end - p < 10 || memcmp(p, "HTTP/", 5) != 0 || !apr_isdigit(p[5]))
+        return;
+    version = (p[5] - '0') * 10;
+    p += 6;
+    if (*p == '.') {
+        if (!apr_isdigit(p[1]))
+            return;
+        version += p[1] - '0';
+        p += 2;
+    }
+    if (end - p < 4 || *p++ != ' ')
+        return;
+    for (i = 0; i < 3; i++) {
+        if (!apr_isdigit(p[i]))
+            return;
+        status = status * 10 + p[i] - '0';
+    }
+    resp->version = version;
+    resp->status = status;
+    p += 3;
+
+    if (p < end && *p == ' ')
+        p++;
+    if (!(eol = memchr(p, '\n', end - p)))
+        eol = end;
+    if (eol > p && eol[-1] == '\r')
+        eol--;
+    resp->reason = p;
+    resp->reasonlen = eol - p;
+}
+
+/* Status codes are three digits. */
+#define STATUS_LIST_MAX 1000
+
+/**
+ * Parse a list of status codes, ranges of them and classes, such as
+ * "200-299,304" or "2xx 304", into a bit for each code.
+ */
+apr_status_t flood_parse_status_list(unsigned char **mask,
+                                     const char *value, apr_pool_t *pool)
+{
+    const char *p = value;
+    char *endptr;
+    long lo, hi;
+
+    *mask = apr_pcalloc(pool, STATUS_LIST_MAX / 8);
+    for (;;) {
+        while (*p == ',' || apr_isspace(*p))
+            p++;
+        if (!*p)
+            break;
+
+        lo = hi = strtol(p, &endptr, 10);
+        if (endptr == p + 1 && endptr[0] == 'x' && endptr[1] == 'x') {
+            lo *= 100;
+            hi = lo + 99;
+            endptr += 2;
+        }
+        else if (endptr != p && *endptr == '-') {
+            p = endptr + 1;
+            hi = strtol(p, &endptr, 10);
+        }
+        if (endptr == p || lo < 100 || hi < lo || hi >= STATUS_LIST_MAX ||
+            (*endptr && *endptr != ',' && !apr_isspace(*endptr))) {
+            apr_file_printf(local_stderr,
+                            "Attribute %s has invalid value %s.\n",
+                            XML_URLLIST_EXPECT_STATUS, value);
+            return APR_EGENERAL;
+        }
+        for (; lo <= hi; lo++)
+            (*mask)[lo >> 3] |= 1 << (lo & 7);
+        p = endptr;
+    }
+
+    return APR_SUCCESS;
+}
+
+/**
+ * Is status one of those in the list flood_parse_status_list() made?
+ */
+int flood_status_listed(const unsigned char *mask, int status)
+{
+    return status >= 100 && status < STATUS_LIST_MAX &&
+           (mask[status >> 3] & (1 << (status & 7)));
+}
+
+
+static const char *known_headers[FLOOD_HEADER_KNOWN] = {
+    "Connection",
+    "Transfer-Encoding",
+    "Content-Length",
+    "Set-Cookie"
+};
+
+/* Is this the blank line that ends the headers? */
+#define HEADERS_END(line, eol) \
+    ((eol) == (line) || ((eol) == (line) + 1 && *(line) == '\r'))
+
+/**
+ * Index resp's header lines, unless that has been done.  Nothing is
+ * copied: each header is kept as where its name and value are in rbuf.
+ */
+void flood_index_headers(response_t *resp, apr_pool_t *pool)
+{
+    const char *start, *end, *line, *eol, *colon, *value, *vend;
+    flood_header_t *h;
+    int n, k;
+
+    if (resp->indexed)
+        return;
+    resp->indexed = 1;
+    resp->nheaders = 0;
+    resp->headerlen = 0;
+    for (k = 0; k < FLOOD_HEADER_KNOWN; k++)
+        resp->known[k] = -1;
+    if (!resp->rbuf)
+        return;
+    start = resp->rbuf;
+    end = start + resp->rbufsize;
+
+    /* Count them first, so that the index takes one allocation. */
+    n = 0;
+    for (line = memchr(start, '\n', end - start); line && ++line < end;
+         line = eol) {
+        if (!(eol = memchr(line, '\n', end - line)) || HEADERS_END(line, eol))
+            break;
+        n++;
+    }
+    resp->header = apr_palloc(pool, (n ? n : 1) * sizeof(flood_header_t));
+
+    /* The status line is not a header, so start on the line after. */
+    for (line = memchr(start, '\n', end - start); line && ++line < end;
+         line = eol) {
+        if (!(eol = memchr(line, '\n', end - line)))
+            break;
+        if (HEADERS_END(line, eol)) {
+            resp->headerlen = eol + 1 - start;
+            break;
+        }
+        if (!(colon = memchr(line, ':', eol - line)))
+            continue;
+
+        value = colon + 1;
+        vend = eol;
+        while (value < vend && apr_isspace(*value))
+            value++;
+        while (vend > value && apr_isspace(vend[-1]))
+            vend--;
+
+        h = &resp->header[resp->nheaders];
+        h->name = line - start;
+        h->namelen = colon - line;
+        h->value = value - start;
+        h->valuelen = vend - value;
+        h->known = -1;
+        for (k = 0; k < FLOOD_HEADER_KNOWN; k++) {
+            if (strlen(known_headers[k]) == h->namelen &&
+                strncasecmp(line, known_headers[k], h->namelen) == 0) {
+                h->known = k;
+                if (resp->known[k] < 0)
+                    resp->known[k] = resp->nheaders;
+                break;
+            }
+        }
+        resp->nheaders++;
+    }
+}
+
+/**
+ * The value of the first header of resp by this name, or NULL.  It is
+ * len bytes long, and isn't NUL-terminated.
+ */
+const char *flood_header_get(response_t *resp, const char *name,
+                             apr_size_t *len)
+{
+    apr_size_t namelen = strlen(name);
+    int i;
+
+    for (i = 0; resp->indexed && i < resp->nheaders; i++) {
+        flood_header_t *h = &resp->header[i];
+
+        if (h->namelen == namelen &&
+            strncasecmp(resp->rbuf + h->name, name, namelen) == 0) {
+            *len = h->valuelen;
+            return resp->rbuf + h->value;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Like flood_header_get(), for one of FLOOD_HEADER_*, without a search.
+ */
+const char *flood_header_known(response_t *resp, int which, apr_size_t *len)
+{
+    flood_header_t *h;
+
+    if (!resp->indexed || resp->known[which] < 0)
+        return NULL;
+    h = &resp->header[resp->known[which]];
+    *len = h->valuelen;
+    return resp->rbuf + h->value;
+}
+
+/**
+ * Where the next bytes of resp should be read to, and how many will fit
+ * there (*room): what is left of the last segment, or else a new one.
+ */
+char *flood_response_room(response_t *resp, apr_size_t *room,
+                          apr_pool_t *pool)
+{
+    flood_seg_t *seg = resp->lastseg;
+
+    if (!seg || seg->len == FLOOD_SEG_SIZE) {
+        seg = apr_palloc(pool, sizeof(flood_seg_t) + FLOOD_SEG_SIZE);
+        seg->next = NULL;
+        seg->len = 0;
+        seg->data = (char *)(seg + 1);
+        if (resp->lastseg)
+            resp->lastseg->next = seg;
+        else
+            resp->seg = seg;
+        resp->lastseg = seg;
+    }
+
+    *room = FLOOD_SEG_SIZE - seg->len;
+    return seg->data + seg->len;
+}
+
+/**
+ * Count the len bytes read to where flood_response_room() said.
+ */
+void flood_response_grow(response_t *resp, apr_size_t len)
+{
+    resp->lastseg->len += len;
+    resp->seglen += len;
+}
+
+/**
+ * Gather all of resp into rbuf, NUL-terminated.  If it is in segments,
+ * this is the one time the response is copied.
+ */
+void flood_response_flatten(response_t *resp, apr_pool_t *pool)
+{
+    flood_seg_t *seg;
+    char *cp;
+
+    if (!resp->seg) {
+        resp->rbuf[resp->rbufsize] = '\0';
+        return;
+    }
+
+    cp = apr_palloc(pool, resp->rbufsize + resp->seglen + 1);
+    memcpy(cp, resp->rbuf, resp->rbufsize);
+    resp->rbuf = cp;
+    cp += resp->rbufsize;
+    for (seg = resp->seg; seg; seg = seg->next) {
+        memcpy(cp, seg->data, seg->len);
+        cp += seg->len;
+    }
+    *cp = '\0';
+
+    resp->rbufsize += resp->seglen;
+    resp->seg = resp->lastseg = NULL;
+    resp->seglen = 0;
+}
@@ -23,6 +23,7 @@
 #include <apr_lib.h>
 #include <apr_hash.h>
 #include <apr_base64.h>
+#include <apr_date.h>
 #include <apr_poll.h>
 #include <apr_thread_proc.h>
 #include <apr_errno.h>
@@ -46,15 +47,24 @@
 #include <limits.h>
 #endif
 #include <assert.h>
-#ifdef FLOOD_USE_PCRE
+
+#include "config.h"
+#if FLOOD_USE_PCRE
 #include "flood_pcre.h"
 #else
 #include "regex.h"
 #endif
 
-#include "config.h"
+#include "flood_body.h"
+#include "flood_coproc.h"
+#include "flood_crc32c.h"
+#include "flood_farmer.h"
+#include "flood_json.h"
+#include "flood_match.h"
+#include "flood_mem.h"
 #include "flood_net.h"
 #include "flood_round_robin.h"
+#include "flood_state.h"
 #include "flood_subst_file.h"
 #include "flood_profile.h"
 
@@ -88,21 +98,57 @@ typedef struct {
     char *requesttemplate;
     char *responsetemplate;
     char *responsescript;
-    char *responsename;
-    int responselen;
+    /* variables set from capture groups 1, 2, ... of responsetemplate,
+     * or from the values the responsejson paths lead to */
+    apr_array_header_t *responsenames;
+    /* responsetemplate compiled, when it has no variables to expand */
+    regex_t *responsere;
+    /* paths into a JSON response body, compiled */
+    char *responsejson;
+    flood_json_paths_t *jsonpaths;
+    /* like responsescript, but started once and kept running */
+    char *responsecoprocess;
+    apr_interval_time_t coprocesstimeout;
+    /* what verify_expect wants of the response: a bit for each status
+     * code it takes (NULL for any 2xx or 3xx), the names of headers that
+     * must be there, and the length (-1 for any) and CRC32C of the body */
+    unsigned char *expectstatus;
+    apr_array_header_t *expectheaders;
+    apr_int64_t expectlength;
+    int expectdigest; /* a boolean */
+    apr_uint32_t expectcrc;
+    /* strings the body must have, and ones it must not, compiled */
+    char *expectbody;
+    char *rejectbody;
+    flood_match_patterns_t *bodypatterns;
     char *user;
     char *password;
+    flood_timeouts_t timeouts;
 } url_t;
 
 typedef struct cookie_t {
     char *name;
     char *value;
+    char *domain;
     char *path;
-    char *expires;
-    char *raw;
-    struct cookie_t *next;
+    apr_time_t expires; /* 0 for a session cookie */
+    int secure; /* a boolean */
+    apr_size_t size; /* what it took out of the jar's pool */
 } cookie_t;
 
+/* Cookies are kept by name, domain and path, so a new value replaces the
+ * old one.  The Cookie header sent to each host and path is built once
+ * and kept until the jar changes, one of its cookies expires or there
+ * are FLOOD_COOKIE_HEADERS_MAX of them. */
+typedef struct {
+    apr_pool_t *pool;
+    apr_hash_t *cookies; /* "name;domain;path" -> cookie_t */
+    apr_hash_t *headers; /* "host path" -> "Cookie: ...\r\n" */
+    apr_time_t nextexpiry; /* when the headers go stale, or 0 */
+    apr_size_t live; /* bytes of pool the cookies and headers take */
+    apr_size_t garbage; /* bytes of pool nothing points to any more */
+} cookie_jar_t;
+
 typedef struct {
     apr_pool_t *pool;
 
@@ -112,10 +158,27 @@ typedef struct {
     url_t *url;
     char *baseurl;
     apr_uri_t *proxy_url;
-
-    cookie_t *cookie;
-
-    apr_hash_t *state;
+    char *unixsocket;
+    int ktls; /* a boolean */
+    int iouring; /* a boolean */
+    int fastopen; /* a boolean */
+    int earlydata; /* a boolean */
+    int maxstreams;
+    flood_timeouts_t timeouts;
+
+    cookie_jar_t jar;
+
+    flood_state_t *state;
+
+    /* the ${...} pattern, compiled once */
+    regex_t paramre;
+    /* responsetemplates compiled after expansion, by expanded pattern */
+    apr_pool_t *regexpool;
+    apr_hash_t *regexes;
+    /* responsecoprocesses, by command line, started as they are needed
+     * and kept, from coprocpool, for as long as the farmer runs */
+    apr_pool_t *coprocpool;
+    apr_hash_t *coprocs;
 
     int subst_count;
     subst_rec_t* subst_list;
@@ -123,39 +186,357 @@ typedef struct {
     int current_round;
     int current_url;
 
+    /* what the state above has cost, charged to mem with the jar's */
+    flood_mem_t *mem;
+
 } round_robin_profile_t;
 
-static char *handle_param_string(round_robin_profile_t *rp, char *template, 
+/* Set a variable, and charge what the state now takes to the farmer. */
+static void state_set(round_robin_profile_t *rp, const char *name,
+                      apr_ssize_t namelen, const char *value, apr_size_t len)
+{
+    flood_state_set(rp->state, name, namelen, value, len);
+    flood_mem_set(rp->mem, FLOOD_MEM_STATE, flood_state_bytes(rp->state));
+}
+
+static apr_status_t regex_cleanup(void *data)
+{
+    regfree((regex_t *)data);
+    return APR_SUCCESS;
+}
+
+/* Compile pattern into a regex that lasts as long as pool. */
+static apr_status_t regex_compile(regex_t **re, const char *pattern,
+                                  apr_pool_t *pool)
+{
+    char buf[256];
+    int status;
+
+    *re = apr_palloc(pool, sizeof(regex_t));
+    if ((status = regcomp(*re, pattern, REG_EXTENDED)) != 0) {
+        regerror(status, *re, buf, sizeof(buf));
+        apr_file_printf(local_stderr,
+                        "Invalid regular expression (%s): %s\n",
+                        pattern, buf);
+        return APR_EGENERAL;
+    }
+    apr_pool_cleanup_register(pool, *re, regex_cleanup,
+                              apr_pool_cleanup_null);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t cookie_jar_init(round_robin_profile_t *rp)
+{
+    cookie_jar_t *jar = &rp->jar;
+    apr_status_t rv;
+
+    if ((rv = apr_pool_create(&jar->pool, rp->pool)) != APR_SUCCESS)
+        return rv;
+    jar->cookies = apr_hash_make(jar->pool);
+    jar->headers = apr_hash_make(jar->pool);
+    jar->nextexpiry = 0;
+    jar->live = jar->garbage = 0;
+
+    return APR_SUCCESS;
+}
+
+/* The cached headers are no good any more; build them again as needed. */
+static void cookie_jar_changed(cookie_jar_t *jar)
+{
+    apr_hash_index_t *hi;
+    const void *key;
+    apr_ssize_t klen;
+    void *val;
+
+    for (hi = apr_hash_first(NULL, jar->headers); hi; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, &key, &klen, &val);
+        jar->live -= klen + strlen(val) + 2;
+        jar->garbage += klen + strlen(val) + 2;
+    }
+    apr_hash_clear(jar->headers);
+}
+
+/* Once more of the jar's pool is garbage than cookies, copy the cookies
+ * to a fresh pool and throw the old one away, so that a long session
+ * that keeps setting the same cookie doesn't grow without bound. */
+static void cookie_jar_compact(round_robin_profile_t *rp)
+{
+    cookie_jar_t *jar = &rp->jar, old = rp->jar;
+    apr_hash_index_t *hi;
+    cookie_t *c, *copy;
+
+    if (jar->garbage > FLOOD_COOKIE_GARBAGE_MIN && jar->garbage > jar->live &&
+        cookie_jar_init(rp) == APR_SUCCESS) {
+        for (hi = apr_hash_first(NULL, old.cookies); hi;
+             hi = apr_hash_next(hi)) {
+            apr_hash_this(hi, NULL, NULL, (void **)&c);
+            copy = apr_pmemdup(jar->pool, c, sizeof(cookie_t));
+            copy->name = apr_pstrdup(jar->pool, c->name);
+            copy->value = apr_pstrdup(jar->pool, c->value);
+            copy->domain = apr_pstrdup(jar->pool, c->domain);
+            copy->path = apr_pstrdup(jar->pool, c->path);
+            apr_hash_set(jar->cookies, apr_pstrcat(jar->pool, copy->name, ";",
+                                                   copy->domain, ";",
+                                                   copy->path, NULL),
+                         APR_HASH_KEY_STRING, copy);
+            jar->live += copy->size;
+        }
+        jar->nextexpiry = old.nextexpiry;
+        apr_pool_destroy(old.pool);
+    }
+
+    flood_mem_set(rp->mem, FLOOD_MEM_COOKIES, jar->live + jar->garbage);
+}
+
+/* Drop every cookie that has expired, and work out when the next one
+ * will. */
+static void cookie_jar_expire(cookie_jar_t *jar, apr_time_t now)
+{
+    apr_hash_index_t *hi;
+    const void *key;
+    cookie_t *c;
+
+    jar->nextexpiry = 0;
+    for (hi = apr_hash_first(NULL, jar->cookies); hi; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, &key, NULL, (void **)&c);
+        if (!c->expires)
+            continue;
+        if (c->expires <= now) {
+            /* APR lets us delete the entry we are on. */
+            apr_hash_set(jar->cookies, key, APR_HASH_KEY_STRING, NULL);
+            jar->live -= c->size;
+            jar->garbage += c->size;
+        }
+        else if (!jar->nextexpiry || c->expires < jar->nextexpiry)
+            jar->nextexpiry = c->expires;
+    }
+}
+
+/* Put the cookie in a Set-Cookie header of len bytes, sent in reply to
+ * req, in the jar.  A cookie the server wants gone is taken out. */
+static void cookie_jar_set(round_robin_profile_t *rp, request_t *req,
+                           const char *line, apr_size_t len)
+{
+    cookie_jar_t *jar = &rp->jar;
+    char *buf, *attr, *next, *eq, *key, *slash;
+    cookie_t *c, *old;
+    apr_time_t now = apr_time_now(), expires = 0;
+    int maxage = 0, expired = 0;
+
+    buf = apr_pstrndup(req->pool, line, len);
+    if (!(next = strchr(buf, ';')))
+        next = buf + len;
+    else
+        *next++ = '\0';
+    if (!(eq = strchr(buf, '=')) || eq == buf)
+        return;
+    *eq++ = '\0';
+
+    c = apr_pcalloc(jar->pool, sizeof(cookie_t));
+    c->name = apr_pstrdup(jar->pool, buf);
+    c->value = apr_pstrdup(jar->pool, eq);
+
+    while (*next) {
+        attr = next;
+        if (!(next = strchr(attr, ';')))
+            next = attr + strlen(attr);
+        else
+            *next++ = '\0';
+        while (apr_isspace(*attr))
+            attr++;
+        if ((eq = strchr(attr, '=')))
+            *eq++ = '\0';
+
+        if (strcasecmp(attr, "Domain") == 0 && eq && *eq) {
+            if (*eq == '.')
+                eq++;
+            c->domain = apr_pstrdup(jar->pool, eq);
+        }
+        else if (strcasecmp(attr, "Path") == 0 && eq && *eq == '/') {
+            c->path = apr_pstrdup(jar->pool, eq);
+        }
+        else if (strcasecmp(attr, "Max-Age") == 0 && eq) {
+            apr_int64_t age = strtoll(eq, NULL, 10);
+
+            /* Max-Age wins over Expires, wherever they come. */
+            maxage = 1;
+            expired = age <= 0;
+            c->expires = expired ? 0 : now + apr_time_from_sec(age);
+        }
+        else if (strcasecmp(attr, "Expires") == 0 && eq) {
+            expires = apr_date_parse_rfc(eq);
+        }
+        else if (strcasecmp(attr, "Secure") == 0) {
+            c->secure = 1;
+        }
+    }
+    if (!maxage && expires != APR_DATE_BAD) {
+        expired = expires <= now;
+        c->expires = expires;
+    }
+
+    if (!c->domain)
+        c->domain = apr_pstrdup(jar->pool, req->parsed_uri->hostname);
+    if (!c->path) {
+        /* The directory the request was for (RFC 6265, 5.1.4). */
+        const char *path = req->parsed_uri->path;
+
+        if (path && *path == '/' && (slash = strrchr(path, '/')) != path)
+            c->path = apr_pstrndup(jar->pool, path, slash - path);
+        else
+            c->path = apr_pstrdup(jar->pool, "/");
+    }
+    c->size = sizeof(cookie_t) + strlen(c->name) + strlen(c->value) +
+              strlen(c->domain) + strlen(c->path) + 4;
+
+    key = apr_pstrcat(jar->pool, c->name, ";", c->domain, ";", c->path, NULL);
+    c->size += strlen(key) + 1;
+
+    if ((old = apr_hash_get(jar->cookies, key, APR_HASH_KEY_STRING))) {
+        jar->live -= old->size;
+        jar->garbage += old->size;
+    }
+    if (expired) {
+        apr_hash_set(jar->cookies, key, APR_HASH_KEY_STRING, NULL);
+        jar->garbage += c->size;
+    }
+    else {
+        apr_hash_set(jar->cookies, key, APR_HASH_KEY_STRING, c);
+        jar->live += c->size;
+        if (c->expires &&
+            (!jar->nextexpiry || c->expires < jar->nextexpiry))
+            jar->nextexpiry = c->expires;
+    }
+
+    if (old || !expired)
+        cookie_jar_changed(jar);
+    cookie_jar_compact(rp);
+}
+
+/* Does the cookie go with a request for path on host? */
+static int cookie_matches(cookie_t *c, const char *host, const char *path,
+                          int secure)
+{
+    apr_size_t hlen, dlen, plen;
+
+    if (c->secure && !secure)
+        return 0;
+
+    hlen = strlen(host);
+    dlen = strlen(c->domain);
+    if (hlen < dlen || strcasecmp(host + hlen - dlen, c->domain) != 0 ||
+        (hlen > dlen && host[hlen - dlen - 1] != '.'))
+        return 0;
+
+    plen = strlen(c->path);
+    if (strncmp(path, c->path, plen) != 0 ||
+        (path[plen] != '\0' && path[plen] != '/' && c->path[plen - 1] != '/'))
+        return 0;
+
+    return 1;
+}
+
+/* The Cookie header to send with r, or "" if the jar has nothing for it.
+ * It lives in the jar, so it must not be modified. */
+static const char *cookie_jar_header(round_robin_profile_t *rp, request_t *r)
+{
+    cookie_jar_t *jar = &rp->jar;
+    apr_hash_index_t *hi;
+    const char *host, *path, *key;
+    char *header, *cp;
+    cookie_t *c;
+    apr_size_t len;
+    int secure;
+
+    if (!apr_hash_count(jar->cookies))
+        return "";
+
+    if (jar->nextexpiry && jar->nextexpiry <= apr_time_now()) {
+        cookie_jar_expire(jar, apr_time_now());
+        cookie_jar_changed(jar);
+        cookie_jar_compact(rp);
+    }
+
+    host = r->parsed_uri->hostname ? r->parsed_uri->hostname : "";
+    path = r->parsed_uri->path ? r->parsed_uri->path : "/";
+    secure = r->parsed_uri->scheme &&
+             strcasecmp(r->parsed_uri->scheme, "https") == 0;
+    key = apr_pstrcat(r->pool, secure ? "s " : "  ", host, " ", path, NULL);
+
+    if ((header = apr_hash_get(jar->headers, key, APR_HASH_KEY_STRING)))
+        return header;
+
+    /* A profile that visits path after path would otherwise keep a
+     * header for every one of them. */
+    if (apr_hash_count(jar->headers) >= FLOOD_COOKIE_HEADERS_MAX) {
+        cookie_jar_changed(jar);
+        cookie_jar_compact(rp);
+    }
+
+    /* Measure, then copy, so the header takes one allocation. */
+    len = 0;
+    for (hi = apr_hash_first(NULL, jar->cookies); hi; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, NULL, (void **)&c);
+        if (cookie_matches(c, host, path, secure))
+            len += strlen(c->name) + strlen(c->value) + 2;
+    }
+
+    if (len) {
+        header = cp = apr_palloc(jar->pool, len + sizeof("Cookie: " CRLF));
+        memcpy(cp, "Cookie: ", 8);
+        cp += 8;
+        for (hi = apr_hash_first(NULL, jar->cookies); hi;
+             hi = apr_hash_next(hi)) {
+            apr_hash_this(hi, NULL, NULL, (void **)&c);
+            if (!cookie_matches(c, host, path, secure))
+                continue;
+            if (cp != header + 8)
+                *cp++ = ';';
+            len = strlen(c->name);
+            memcpy(cp, c->name, len);
+            cp += len;
+            *cp++ = '=';
+            len = strlen(c->value);
+            memcpy(cp, c->value, len);
+            cp += len;
+        }
+        memcpy(cp, CRLF, sizeof(CRLF));
+    }
+    else
+        header = "";
+
+    apr_hash_set(jar->headers, apr_pstrdup(jar->pool, key),
+                 APR_HASH_KEY_STRING, header);
+    jar->live += strlen(key) + strlen(header) + 2;
+    flood_mem_set(rp->mem, FLOOD_MEM_COOKIES, jar->live + jar->garbage);
+    return header;
+}
+
+/* Expand template into a string allocated from pool.  Random values it
+ * makes up are copied into the profile's state to live on. */
+static char *handle_param_string(round_robin_profile_t *rp,
+                                 apr_pool_t *pool, char *template,
                                  expand_param_e set)
 {
-    char *cpy, *cur, *prev, *data, *returnValue, *pattern;
+    char *cpy, *cur, *prev, *data, *returnValue;
     int size, matchsize;
-    regex_t re;
     regmatch_t match[2];
     subst_rec_t* subst_rec_p;
     char* lookup_val;
     char subst_buf[8096];
-    apr_pool_t *local_pool;
 
-    if (apr_pool_create(&local_pool, NULL) != APR_SUCCESS) {
-      apr_file_printf(local_stderr, "Failed apr_pool_create!\n");
-      exit(-1);
-    }
-         
-         
     prev = template;
     returnValue = NULL;
 
-    pattern = "\\$\\{([^\\}]+)\\}";
-    regcomp(&re, pattern, REG_EXTENDED);
     cur = template;
-    while (regexec(&re, cur, 2, match, 0) == REG_OK)
+    while (regexec(&rp->paramre, cur, 2, match, 0) == REG_OK)
     {
         /* We must backup over the ${ characters. */
         size = match[1].rm_so - 2;
         if (size++)
         {
-            cpy = apr_palloc(rp->pool, size);
+            cpy = apr_palloc(pool, size);
             apr_cpystrn(cpy, cur, size);
         }
         else
@@ -167,14 +548,15 @@ static char *handle_param_string(round_robin_profile_t *rp, char *template,
             {
                 /* We need to assign it a random value. */
 #if FLOOD_USE_RAND
-                data = apr_psprintf(rp->pool, "%d", rand());
+                data = apr_psprintf(pool, "%d", rand());
 #elif FLOOD_USE_RAND48
-                data = apr_psprintf(rp->pool, "%ld", lrand48());
+                data = apr_psprintf(pool, "%ld", lrand48());
 #elif FLOOD_USE_RANDOM
-                data = apr_psprintf(rp->pool, "%ld", (long)random());
+                data = apr_psprintf(pool, "%ld", (long)random());
 #endif
                 matchsize = match[1].rm_eo - match[1].rm_so - 1;
-                apr_hash_set(rp->state, cur+match[1].rm_so+1, matchsize, data);
+                state_set(rp, cur+match[1].rm_so+1, matchsize, data,
+                          strlen(data));
             }
             else
                 data = NULL;
@@ -182,14 +564,15 @@ static char *handle_param_string(round_robin_profile_t *rp, char *template,
         else
         {
             matchsize = match[1].rm_eo - match[1].rm_so;
-            data = apr_hash_get(rp->state, cur+match[1].rm_so, matchsize);
+            data = (char *)flood_state_get(rp->state, cur+match[1].rm_so,
+                                           matchsize);
         }
 
         /* if there is no data, maybe it's a random string subst */
         /* try to do the substition */
 	if (!data) {
 	  matchsize = match[1].rm_eo - match[1].rm_so;
-	  lookup_val = apr_pstrndup(local_pool, cur+match[1].rm_so, matchsize);
+	  lookup_val = apr_pstrndup(pool, cur+match[1].rm_so, matchsize);
 
 	  memset(subst_buf, 0, sizeof(subst_buf));
 	  subst_rec_p = subst_file_get(lookup_val, rp->subst_list);
@@ -202,30 +585,30 @@ static char *handle_param_string(round_robin_profile_t *rp, char *template,
                             "substitution didn't return data!\n");
             exit(-1);
 	  } 
-	  data = apr_pstrdup(rp->pool, subst_buf);
+	  data = apr_pstrdup(pool, subst_buf);
 	}
 
         /* If there is no data, place the original string back. */
         if (!data) {
-            data = apr_psprintf(rp->pool, "${%s}", 
-                                apr_pstrmemdup(rp->pool, cur+match[1].rm_so,
+            data = apr_psprintf(pool, "${%s}", 
+                                apr_pstrmemdup(pool, cur+match[1].rm_so,
                                 match[1].rm_eo - match[1].rm_so));
         }
 
         if (!returnValue)
         {
             if (cpy)
-                returnValue = apr_pstrcat(rp->pool, cpy, data, NULL);
+                returnValue = apr_pstrcat(pool, cpy, data, NULL);
             else
-                returnValue = apr_pstrdup(rp->pool, data);
+                returnValue = apr_pstrdup(pool, data);
         }
         else
         {
             if (cpy)
-                returnValue = apr_pstrcat(rp->pool, returnValue, cpy, data, 
+                returnValue = apr_pstrcat(pool, returnValue, cpy, data, 
                                           NULL);
             else
-                returnValue = apr_pstrcat(rp->pool, returnValue, data, NULL);
+                returnValue = apr_pstrcat(pool, returnValue, data, NULL);
             
         }
 
@@ -234,58 +617,252 @@ static char *handle_param_string(round_robin_profile_t *rp, char *template,
     }
 
     if (!returnValue)
-        returnValue = apr_pstrdup(rp->pool, cur);
+        returnValue = apr_pstrdup(pool, cur);
     else
-        returnValue = apr_pstrcat(rp->pool, returnValue, cur, NULL);
+        returnValue = apr_pstrcat(pool, returnValue, cur, NULL);
 
     subst_file_entry_unescape(returnValue, sizeof(returnValue));
 
-    regfree(&re);
-    apr_pool_destroy(local_pool);
     return returnValue;
 }
 
-static char *expand_param_string(round_robin_profile_t *rp, char *template)
+static char *expand_param_string(round_robin_profile_t *rp,
+                                 apr_pool_t *pool, char *template)
+{
+    return handle_param_string(rp, pool, template, EPE_EXPAND);
+}
+
+static char *parse_param_string(round_robin_profile_t *rp,
+                                apr_pool_t *pool, char *template)
+{
+    return handle_param_string(rp, pool, template, EPE_EXPAND_SET);
+}
+
+/* The compiled form of the current URL's responsetemplate.  One without
+ * variables is compiled the first time it is used; one with them is
+ * looked up by what it expands to, and compiled only when that's new. */
+static apr_status_t response_regex(regex_t **re, round_robin_profile_t *rp,
+                                   apr_pool_t *pool)
+{
+    url_t *url = &rp->url[rp->current_url];
+    char *expanded;
+    apr_status_t rv;
+
+    if (url->responsere) {
+        *re = url->responsere;
+        return APR_SUCCESS;
+    }
+
+    if (!strstr(url->responsetemplate, "${")) {
+        if ((rv = regex_compile(&url->responsere, url->responsetemplate,
+                                rp->pool)) != APR_SUCCESS)
+            return rv;
+        *re = url->responsere;
+        return APR_SUCCESS;
+    }
+
+    expanded = expand_param_string(rp, pool, url->responsetemplate);
+    if ((*re = apr_hash_get(rp->regexes, expanded, APR_HASH_KEY_STRING)))
+        return APR_SUCCESS;
+
+    /* Values that change on every request would fill the cache with
+     * patterns we'll never see again, so start it over now and then. */
+    if (apr_hash_count(rp->regexes) >= FLOOD_REGEX_CACHE_MAX) {
+        apr_pool_clear(rp->regexpool);
+        rp->regexes = apr_hash_make(rp->regexpool);
+    }
+
+    if ((rv = regex_compile(re, expanded, rp->regexpool)) != APR_SUCCESS)
+        return rv;
+    apr_hash_set(rp->regexes, apr_pstrdup(rp->regexpool, expanded),
+                 APR_HASH_KEY_STRING, *re);
+
+    return APR_SUCCESS;
+}
+
+/* Matches a responsetemplate against the response as it is read, so the
+ * body needn't be kept.  All that is kept is what might still be part of
+ * a match: when nothing matches, the last FLOOD_EXTRACT_OVERLAP bytes. */
+typedef struct {
+    regex_t *re;
+    int nmatch;
+    char *buf;
+    apr_size_t len;
+    apr_size_t size;
+    int slid;  /* a boolean: has the start of the response gone? */
+    int found; /* a boolean */
+    regmatch_t match[FLOOD_RESPONSE_NAMES_MAX + 1];
+} response_extract_t;
+
+/* Look for a match in what we have.  Unless this is the end of the
+ * response, one that runs to the end of what we have might run on into
+ * what we don't, so it waits for more. */
+static void extract_match(response_extract_t *ext, int final)
+{
+    apr_size_t keep;
+    int status, eflags = ext->slid ? REG_NOTBOL : 0;
+
+#ifdef REG_STARTEND
+    ext->match[0].rm_so = 0;
+    ext->match[0].rm_eo = ext->len;
+    status = regexec(ext->re, ext->buf, ext->nmatch, ext->match,
+                     eflags | REG_STARTEND);
+#else
+    ext->buf[ext->len] = '\0';
+    status = regexec(ext->re, ext->buf, ext->nmatch, ext->match, eflags);
+#endif
+
+    if (status == REG_OK) {
+        if (final || ext->match[0].rm_eo < ext->len ||
+            ext->len == ext->size) {
+            ext->found = 1;
+            return;
+        }
+        keep = ext->len - ext->match[0].rm_so;
+    }
+    else
+        keep = 0;
+
+    if (keep < FLOOD_EXTRACT_OVERLAP)
+        keep = FLOOD_EXTRACT_OVERLAP;
+    if (keep < ext->len) {
+        memmove(ext->buf, ext->buf + ext->len - keep, keep);
+        ext->len = keep;
+        ext->slid = 1;
+    }
+}
+
+/* The request's sink: take the next piece of the response. */
+static void extract_sink(void *ctx, const char *data, apr_size_t len)
+{
+    response_extract_t *ext = (response_extract_t *)ctx;
+    apr_size_t n;
+
+    if (!data) {
+        ext->len = 0;
+        ext->slid = ext->found = 0;
+        return;
+    }
+
+    while (len && !ext->found) {
+        n = ext->size - ext->len;
+        if (n > len)
+            n = len;
+        memcpy(ext->buf + ext->len, data, n);
+        ext->len += n;
+        data += n;
+        len -= n;
+        extract_match(ext, 0);
+    }
+}
+
+static apr_status_t extract_create(response_extract_t **ext,
+                                   round_robin_profile_t *rp,
+                                   apr_pool_t *pool)
+{
+    apr_array_header_t *names = rp->url[rp->current_url].responsenames;
+    apr_status_t rv;
+
+    *ext = apr_pcalloc(pool, sizeof(response_extract_t));
+    if ((rv = response_regex(&(*ext)->re, rp, pool)) != APR_SUCCESS)
+        return rv;
+
+    /* Ask for no more groups than there are names to give them. */
+    (*ext)->nmatch = names && names->nelts ? names->nelts + 1 : 2;
+    (*ext)->size = FLOOD_EXTRACT_OVERLAP + MAX_DOC_LENGTH;
+    (*ext)->buf = apr_palloc(pool, (*ext)->size + 1);
+
+    return APR_SUCCESS;
+}
+
+/* Everything that looks at a response as it is read. */
+typedef struct {
+    int fed; /* a boolean: has the socket group shown us anything? */
+    response_extract_t *extract; /* for a responsetemplate */
+    flood_body_t body; /* for those that look at the body alone */
+    flood_json_t *json; /* for responsejson */
+    int digest; /* a boolean: for expectdigest */
+    apr_uint32_t crc; /* of the body so far */
+    flood_match_t *match; /* for expectbody and rejectbody */
+} response_watch_t;
+
+static void watch_body(void *ctx, const char *data, apr_size_t len)
 {
-    return handle_param_string(rp, template, EPE_EXPAND);
+    response_watch_t *watch = (response_watch_t *)ctx;
+
+    if (watch->json)
+        flood_json_feed(watch->json, data, len);
+    if (watch->digest)
+        watch->crc = flood_crc32c(watch->crc, data, len);
+    if (watch->match)
+        flood_match_feed(watch->match, data, len);
 }
 
-static char *parse_param_string(round_robin_profile_t *rp, char *template)
+/* The request's sink: show the next piece of the response to each. */
+static void watch_sink(void *ctx, const char *data, apr_size_t len)
 {
-    return handle_param_string(rp, template, EPE_EXPAND_SET);
+    response_watch_t *watch = (response_watch_t *)ctx;
+
+    if (!data) {
+        watch->fed = 0;
+        if (watch->extract)
+            extract_sink(watch->extract, NULL, 0);
+        if (watch->json)
+            flood_json_reset(watch->json);
+        watch->crc = 0;
+        if (watch->match)
+            flood_match_reset(watch->match);
+        flood_body_reset(&watch->body);
+        return;
+    }
+
+    watch->fed = 1;
+    if (watch->extract)
+        extract_sink(watch->extract, data, len);
+    flood_body_feed(&watch->body, data, len);
 }
 
 /* Construct a request */
 apr_status_t round_robin_create_req(profile_t *profile, request_t *r)
 {
     round_robin_profile_t *p;
-    char *cookies, *path;
+    const char *cookies;
+    char *path;
     char *enc_credtls, *credtls, *authz_hdr = NULL, *extra_hdr = NULL;
-    cookie_t *cook;
    
     p = (round_robin_profile_t*)profile; 
 
-    /* Do we want to save the entire response? */
-    r->wantresponse = p->url[p->current_url].responsetemplate ? 1 : 0;
-
-    /* FIXME: This algorithm sucks. */
-    if (p->cookie)
-    {
-        cookies = apr_pstrdup(p->pool, "Cookie: ");
-        cook = p->cookie;
-        while (cook)
-        {
-            if (cook != p->cookie)
-                cookies = apr_pstrcat(p->pool, cookies, ";", NULL);
+    /* We look for the responsetemplate and responsejson paths, and
+     * measure the body, as the response arrives, rather than keep all
+     * of it. */
+    if (p->url[p->current_url].responsetemplate ||
+        p->url[p->current_url].jsonpaths ||
+        p->url[p->current_url].expectlength >= 0 ||
+        p->url[p->current_url].expectdigest ||
+        p->url[p->current_url].bodypatterns) {
+        response_watch_t *watch = apr_pcalloc(r->pool,
+                                              sizeof(response_watch_t));
+        apr_status_t rv;
 
-            cookies = apr_pstrcat(p->pool, cookies, cook->name, "=", 
-                                  cook->value, NULL);
-            cook = cook->next; 
-        }
-        cookies = apr_pstrcat(p->pool, cookies, CRLF, NULL);
+        if (p->url[p->current_url].responsetemplate &&
+            (rv = extract_create(&watch->extract, p, r->pool)) != APR_SUCCESS)
+            return rv;
+        if (p->url[p->current_url].jsonpaths)
+            watch->json = flood_json_create(p->url[p->current_url].jsonpaths,
+                                            r->pool);
+        watch->digest = p->url[p->current_url].expectdigest;
+        if (p->url[p->current_url].bodypatterns)
+            watch->match = flood_match_create(
+                               p->url[p->current_url].bodypatterns, r->pool);
+        flood_body_init(&watch->body, watch_body, watch);
+        r->sink = watch_sink;
+        r->sinkctx = watch;
     }
-    else
-        cookies = "";
+
+    /* A responsecoprocess is shown all of the response. */
+    r->wantresponse = p->url[p->current_url].responsecoprocess ? 1 : 0;
+
+    cookies = cookie_jar_header(p, r);
 
     if (p->url[p->current_url].user) {
         if (!p->url[p->current_url].password) {
@@ -402,9 +979,45 @@ apr_status_t round_robin_create_req(profile_t *profile, request_t *r)
     return APR_SUCCESS;
 }
 
+/* Which of t's limits goes by this name, if any? */
+static apr_interval_time_t *timeout_field(flood_timeouts_t *t,
+                                          const char *name)
+{
+    if (strncasecmp(name, XML_URLLIST_CONNECT_TIMEOUT, FLOOD_STRLEN_MAX) == 0)
+        return &t->connect;
+    if (strncasecmp(name, XML_URLLIST_FIRST_BYTE_TIMEOUT,
+                    FLOOD_STRLEN_MAX) == 0)
+        return &t->firstbyte;
+    if (strncasecmp(name, XML_URLLIST_IDLE_TIMEOUT, FLOOD_STRLEN_MAX) == 0)
+        return &t->idle;
+    if (strncasecmp(name, XML_URLLIST_TOTAL_TIMEOUT, FLOOD_STRLEN_MAX) == 0)
+        return &t->total;
+    return NULL;
+}
+
+/* Timeouts are given in milliseconds. */
+static apr_status_t parse_timeout(apr_interval_time_t *t, const char *name,
+                                  const char *value)
+{
+    char *endptr;
+
+    *t = strtoll(value, &endptr, 10);
+    if (*endptr != '\0' || *t < 0)
+    {
+        apr_file_printf(local_stderr, "%s has invalid value %s.\n",
+                        name, value);
+        return APR_EGENERAL;
+    }
+    *t *= 1000;
+
+    return APR_SUCCESS;
+}
+
 static apr_status_t parse_xml_url_info(apr_xml_elem *e, url_t *url,
                                        apr_pool_t *pool)
 {
+    url->expectlength = -1;
+
     /* Grab the url from the text section. */
     if (e->first_cdata.first && e->first_cdata.first->text)
     {
@@ -427,9 +1040,15 @@ static apr_status_t parse_xml_url_info(apr_xml_elem *e, url_t *url,
     if (e->attr)
     {
         apr_xml_attr *attr = e->attr;
+        apr_interval_time_t *timeout;
         while (attr)
         {
-            if (strncasecmp(attr->name, XML_URLLIST_METHOD, 
+            if ((timeout = timeout_field(&url->timeouts, attr->name))) {
+                if (parse_timeout(timeout, attr->name,
+                                  attr->value) != APR_SUCCESS)
+                    return APR_EGENERAL;
+            }
+            else if (strncasecmp(attr->name, XML_URLLIST_METHOD, 
                             FLOOD_STRLEN_MAX) == 0) {
                 if (strncasecmp(attr->value, XML_URLLIST_METHOD_POST, 4) == 0) {
                     url->method = POST;
@@ -574,6 +1193,26 @@ static apr_status_t parse_xml_url_info(apr_xml_elem *e, url_t *url,
                                  FLOOD_STRLEN_MAX) == 0) {
                 url->responsetemplate = (char*)attr->value;
             }
+            else if (strncasecmp(attr->name, 
+                                 XML_URLLIST_RESPONSE_JSON, 
+                                 FLOOD_STRLEN_MAX) == 0) {
+                url->responsejson = (char*)attr->value;
+                if (flood_json_compile(&url->jsonpaths, url->responsejson,
+                                       pool) != APR_SUCCESS)
+                    return APR_EGENERAL;
+            }
+            else if (strncasecmp(attr->name, 
+                                 XML_URLLIST_RESPONSE_COPROCESS_TIMEOUT, 
+                                 FLOOD_STRLEN_MAX) == 0) {
+                if (parse_timeout(&url->coprocesstimeout, attr->name,
+                                  attr->value) != APR_SUCCESS)
+                    return APR_EGENERAL;
+            }
+            else if (strncasecmp(attr->name, 
+                                 XML_URLLIST_RESPONSE_COPROCESS, 
+                                 FLOOD_STRLEN_MAX) == 0) {
+                url->responsecoprocess = (char*)attr->value;
+            }
             else if (strncasecmp(attr->name, 
                                  XML_URLLIST_RESPONSE_SCRIPT, 
                                  FLOOD_STRLEN_MAX) == 0) {
@@ -582,8 +1221,82 @@ static apr_status_t parse_xml_url_info(apr_xml_elem *e, url_t *url,
             else if (strncasecmp(attr->name, 
                                  XML_URLLIST_RESPONSE_NAME,
                                  FLOOD_STRLEN_MAX) == 0) {
-                url->responsename = (char*)attr->value;
-                url->responselen = strlen((char*)attr->value);
+                /* one name for each capture group, separated by commas */
+                char *names = apr_pstrdup(pool, attr->value), *last, *name;
+
+                url->responsenames = apr_array_make(pool, 1, sizeof(char*));
+                for (name = apr_strtok(names, ", \t", &last); name;
+                     name = apr_strtok(NULL, ", \t", &last)) {
+                    *(char**)apr_array_push(url->responsenames) = name;
+                }
+                if (url->responsenames->nelts > FLOOD_RESPONSE_NAMES_MAX) {
+                    apr_file_printf(local_stderr,
+                                    "Attribute %s has more than %d names.\n",
+                                    XML_URLLIST_RESPONSE_NAME,
+                                    FLOOD_RESPONSE_NAMES_MAX);
+                    return APR_EGENERAL;
+                }
+            }
+            else if (strncasecmp(attr->name, 
+                                 XML_URLLIST_EXPECT_STATUS,
+                                 FLOOD_STRLEN_MAX) == 0) {
+                if (flood_parse_status_list(&url->expectstatus, attr->value,
+                                            pool) != APR_SUCCESS)
+                    return APR_EGENERAL;
+            }
+            else if (strncasecmp(attr->name, 
+                                 XML_URLLIST_EXPECT_LENGTH,
+                                 FLOOD_STRLEN_MAX) == 0) {
+                char *endptr;
+                url->expectlength = strtoll(attr->value, &endptr, 10);
+                if (*endptr != '\0' || url->expectlength < 0)
+                {
+                    apr_file_printf(local_stderr, 
+                                    "Attribute %s has invalid value %s.\n",
+                                    XML_URLLIST_EXPECT_LENGTH, attr->value);
+                    return APR_EGENERAL;
+                }
+            }
+            else if (strncasecmp(attr->name, 
+                                 XML_URLLIST_EXPECT_DIGEST,
+                                 FLOOD_STRLEN_MAX) == 0) {
+                /* "crc32c:" and eight hex digits */
+                char *endptr = NULL;
+                if (strncasecmp(attr->value, "crc32c:", 7) == 0 &&
+                    apr_isxdigit(attr->value[7]) &&
+                    strlen(attr->value) <= 15)
+                    url->expectcrc = (apr_uint32_t)strtoul(attr->value + 7,
+                                                           &endptr, 16);
+                if (!endptr || *endptr != '\0')
+                {
+                    apr_file_printf(local_stderr, 
+                                    "Attribute %s has invalid value %s.\n",
+                                    XML_URLLIST_EXPECT_DIGEST, attr->value);
+                    return APR_EGENERAL;
+                }
+                url->expectdigest = 1;
+            }
+            else if (strncasecmp(attr->name, 
+                                 XML_URLLIST_EXPECT_BODY,
+                                 FLOOD_STRLEN_MAX) == 0) {
+                url->expectbody = (char*)attr->value;
+            }
+            else if (strncasecmp(attr->name, 
+                                 XML_URLLIST_REJECT_BODY,
+                                 FLOOD_STRLEN_MAX) == 0) {
+                url->rejectbody = (char*)attr->value;
+            }
+            else if (strncasecmp(attr->name, 
+                                 XML_URLLIST_EXPECT_HEADER,
+                                 FLOOD_STRLEN_MAX) == 0) {
+                /* header names, separated by commas */
+                char *names = apr_pstrdup(pool, attr->value), *last, *name;
+
+                url->expectheaders = apr_array_make(pool, 1, sizeof(char*));
+                for (name = apr_strtok(names, ", \t", &last); name;
+                     name = apr_strtok(NULL, ", \t", &last)) {
+                    *(char**)apr_array_push(url->expectheaders) = name;
+                }
             }
             else if (strncasecmp(attr->name, 
                                  XML_URLLIST_USER,
@@ -597,6 +1310,19 @@ static apr_status_t parse_xml_url_info(apr_xml_elem *e, url_t *url,
             }
             attr = attr->next;
         }
+        /* Both would want the responsenames. */
+        if (url->responsetemplate && url->responsejson) {
+            apr_file_printf(local_stderr,
+                            "Attributes %s and %s can't both be given.\n",
+                            XML_URLLIST_RESPONSE_TEMPLATE,
+                            XML_URLLIST_RESPONSE_JSON);
+            return APR_EGENERAL;
+        }
+        /* One automaton looks for both. */
+        if ((url->expectbody || url->rejectbody) &&
+            flood_match_compile(&url->bodypatterns, url->expectbody,
+                                url->rejectbody, pool) != APR_SUCCESS)
+            return APR_EGENERAL;
     }
     else
     {
@@ -661,7 +1387,8 @@ static apr_status_t parse_xml_seq_info(apr_xml_elem *e,
         }
     }             
     for (curseq = 0; curseq < seqcount; curseq++) {
-        apr_hash_set(p->state, seqname, seqnamelen, seqlist[curseq]);
+        state_set(p, seqname, seqnamelen, seqlist[curseq],
+                  strlen(seqlist[curseq]));
         for (child_url_elem = e->first_child; child_url_elem;
              child_url_elem = child_url_elem->next) {
             if (strncasecmp(child_url_elem->name, XML_URLLIST_SEQUENCE,
@@ -682,19 +1409,19 @@ static apr_status_t parse_xml_seq_info(apr_xml_elem *e,
                 /* Expand them. */
                 if (p->url[p->current_url].payloadtemplate) {
                     p->url[p->current_url].payloadtemplate = 
-                        handle_param_string(p,
+                        handle_param_string(p, p->pool,
                                         p->url[p->current_url].payloadtemplate,
                                         EPE_PASSTHROUGH);
                 }
                 if (p->url[p->current_url].requesttemplate) {
                     p->url[p->current_url].requesttemplate = 
-                        handle_param_string(p,
+                        handle_param_string(p, p->pool,
                                         p->url[p->current_url].requesttemplate,
                                         EPE_PASSTHROUGH);
                 }
                 if (p->url[p->current_url].responsetemplate) {
                     p->url[p->current_url].responsetemplate = 
-                        handle_param_string(p,
+                        handle_param_string(p, p->pool,
                                         p->url[p->current_url].responsetemplate,
                                         EPE_PASSTHROUGH);
                 }
@@ -705,6 +1432,29 @@ static apr_status_t parse_xml_seq_info(apr_xml_elem *e,
     return APR_SUCCESS;
 }
 
+/* Boolean children of <urllist> are switched on by their presence, unless
+ * their value says otherwise. */
+static int retrieve_urllist_flag(struct apr_xml_elem *urllist_elem,
+                                 const char *name)
+{
+    struct apr_xml_elem *flag_elem;
+    const char *value;
+
+    if (retrieve_xml_elem_child(&flag_elem, urllist_elem, name) != APR_SUCCESS)
+        return 0;
+
+    if (!flag_elem->first_cdata.first || !flag_elem->first_cdata.first->text)
+        return 1;
+
+    value = flag_elem->first_cdata.first->text;
+    if (strncasecmp(value, "off", FLOOD_STRLEN_MAX) == 0 ||
+        strncasecmp(value, "no", FLOOD_STRLEN_MAX) == 0 ||
+        strncasecmp(value, "0", FLOOD_STRLEN_MAX) == 0)
+        return 0;
+
+    return 1;
+}
+
 static int count_xml_seq_child(apr_xml_elem *urllist_elem)
 {
     struct apr_xml_elem *e;
@@ -753,8 +1503,9 @@ apr_status_t round_robin_profile_init(profile_t **profile,
     struct apr_xml_elem *root_elem, *profile_elem,
            *urllist_elem, *count_elem, *useurllist_elem, *baseurl_elem,
       *subst_list_elem, *subst_entry_elem, *subst_entry_child,
-           *proxyurl_elem, *e;
+           *proxyurl_elem, *unixsocket_elem, *maxstreams_elem, *e;
     round_robin_profile_t *p;
+    farmer_ctx_t *ctx;
     char *xml_profile, *xml_urllist, *urllist_name;
     char *xml_subst_list, *subst_list_name;
     subst_rec_t* subst_rec_p; 
@@ -766,7 +1517,27 @@ apr_status_t round_robin_profile_init(profile_t **profile,
     /* yeah, yeah; calloc(), whatever...this is readability baby! */
     p->current_url = 0; /* start on the first URL */
     p->current_round = 0; /* start counting rounds at 0 */
-    p->state = apr_hash_make(pool);
+    p->state = flood_state_create(pool);
+    p->mem = flood_mem_get(pool);
+    if ((rv = cookie_jar_init(p)) != APR_SUCCESS)
+        return rv;
+    if (regcomp(&p->paramre, "\\$\\{([^\\}]+)\\}", REG_EXTENDED) != 0)
+        return APR_EGENERAL;
+    apr_pool_cleanup_register(pool, &p->paramre, regex_cleanup,
+                              apr_pool_cleanup_null);
+    if ((rv = apr_pool_create(&p->regexpool, pool)) != APR_SUCCESS)
+        return rv;
+    p->regexes = apr_hash_make(p->regexpool);
+    /* This pool goes after every run of the profile; the co-processes
+     * are worth keeping. */
+    if ((ctx = farmer_ctx_get(pool))) {
+        p->coprocpool = ctx->pool;
+        p->coprocs = ctx->coprocs;
+    }
+    else {
+        p->coprocpool = pool;
+        p->coprocs = apr_hash_make(pool);
+    }
 
     /* get the XML pathes to the profile and the urllist */
     xml_profile = apr_pstrdup(pool, XML_PROFILE);
@@ -844,6 +1615,62 @@ apr_status_t round_robin_profile_init(profile_t **profile,
         p->proxy_url = NULL;
     }
 
+    /* do we talk to the server over a Unix domain socket? */
+    if ((rv = retrieve_xml_elem_child(
+             &unixsocket_elem, urllist_elem, XML_URLLIST_UNIX_SOCKET)) == APR_SUCCESS) {
+        if (!unixsocket_elem->first_cdata.first ||
+            !*unixsocket_elem->first_cdata.first->text) {
+            apr_file_printf(local_stderr, "%s has no path.\n",
+                            XML_URLLIST_UNIX_SOCKET);
+            return APR_EGENERAL;
+        }
+        p->unixsocket = apr_pstrdup(pool, unixsocket_elem->first_cdata.first->text);
+    } else {
+        p->unixsocket = NULL;
+    }
+
+    /* do we want kernel TLS? */
+    p->ktls = retrieve_urllist_flag(urllist_elem, XML_URLLIST_KTLS);
+
+    /* do we want io_uring for plain connections? */
+    p->iouring = retrieve_urllist_flag(urllist_elem, XML_URLLIST_IO_URING);
+
+    /* may we put requests in the SYN? */
+    p->fastopen = retrieve_urllist_flag(urllist_elem, XML_URLLIST_FASTOPEN);
+
+    /* may we send requests as TLS 1.3 early data? */
+    p->earlydata = retrieve_urllist_flag(urllist_elem, XML_URLLIST_EARLY_DATA);
+
+    /* how many requests may share an h2 or h3 connection? */
+    if ((rv = retrieve_xml_elem_child(
+             &maxstreams_elem, urllist_elem, XML_URLLIST_MAX_STREAMS)) == APR_SUCCESS) {
+        const char *value = maxstreams_elem->first_cdata.first ?
+                            maxstreams_elem->first_cdata.first->text : "";
+        char *endptr;
+        long n;
+
+        /* A client opens odd stream ids below 2^31: no more than 2^30. */
+        n = strtol(value, &endptr, 10);
+        if (endptr == value || *endptr != '\0' || n < 1 || n > (1L << 30)) {
+            apr_file_printf(local_stderr, "%s has invalid value %s.\n",
+                            XML_URLLIST_MAX_STREAMS, value);
+            return APR_EGENERAL;
+        }
+        p->maxstreams = n;
+    } else {
+        p->maxstreams = FLOOD_H2_MAX_STREAMS;
+    }
+
+    /* how long may requests take?  <url> attributes override these. */
+    for (e = urllist_elem->first_child; e; e = e->next) {
+        apr_interval_time_t *timeout = timeout_field(&p->timeouts, e->name);
+
+        if (timeout && e->first_cdata.first &&
+            parse_timeout(timeout, e->name,
+                          e->first_cdata.first->text) != APR_SUCCESS)
+            return APR_EGENERAL;
+    }
+
     p->urls = 0;
     /* Include sequences.  We'll expand them later. */
     p->urls = count_xml_seq_child(urllist_elem);
@@ -953,7 +1780,8 @@ apr_status_t round_robin_profile_init(profile_t **profile,
     return APR_SUCCESS;
 }
 
-apr_status_t round_robin_get_next_url(request_t **request, profile_t *profile)
+apr_status_t round_robin_get_next_url(request_t **request, profile_t *profile,
+                                      apr_pool_t *pool)
 {
     round_robin_profile_t *rp;
     request_t *r;
@@ -961,12 +1789,12 @@ apr_status_t round_robin_get_next_url(request_t **request, profile_t *profile)
     rp = (round_robin_profile_t*)profile;
 
     /* FIXME: precompute request_t in profile_init */
-    r = apr_pcalloc(rp->pool, sizeof(request_t));
-    r->pool = rp->pool;
+    r = apr_pcalloc(pool, sizeof(request_t));
+    r->pool = pool;
 
     if (rp->url[rp->current_url].requesttemplate)
     {
-        r->uri = parse_param_string(rp, 
+        r->uri = parse_param_string(rp, pool,
                                     rp->url[rp->current_url].requesttemplate);
     }
     else
@@ -984,14 +1812,15 @@ apr_status_t round_robin_get_next_url(request_t **request, profile_t *profile)
     }
     else if (rp->url[rp->current_url].payloadtemplate)
     {
-        r->payload = parse_param_string(rp, 
+        r->payload = parse_param_string(rp, pool,
                                     rp->url[rp->current_url].payloadtemplate);
         r->payloadsize = strlen(r->payload);
     }
 
     if (rp->url[rp->current_url].contenttype)
     {
-        r->contenttype = parse_param_string(rp, rp->url[rp->current_url].contenttype);
+        r->contenttype = parse_param_string(rp, pool,
+                                            rp->url[rp->current_url].contenttype);
         r->contenttypesize = strlen(r->contenttype);
     }
 
@@ -1017,13 +1846,13 @@ apr_status_t round_robin_get_next_url(request_t **request, profile_t *profile)
 
     }
 
-    r->parsed_uri = apr_palloc(rp->pool, sizeof(apr_uri_t));
+    r->parsed_uri = apr_palloc(pool, sizeof(apr_uri_t));
 
     if (rp->baseurl != NULL) {
-        r->uri = apr_pstrcat(rp->pool, rp->baseurl, r->uri, NULL);
+        r->uri = apr_pstrcat(pool, rp->baseurl, r->uri, NULL);
     }
 
-    apr_uri_parse(rp->pool, r->uri, r->parsed_uri);
+    apr_uri_parse(pool, r->uri, r->parsed_uri);
     if (r->parsed_uri->scheme == NULL || r->parsed_uri->hostname == NULL) {
         apr_file_printf(local_stderr, "Misformed URL '%s'\n", r->uri);
         exit (APR_EGENERAL);
@@ -1056,6 +1885,21 @@ apr_status_t round_robin_get_next_url(request_t **request, profile_t *profile)
         r->parsed_uri->path = "/";
 
     r->parsed_proxy_uri = rp->proxy_url;
+    r->unixsocket = rp->unixsocket;
+    r->ktls = rp->ktls;
+    r->iouring = rp->iouring;
+    r->fastopen = rp->fastopen;
+    r->earlydata = rp->earlydata;
+    r->maxstreams = rp->maxstreams;
+    r->timeouts = rp->timeouts;
+    if (rp->url[rp->current_url].timeouts.connect)
+        r->timeouts.connect = rp->url[rp->current_url].timeouts.connect;
+    if (rp->url[rp->current_url].timeouts.firstbyte)
+        r->timeouts.firstbyte = rp->url[rp->current_url].timeouts.firstbyte;
+    if (rp->url[rp->current_url].timeouts.idle)
+        r->timeouts.idle = rp->url[rp->current_url].timeouts.idle;
+    if (rp->url[rp->current_url].timeouts.total)
+        r->timeouts.total = rp->url[rp->current_url].timeouts.total;
 
 #ifdef PROFILE_DEBUG
     apr_file_printf(local_stdout, "Generating request to: %s\n", r->uri);
@@ -1066,74 +1910,144 @@ apr_status_t round_robin_get_next_url(request_t **request, profile_t *profile)
     return APR_SUCCESS;
 }
 
+/* Hand the response to the url's responsecoprocess.  Its answer is "ok"
+ * or "fail" and a reason, on a line of its own, then any number of
+ * name=value lines to set variables from. */
+static apr_status_t coprocess_check(round_robin_profile_t *rp,
+                                    request_t *req, response_t *resp)
+{
+    url_t *url = &rp->url[rp->current_url];
+    flood_coproc_t *coproc;
+    apr_status_t rv;
+    apr_size_t len;
+    char *answer, *line, *last, *value;
+
+    coproc = apr_hash_get(rp->coprocs, url->responsecoprocess,
+                          APR_HASH_KEY_STRING);
+    if (!coproc) {
+        if ((rv = flood_coproc_create(&coproc, url->responsecoprocess,
+                                      url->coprocesstimeout ?
+                                      url->coprocesstimeout :
+                                      FLOOD_COPROC_TIMEOUT,
+                                      rp->coprocpool)) != APR_SUCCESS)
+            return rv;
+        apr_hash_set(rp->coprocs,
+                     apr_pstrdup(rp->coprocpool, url->responsecoprocess),
+                     APR_HASH_KEY_STRING, coproc);
+    }
+
+    flood_response_flatten(resp, req->pool);
+    if ((rv = flood_coproc_call(coproc, req->uri, resp->rbuf, resp->rbufsize,
+                                &answer, &len, req->pool)) != APR_SUCCESS)
+        return rv;
+
+    line = apr_strtok(answer, "\r\n", &last);
+    if (!line || strcmp(line, "ok") != 0) {
+        apr_file_printf(local_stderr,
+                        "Postprocess co-process '%s' failed %s: %s\n",
+                        url->responsecoprocess, req->uri,
+                        line ? line : "(no answer)");
+        return APR_EGENERAL;
+    }
+
+    while ((line = apr_strtok(NULL, "\r\n", &last))) {
+        if (!(value = strchr(line, '='))) {
+            apr_file_printf(local_stderr,
+                            "Postprocess co-process '%s' answered with "
+                            "a line that sets nothing: %s\n",
+                            url->responsecoprocess, line);
+            return APR_EGENERAL;
+        }
+        *value++ = '\0';
+        state_set(rp, line, APR_HASH_KEY_STRING, value, strlen(value));
+    }
+
+    return APR_SUCCESS;
+}
+
 apr_status_t round_robin_postprocess(profile_t *profile,
                                      request_t *req,
                                      response_t *resp)
 {
     round_robin_profile_t *rp;
-    char *cookieheader, *cookievalue, *cookieend;
+    response_watch_t *watch;
+    int h;
 
     rp = (round_robin_profile_t*)profile;
 
-    /* FIXME: This algorithm sucks.  I need to be shot for writing such 
-     * atrocious code.  Grr.  */
-    cookieheader = strstr(resp->rbuf, "Set-Cookie: ");
-    if (cookieheader)
-    {
-        /* Point to the value */
-        cookieheader += 12;
-        cookievalue = (char*) memchr(cookieheader, '=', 
-                      resp->rbufsize - (int)(cookieheader - (int)(resp->rbuf)));
-        if (cookievalue)
-        {
-            cookie_t * cookie = apr_pcalloc(rp->pool, sizeof(cookie_t));
-
-            ++cookievalue;
-            cookie->name = apr_palloc(rp->pool, cookievalue - cookieheader);
-            apr_cpystrn(cookie->name, cookieheader, cookievalue - cookieheader);
-
-            cookieheader = cookievalue;
-            cookieend = (char*) memchr(cookieheader, '\r', 
-                      resp->rbufsize - (int)(cookieheader - (int)(resp->rbuf)));
-            cookievalue = (char*) memchr(cookieheader, ';', 
-                                  cookieend - cookieheader);
-            if (!cookievalue)
-                cookievalue = cookieend;
-            
-            ++cookievalue;
-            
-            cookie->value = apr_palloc(rp->pool, cookievalue - cookieheader);
-            apr_cpystrn(cookie->value, cookieheader, 
-                        cookievalue - cookieheader);
-            cookie->next = rp->cookie;
-            rp->cookie = cookie;
-        }
+    /* Socket groups that don't stream leave us the whole response. */
+    watch = req->sink == watch_sink ? (response_watch_t *)req->sinkctx : NULL;
+    if (watch && !watch->fed) {
+        flood_seg_t *seg;
+
+        watch_sink(watch, NULL, 0);
+        watch_sink(watch, resp->rbuf, resp->rbufsize);
+        for (seg = resp->seg; seg; seg = seg->next)
+            watch_sink(watch, seg->data, seg->len);
+    }
+
+    /* Take every cookie. */
+    for (h = 0; resp->indexed && h < resp->nheaders; h++) {
+        if (resp->header[h].known == FLOOD_HEADER_SET_COOKIE)
+            cookie_jar_set(rp, req, resp->rbuf + resp->header[h].value,
+                           resp->header[h].valuelen);
     }
+
     if (rp->url[rp->current_url].responsetemplate)
     {
-        int status, size;
-        char *expanded, *newValue;
-        regmatch_t match[10];
-        regex_t re;
+        apr_array_header_t *names = rp->url[rp->current_url].responsenames;
+        response_extract_t *ext = watch->extract;
+        int i;
 
-        expanded = expand_param_string(rp, 
-                                    rp->url[rp->current_url].responsetemplate);
-        regcomp(&re, expanded, REG_EXTENDED);
-        status = regexec(&re, resp->rbuf, 10, match, 0);
+        if (!ext->found && ext->len)
+            extract_match(ext, 1);
 
-        if (status != REG_OK) {
+        if (!ext->found) {
             apr_file_printf(local_stderr,
                             "Regular expression match failed (%s)\n",
                             rp->url[rp->current_url].responsetemplate);
             return APR_EGENERAL;
         }
 
-        size = match[1].rm_eo - match[1].rm_so + 1;
-        newValue = apr_palloc(rp->pool, size);
-        apr_cpystrn(newValue, resp->rbuf + match[1].rm_so, size);
-        apr_hash_set(rp->state, rp->url[rp->current_url].responsename,
-                     rp->url[rp->current_url].responselen, newValue);
-        regfree(&re);
+        for (i = 0; names && i < names->nelts; i++) {
+            const char *name = ((char**)names->elts)[i];
+
+            /* A group that took no part in the match sets nothing. */
+            if (ext->match[i + 1].rm_so < 0)
+                continue;
+            state_set(rp, name, APR_HASH_KEY_STRING,
+                      ext->buf + ext->match[i + 1].rm_so,
+                      ext->match[i + 1].rm_eo - ext->match[i + 1].rm_so);
+        }
+    }
+    if (rp->url[rp->current_url].jsonpaths)
+    {
+        apr_array_header_t *names = rp->url[rp->current_url].responsenames;
+        flood_json_paths_t *paths = rp->url[rp->current_url].jsonpaths;
+        int i;
+
+        flood_json_finish(watch->json);
+        for (i = 0; i < flood_json_count(paths); i++) {
+            const char *value = flood_json_value(watch->json, i);
+
+            if (!value) {
+                apr_file_printf(local_stderr,
+                                "JSON path %s led to no value\n",
+                                flood_json_path(paths, i));
+                return APR_EGENERAL;
+            }
+            if (!names || i >= names->nelts)
+                continue;
+            state_set(rp, ((char**)names->elts)[i], APR_HASH_KEY_STRING,
+                      value, strlen(value));
+        }
+    }
+    if (rp->url[rp->current_url].responsecoprocess)
+    {
+        apr_status_t rv;
+
+        if ((rv = coprocess_check(rp, req, resp)) != APR_SUCCESS)
+            return rv;
     }
     if (rp->url[rp->current_url].responsescript)
     {
@@ -1150,7 +2064,7 @@ apr_status_t round_robin_postprocess(profile_t *profile,
         const char *progname;
         
 
-        if ((rv = apr_procattr_create(&procattr, rp->pool)) != APR_SUCCESS) {
+        if ((rv = apr_procattr_create(&procattr, req->pool)) != APR_SUCCESS) {
             apr_file_printf(local_stderr,
                             "apr_procattr_create failed for '%s': %s\n",
                             rp->url[rp->current_url].responsescript,
@@ -1177,14 +2091,14 @@ apr_status_t round_robin_postprocess(profile_t *profile,
         }
 
         apr_tokenize_to_argv(rp->url[rp->current_url].responsescript, &args,
-                                rp->pool);
-        progname = apr_pstrdup(rp->pool, args[0]);
+                                req->pool);
+        progname = apr_pstrdup(req->pool, args[0]);
 
-        proc = (apr_proc_t *)apr_pcalloc(rp->pool, sizeof(*proc));
+        proc = (apr_proc_t *)apr_pcalloc(req->pool, sizeof(*proc));
 
         /* create process */
         if ((rv = apr_proc_create(proc, progname, (const char * const *)args,
-                                  NULL, procattr, rp->pool)) != APR_SUCCESS) {
+                                  NULL, procattr, req->pool)) != APR_SUCCESS) {
             apr_file_printf(local_stderr,
                             "Can't spawn postprocess script '%s': %s\n",
                             rp->url[rp->current_url].responsescript,
@@ -1201,7 +2115,7 @@ apr_status_t round_robin_postprocess(profile_t *profile,
             return rv;
         }
 
-        apr_pollset_create(&pollset, 1, rp->pool, 0);
+        apr_pollset_create(&pollset, 1, req->pool, 0);
 
         pipeout.desc_type = APR_POLL_FILE;
         pipeout.reqevents = APR_POLLOUT;
@@ -1210,8 +2124,9 @@ apr_status_t round_robin_postprocess(profile_t *profile,
 
         apr_pollset_add(pollset, &pipeout);
 
+        flood_response_flatten(resp, req->pool);
         wbytes = 0;
-        nbytes = strlen(resp->rbuf);
+        nbytes = resp->rbufsize;
 
         while (wbytes < nbytes) {
 
@@ -1266,18 +2181,13 @@ apr_status_t round_robin_postprocess(profile_t *profile,
 
 apr_status_t verify_200(int *verified, profile_t *profile, request_t *req, response_t *resp)
 {
-    round_robin_profile_t *rp;
-    int res;
-
-    rp = (round_robin_profile_t*) profile;
-
-    res = memcmp(resp->rbuf, "HTTP/1.1 2", 10);
+    flood_parse_status(resp);
 
-    if (!res)
+    /* 2xx from HTTP/1.1 or HTTP/1.0, and 3xx from anything. */
+    if (resp->status >= 200 && resp->status < 300 &&
+        (resp->version == 11 || resp->version == 10))
         *verified = FLOOD_VALID;
-    else if (memcmp(resp->rbuf + 9, "3", 1) == 0) /* Accept 3xx as okay. */
-        *verified = FLOOD_VALID;
-    else if (memcmp(resp->rbuf, "HTTP/1.0 2", 10) == 0) /* HTTP/1.0 is ok. */
+    else if (resp->status >= 300 && resp->status < 400)
         *verified = FLOOD_VALID;
     else
         *verified = FLOOD_INVALID;
@@ -1288,13 +2198,9 @@ apr_status_t verify_200(int *verified, profile_t *profile, request_t *req, respo
 apr_status_t verify_status_code(int *verified, profile_t *profile,
                                 request_t *req, response_t *resp)
 {
-    const char delimiter = ' ';
-    char *state, *protocol, *scode;
-
-    protocol = apr_strtok(resp->rbuf, &delimiter, &state);
-    scode = apr_strtok(NULL, &delimiter, &state);
+    flood_parse_status(resp);
 
-    if (scode[0] == '2' || scode[0] == '3') {
+    if (resp->status >= 200 && resp->status < 400) {
         *verified = FLOOD_VALID;
     }
     else {
@@ -1304,6 +2210,73 @@ apr_status_t verify_status_code(int *verified, profile_t *profile,
     return APR_SUCCESS;
 }
 
+apr_status_t verify_expect(int *verified, profile_t *profile,
+                           request_t *req, response_t *resp)
+{
+    round_robin_profile_t *rp = (round_robin_profile_t*)profile;
+    url_t *url = &rp->url[rp->current_url];
+    response_watch_t *watch;
+    const char *value;
+    apr_size_t len;
+    int i;
+
+    flood_parse_status(resp);
+    *verified = FLOOD_INVALID;
+
+    if (url->expectstatus) {
+        if (!flood_status_listed(url->expectstatus, resp->status))
+            return APR_SUCCESS;
+    }
+    else if (resp->status < 200 || resp->status >= 400) {
+        return APR_SUCCESS;
+    }
+
+    for (i = 0; url->expectheaders && i < url->expectheaders->nelts; i++) {
+        if (!flood_header_get(resp, ((char**)url->expectheaders->elts)[i],
+                              &len))
+            return APR_SUCCESS;
+    }
+
+    /* The right answer, but not the body that should have come with it:
+     * cut short, or some other object's. */
+    watch = req->sink == watch_sink ? (response_watch_t *)req->sinkctx : NULL;
+    if (watch && url->expectlength >= 0) {
+        apr_int64_t length = 0;
+
+        if ((value = flood_header_known(resp, FLOOD_HEADER_CONTENT_LENGTH,
+                                        &len))) {
+            for (i = 0; i < len && apr_isdigit(value[i]); i++)
+                length = length * 10 + value[i] - '0';
+            if (i < len || length != url->expectlength) {
+                *verified = FLOOD_ERR_BODY;
+                return APR_SUCCESS;
+            }
+        }
+        if (watch->body.bodylen != url->expectlength) {
+            *verified = FLOOD_ERR_BODY;
+            return APR_SUCCESS;
+        }
+    }
+    if (watch && url->expectdigest && watch->crc != url->expectcrc) {
+        *verified = FLOOD_ERR_BODY;
+        return APR_SUCCESS;
+    }
+    if (watch && watch->match) {
+        const char *pattern;
+        int rejected;
+
+        if ((pattern = flood_match_failed(watch->match, &rejected))) {
+            apr_file_printf(local_stderr, "Response to %s %s '%s'\n",
+                            req->uri, rejected ? "has" : "lacks", pattern);
+            *verified = FLOOD_ERR_BODY;
+            return APR_SUCCESS;
+        }
+    }
+
+    *verified = FLOOD_VALID;
+    return APR_SUCCESS;
+}
+
 int round_robin_loop_condition(profile_t *profile)
 {
     round_robin_profile_t *rp;
@@ -1360,7 +2333,14 @@ int round_robin_loop_condition(profile_t *profile)
 
 apr_status_t round_robin_profile_destroy(profile_t *profile)
 {
+    round_robin_profile_t *rp = (round_robin_profile_t*)profile;
+
     /* FIXME: free() the memory used by this profile, or reset() the pool
      * (or whatever semantics apr uses, I dunno...) -aaron */
+
+    /* The farmer clears the pool it all came from once we're done. */
+    flood_mem_set(rp->mem, FLOOD_MEM_COOKIES, 0);
+    flood_mem_set(rp->mem, FLOOD_MEM_STATE, 0);
+
     return APR_SUCCESS;
 }
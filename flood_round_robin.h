@@ -24,7 +24,8 @@ apr_status_t round_robin_profile_init(profile_t **profile,
                                       const char *profile_name,
                                       apr_pool_t *pool);
 apr_status_t round_robin_get_next_url(request_t **request,
-                                      profile_t *profile);
+                                      profile_t *profile,
+                                      apr_pool_t *pool);
 apr_status_t round_robin_create_req(profile_t *profile,
                                     request_t *request);
 apr_status_t round_robin_postprocess(profile_t *profile,
@@ -38,6 +39,10 @@ apr_status_t verify_status_code(int *verified,
                                 profile_t *profile,
                                 request_t *req,
                                 response_t *resp);
+apr_status_t verify_expect(int *verified,
+                           profile_t *profile,
+                           request_t *req,
+                           response_t *resp);
 int round_robin_loop_condition(profile_t *profile);
 apr_status_t round_robin_profile_destroy(profile_t *profile);
 
@@ -25,15 +25,28 @@ struct simple_report_t {
     int hit_count;
     int successes;
     int failures;
+    int errors[FLOOD_ERR_MAX];  /* failures, by FLOOD_ERR_* */
+    int early_accepted;
+    int early_rejected;
+    apr_time_t accepted_ttfb;  /* first byte times, summed */
+    apr_time_t rejected_ttfb;
+    int fastopen_used;
+    int fastopen_missed;
+    apr_time_t used_ttfb;
+    apr_time_t missed_ttfb;
 };
 typedef struct simple_report_t simple_report_t;
 
 apr_status_t simple_report_init(report_t **report, config_t *config, const char *profile_name, apr_pool_t *pool)
 {
-    simple_report_t *sr = apr_palloc(pool, sizeof(simple_report_t));
+    simple_report_t *sr = apr_pcalloc(pool, sizeof(simple_report_t));
 
     sr->hit_count = 0;
     sr->successes = 0; sr->failures = 0;
+    sr->early_accepted = 0; sr->early_rejected = 0;
+    sr->accepted_ttfb = 0; sr->rejected_ttfb = 0;
+    sr->fastopen_used = 0; sr->fastopen_missed = 0;
+    sr->used_ttfb = 0; sr->missed_ttfb = 0;
 
     *report = sr;
 
@@ -52,21 +65,74 @@ apr_status_t simple_process_stats(report_t *report, int verified, request_t *req
     } else if (verified == FLOOD_INVALID) {
         sr->failures++;
         apr_file_printf(local_stdout, "FAIL %s\n", req->uri);
+    } else if (verified > FLOOD_INVALID && verified < FLOOD_ERR_MAX) {
+        sr->failures++;
+        sr->errors[verified]++;
+        apr_file_printf(local_stdout, "FAIL %s %s\n",
+                        flood_error_name(verified), req->uri);
     } else {
         apr_file_printf(local_stderr, "simple_process_stats(): Internal Error: 'verified' has invalid value.\n");
     }
 
+    if (req->earlydatastatus == FLOOD_EARLY_DATA_ACCEPTED) {
+        sr->early_accepted++;
+        sr->accepted_ttfb += timer->read - timer->begin;
+    } else if (req->earlydatastatus == FLOOD_EARLY_DATA_REJECTED) {
+        sr->early_rejected++;
+        sr->rejected_ttfb += timer->read - timer->begin;
+    }
+
+    if (req->fastopenstatus == FLOOD_FASTOPEN_USED) {
+        sr->fastopen_used++;
+        sr->used_ttfb += timer->read - timer->begin;
+    } else if (req->fastopenstatus == FLOOD_FASTOPEN_MISSED) {
+        sr->fastopen_missed++;
+        sr->missed_ttfb += timer->read - timer->begin;
+    }
+
     return APR_SUCCESS;
 }
 
 apr_status_t simple_report_stats(report_t *report)
 {
     simple_report_t *sr = (simple_report_t*)report;
+    int i;
 
     apr_file_printf(local_stdout, "Report Follows ------------\n");
     apr_file_printf(local_stdout, " #OK      - %d\n", sr->successes);
     apr_file_printf(local_stdout, " #FAILED  - %d\n", sr->failures);
     apr_file_printf(local_stdout, " Total ---- %d\n", sr->hit_count);
+    for (i = FLOOD_INVALID + 1; i < FLOOD_ERR_MAX; i++) {
+        if (sr->errors[i])
+            apr_file_printf(local_stdout, "  %-16s - %d\n",
+                            flood_error_name(i), sr->errors[i]);
+    }
+    if (sr->early_accepted || sr->early_rejected) {
+        apr_file_printf(local_stdout, " #0-RTT OK       - %d",
+                        sr->early_accepted);
+        if (sr->early_accepted)
+            apr_file_printf(local_stdout, " (avg %" APR_TIME_T_FMT " usec)",
+                            sr->accepted_ttfb / sr->early_accepted);
+        apr_file_printf(local_stdout, "\n #0-RTT REJECTED - %d",
+                        sr->early_rejected);
+        if (sr->early_rejected)
+            apr_file_printf(local_stdout, " (avg %" APR_TIME_T_FMT " usec)",
+                            sr->rejected_ttfb / sr->early_rejected);
+        apr_file_printf(local_stdout, "\n");
+    }
+    if (sr->fastopen_used || sr->fastopen_missed) {
+        apr_file_printf(local_stdout, " #TFO USED       - %d",
+                        sr->fastopen_used);
+        if (sr->fastopen_used)
+            apr_file_printf(local_stdout, " (avg %" APR_TIME_T_FMT " usec)",
+                            sr->used_ttfb / sr->fastopen_used);
+        apr_file_printf(local_stdout, "\n #TFO MISSED     - %d",
+                        sr->fastopen_missed);
+        if (sr->fastopen_missed)
+            apr_file_printf(local_stdout, " (avg %" APR_TIME_T_FMT " usec)",
+                            sr->missed_ttfb / sr->fastopen_missed);
+        apr_file_printf(local_stdout, "\n");
+    }
 
     return APR_SUCCESS;
 }
@@ -34,6 +34,8 @@ typedef struct {
     void *s;
     int wantresponse;   /* A boolean */
     int ssl;            /* A boolean */
+    response_sink_t sink;
+    void *sinkctx;
 } generic_socket_t;
 
 apr_status_t generic_socket_init(socket_t **sock, apr_pool_t *pool)
@@ -83,6 +85,15 @@ apr_status_t generic_begin_conn(socket_t *sock, request_t *req, apr_pool_t *pool
     return APR_SUCCESS;
 }
 
+/**
+ * Generic implementation for warmup_conn.  A connection per request
+ * leaves nothing to keep warm.
+ */
+apr_status_t generic_warmup_conn(socket_t *sock, request_t *req, apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
 /**
  * Generic implementation for send_req.
  */
@@ -90,10 +101,19 @@ apr_status_t generic_send_req(socket_t *sock, request_t *req, apr_pool_t *pool)
 {
     generic_socket_t *gsock = (generic_socket_t *)sock;
     gsock->wantresponse = req->wantresponse;
+    gsock->sink = req->sink;
+    gsock->sinkctx = req->sinkctx;
+    if (gsock->sink)
+        gsock->sink(gsock->sinkctx, NULL, 0);
     return gsock->ssl ? ssl_write_socket(gsock->s, req) :
                         write_socket(gsock->s, req);
 }
 
+/* Did a read bring in any of the response?  A failed one brought
+ * nothing, whatever it left in the length. */
+#define GENERIC_READ_SOME(status, len) \
+    ((len) && ((status) == APR_SUCCESS || (status) == APR_EOF))
+
 /**
  * Generic implementation for recv_resp.
  */
@@ -111,54 +131,57 @@ apr_status_t generic_recv_resp(response_t **resp, socket_t *sock, apr_pool_t *po
 
     if (gsock->wantresponse)
     {
-        /* Ugh, we want everything. */
-        apr_size_t currentalloc;
-        char *cp, *op;
-
-        new_resp->rbufsize = 0;
-        currentalloc = MAX_DOC_LENGTH;
-        new_resp->rbuf = apr_palloc(pool, currentalloc);
-        cp = new_resp->rbuf;
-        do
+        /* Ugh, we want everything.  The first read goes in rbuf, as
+         * below; the rest straight into segments, which are never
+         * moved. */
+        char *cp;
+
+        new_resp->rbufsize = MAX_DOC_LENGTH - 1;
+        new_resp->rbuf = apr_palloc(pool, MAX_DOC_LENGTH);
+        status = gsock->ssl ? ssl_read_socket(gsock->s, new_resp->rbuf,
+                                              &new_resp->rbufsize) :
+                              read_socket(gsock->s, new_resp->rbuf,
+                                          &new_resp->rbufsize);
+        if (gsock->sink && GENERIC_READ_SOME(status, new_resp->rbufsize))
+            gsock->sink(gsock->sinkctx, new_resp->rbuf, new_resp->rbufsize);
+
+        /* Until the server closes the connection, or lets us down. */
+        while (status == APR_SUCCESS)
         {
-            i = MAX_DOC_LENGTH - 1;
-            status = gsock->ssl ? ssl_read_socket(gsock->s, b, &i)
-                                : read_socket(gsock->s, b, &i);
-            if (new_resp->rbufsize + i > currentalloc)
-            {
-                /* You can think why this always work. */
-                currentalloc *= 2;
-                op = new_resp->rbuf;
-                new_resp->rbuf = apr_palloc(pool, currentalloc);
-                memcpy(new_resp->rbuf, op, cp - op);
-                cp = new_resp->rbuf + (cp - op);
-            }
-            
-            memcpy(cp, b, i);
-            new_resp->rbufsize += i;
-            cp += i;
+            cp = flood_response_room(new_resp, &i, pool);
+            status = gsock->ssl ? ssl_read_socket(gsock->s, cp, &i)
+                                : read_socket(gsock->s, cp, &i);
+            if (!GENERIC_READ_SOME(status, i))
+                continue;
+            if (gsock->sink)
+                gsock->sink(gsock->sinkctx, cp, i);
+            flood_response_grow(new_resp, i);
         }
-        while (status != APR_EOF && status != APR_TIMEUP);
     }
     else
     {
         /* We just want to store the first chunk read. */
         new_resp->rbufsize = MAX_DOC_LENGTH - 1;
-        new_resp->rbuf = apr_palloc(pool, new_resp->rbufsize);
+        new_resp->rbuf = apr_palloc(pool, MAX_DOC_LENGTH);
         status = gsock->ssl ? ssl_read_socket(gsock->s, new_resp->rbuf, 
                                               &new_resp->rbufsize) :
                               read_socket(gsock->s, new_resp->rbuf, 
                                           &new_resp->rbufsize);
+        if (gsock->sink && GENERIC_READ_SOME(status, new_resp->rbufsize))
+            gsock->sink(gsock->sinkctx, new_resp->rbuf, new_resp->rbufsize);
 
-        while (status != APR_EOF && status != APR_TIMEUP) {
+        while (status == APR_SUCCESS) {
             i = MAX_DOC_LENGTH - 1;
             status = gsock->ssl ? ssl_read_socket(gsock->s, b, &i) :
                                   read_socket(gsock->s, b, &i);
+            if (gsock->sink && GENERIC_READ_SOME(status, i))
+                gsock->sink(gsock->sinkctx, b, i);
         }
-        if (status != APR_SUCCESS && status != APR_EOF) {
-            return status;
-        }
+    }
 
+    /* A timeout, whichever deadline it was, is the caller's to count. */
+    if (status != APR_EOF) {
+        return status;
     }
 
     *resp = new_resp;
@@ -192,6 +215,10 @@ apr_status_t generic_fullresp_recv_resp(response_t **resp,
 apr_status_t generic_end_conn(socket_t *sock, request_t *req, response_t *resp)
 {
     generic_socket_t *gsock = (generic_socket_t *)sock;
+
+    if (!gsock->ssl)
+        req->fastopenstatus = fastopen_status(gsock->s);
+
     gsock->ssl ? ssl_close_socket(gsock->s) : close_socket(gsock->s);
     return APR_SUCCESS;
 }
@@ -0,0 +1,1108 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+/* HTTP/2 socket group.
+ *
+ * Every farmer still runs one request at a time, but farmers talking to
+ * the same server share connections: each connection carries up to
+ * <maxstreams> requests as concurrent streams.  Whichever farmer finds
+ * nobody reading the connection does the reading for everybody, and the
+ * others sleep until their stream is complete.  Each farmer waits only
+ * as long as its own request's timeouts allow, and then cancels just its
+ * own stream.  All I/O on a connection happens under its lock, except for
+ * the wait for the socket to become readable, so writes from other
+ * farmers can go out meanwhile.
+ */
+
+#include <apr.h>
+#include <apr_strings.h>
+#include <apr_hash.h>
+#include <apr_lib.h>
+#include <apr_file_io.h>
+
+#if APR_HAS_THREADS
+#include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
+#endif
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "config.h"
+#include "flood_net.h"
+#include "flood_net_ssl.h"
+#include "flood_mem.h"
+#include "flood_socket_h2.h"
+
+extern apr_file_t *local_stderr;
+
+static void h2_add_field(h2_field_t *fields, int *n, const char *name,
+                         const char *value)
+{
+    fields[*n].name = name;
+    fields[*n].value = value;
+    (*n)++;
+}
+
+/* The profile wrote an HTTP/1.1 request.  Take it apart again, so that
+ * request templates, extra headers, cookies and authentication carry
+ * over to h2 and h3 unchanged. */
+apr_status_t h2_split_req(h2_field_t **fields, int *nfields,
+                          const char **body, apr_size_t *bodylen,
+                          request_t *req, apr_pool_t *pool)
+{
+    char *head, *end, *line, *eol, *sp, *colon, *p;
+    const char *method, *path, *authority;
+    h2_field_t *f;
+    int n = 0, lines = 0, slot;
+
+    head = apr_pstrmemdup(pool, req->rbuf, req->rbufsize);
+    end = strstr(head, CRLF CRLF);
+    if (!end)
+        return APR_EGENERAL;
+
+    *body = (const char *)req->rbuf + (end - head) + 4;
+    *bodylen = req->rbufsize - ((end - head) + 4);
+    end[2] = '\0';
+
+    for (p = head; (p = strstr(p, CRLF)); p += 2)
+        lines++;
+    f = apr_palloc(pool, (lines + 4) * sizeof(h2_field_t));
+
+    /* Request-Line */
+    eol = strstr(head, CRLF);
+    *eol = '\0';
+    method = head;
+    if (!(sp = strchr(head, ' ')))
+        return APR_EGENERAL;
+    *sp++ = '\0';
+    path = sp;
+    if ((sp = strchr(sp, ' ')))
+        *sp = '\0';
+
+    /* An absolute URI is only meant for a proxy. */
+    if (*path != '/') {
+        path = apr_pstrcat(pool,
+                           req->parsed_uri->path ? req->parsed_uri->path : "/",
+                           req->parsed_uri->query ? "?" : "",
+                           req->parsed_uri->query ? req->parsed_uri->query : "",
+                           NULL);
+    }
+
+    /* Pseudo-headers come first; :authority is filled in below. */
+    h2_add_field(f, &n, ":method", method);
+    h2_add_field(f, &n, ":scheme", req->parsed_uri->scheme);
+    slot = n++;
+    h2_add_field(f, &n, ":path", path);
+    authority = req->parsed_uri->hostinfo;
+
+    for (line = eol + 2; (eol = strstr(line, CRLF)); line = eol + 2) {
+        *eol = '\0';
+        if (!(colon = strchr(line, ':')))
+            continue;
+        *colon++ = '\0';
+        while (*colon == ' ' || *colon == '\t')
+            colon++;
+
+        if (!strcasecmp(line, "Host")) {
+            authority = colon;
+            continue;
+        }
+        /* Connection-specific headers are not allowed any more. */
+        if (!strcasecmp(line, "Connection") ||
+            !strcasecmp(line, "Keep-Alive") ||
+            !strcasecmp(line, "Proxy-Connection") ||
+            !strcasecmp(line, "Transfer-Encoding") ||
+            !strcasecmp(line, "Upgrade") ||
+            !strcasecmp(line, "TE")) {
+            continue;
+        }
+
+        /* Field names must be lowercase. */
+        for (p = line; *p; p++)
+            *p = apr_tolower(*p);
+        h2_add_field(f, &n, line, colon);
+    }
+
+    h2_add_field(f, &slot, ":authority", authority);
+
+    *fields = f;
+    *nfields = n;
+    return APR_SUCCESS;
+}
+
+/* Render a response as HTTP/1.1 text, so that the verifiers, the
+ * response templates and the reports all work as they do for the other
+ * socket groups.  The status line and the headers go in rbuf; the body
+ * stays in the segments it was received into. */
+response_t *h2_build_resp(const char *status, apr_table_t *headers,
+                          response_t *new_resp, apr_pool_t *pool)
+{
+    const apr_array_header_t *arr;
+    const apr_table_entry_t *elts;
+    apr_size_t len;
+    char *cp;
+    int i;
+
+    arr = apr_table_elts(headers);
+    elts = (const apr_table_entry_t *)arr->elts;
+
+    len = sizeof("HTTP/1.1 " CRLF CRLF) + strlen(status);
+    for (i = 0; i < arr->nelts; i++)
+        len += strlen(elts[i].key) + strlen(elts[i].val) + 4;
+
+    new_resp->rbuftype = POOL;
+    new_resp->rbuf = cp = apr_palloc(pool, len);
+    new_resp->keepalive = 1;
+
+    cp = apr_cpystrn(cp, "HTTP/1.1 ", len);
+    cp = apr_cpystrn(cp, status, len);
+    cp = apr_cpystrn(cp, CRLF, len);
+    for (i = 0; i < arr->nelts; i++) {
+        cp = apr_cpystrn(cp, elts[i].key, len);
+        cp = apr_cpystrn(cp, ": ", len);
+        cp = apr_cpystrn(cp, elts[i].val, len);
+        cp = apr_cpystrn(cp, CRLF, len);
+    }
+    cp = apr_cpystrn(cp, CRLF, len);
+    new_resp->rbufsize = cp - new_resp->rbuf;
+
+    return new_resp;
+}
+
+#if FLOOD_HAS_NGHTTP2
+
+#include <nghttp2/nghttp2.h>
+
+/* Flow control windows we grant the server.  The protocol default of
+ * 64k would make the test measure our window updates. */
+#define H2_STREAM_WINDOW (1 << 24)
+#define H2_CONN_WINDOW (1 << 30)
+
+#define h2_read_socket(c, buf, lenaddr) \
+    c->ssl ? ssl_read_socket(c->s, buf, lenaddr) : \
+             read_socket(c->s, buf, lenaddr)
+
+#define h2_write_socket(c, req) \
+    c->ssl ? ssl_write_socket(c->s, req) : \
+             write_socket(c->s, req)
+
+#define h2_close_socket(c) \
+    c->ssl ? ssl_close_socket(c->s) : \
+             close_socket(c->s)
+
+typedef struct h2_server_t h2_server_t;
+typedef struct h2_conn_t h2_conn_t;
+typedef struct h2_stream_t h2_stream_t;
+
+/* Connections to one scheme://host:port. */
+struct h2_server_t {
+    h2_conn_t *conns;
+};
+
+struct h2_conn_t {
+    apr_pool_t *pool;
+    h2_server_t *server;
+    h2_conn_t *next;          /* other connections to the same server */
+    void *s;
+    int ssl;                  /* A boolean */
+    int alpn_checked;         /* A boolean */
+    nghttp2_session *session;
+    int maxstreams;
+    int streams;              /* slots handed out, under h2_servers_lock */
+    h2_stream_t *open;        /* streams still waiting for a response */
+    int reading;              /* A boolean: someone is reading for us all */
+    int dead;                 /* A boolean: no new streams, close when idle */
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;
+#endif
+};
+
+/* A request in flight.  It comes from the pool of the farmer that sent
+ * it; other farmers only touch it with the connection locked.  Whoever
+ * reads for the connection never allocates from the owner's pools: what
+ * it reads goes in the inbox, which is on an allocator of its own, and
+ * the owner takes it from there into its own pool. */
+struct h2_stream_t {
+    int32_t id;
+    h2_stream_t *next;
+    apr_pool_t *pool;         /* the owner's */
+    const char *body;         /* request body not yet sent */
+    apr_size_t bodylen;
+    int wantresponse;         /* A boolean: read the body into the inbox */
+    int keep;                 /* A boolean: and then into the response */
+    response_sink_t sink;
+    void *sinkctx;
+    /* Filled in by the reader, from the inbox. */
+    apr_pool_t *inbox;
+    const char *status;
+    apr_table_t *headers;
+    int headersdone;          /* A boolean: the final header block is in */
+    response_t in;            /* body not yet taken, in segments */
+    /* The owner's. */
+    response_t *resp;
+    apr_time_t firstbyte;
+    /* The request's timeouts, as for flood_socket_t; heard is when the
+     * reader last got something for us. */
+    apr_time_t deadline;
+    apr_time_t firstbytedue;
+    apr_interval_time_t wait;
+    apr_time_t heard;
+    int done;                 /* A boolean */
+    apr_status_t rv;
+};
+
+typedef struct {
+    h2_conn_t *conn;
+    h2_stream_t *stream;
+    apr_pool_t *inbox;        /* for each stream of ours in turn */
+} h2_socket_t;
+
+static apr_pool_t *h2_pool;
+static apr_hash_t *h2_servers;
+
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *h2_servers_lock;
+#endif
+
+static void h2_servers_lock_acquire(void)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(h2_servers_lock);
+#endif
+}
+
+static void h2_servers_lock_release(void)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(h2_servers_lock);
+#endif
+}
+
+static void h2_conn_lock(h2_conn_t *c)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(c->lock);
+#endif
+}
+
+static void h2_conn_unlock(h2_conn_t *c)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(c->lock);
+#endif
+}
+
+static void h2_conn_timedwait(h2_conn_t *c, apr_interval_time_t t)
+{
+#if APR_HAS_THREADS
+    apr_thread_cond_timedwait(c->cond, c->lock, t);
+#endif
+}
+
+static void h2_conn_wake(h2_conn_t *c)
+{
+#if APR_HAS_THREADS
+    apr_thread_cond_broadcast(c->cond);
+#endif
+}
+
+static void h2_stream_done(h2_conn_t *c, h2_stream_t *st)
+{
+    h2_stream_t **sp;
+
+    for (sp = &c->open; *sp; sp = &(*sp)->next) {
+        if (*sp == st) {
+            *sp = st->next;
+            break;
+        }
+    }
+    st->done = 1;
+}
+
+/* The connection is unusable; fail everything still open on it. */
+static void h2_conn_fail(h2_conn_t *c, apr_status_t rv)
+{
+    h2_stream_t *st;
+
+    c->dead = 1;
+    for (st = c->open; st; st = st->next) {
+        st->done = 1;
+        st->rv = rv;
+    }
+    c->open = NULL;
+    h2_conn_wake(c);
+}
+
+static int h2_on_begin_headers(nghttp2_session *session,
+                               const nghttp2_frame *frame, void *user_data)
+{
+    h2_stream_t *st;
+
+    if (frame->hd.type != NGHTTP2_HEADERS)
+        return 0;
+
+    st = nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
+    if (st) {
+        st->heard = apr_time_now();
+        if (!st->firstbyte)
+            st->firstbyte = st->heard;
+    }
+
+    return 0;
+}
+
+static int h2_on_header(nghttp2_session *session, const nghttp2_frame *frame,
+                        const uint8_t *name, size_t namelen,
+                        const uint8_t *value, size_t valuelen,
+                        uint8_t flags, void *user_data)
+{
+    h2_stream_t *st;
+
+    if (frame->hd.type != NGHTTP2_HEADERS)
+        return 0;
+
+    /* Trailers come after the owner has taken the headers. */
+    st = nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
+    if (!st || st->headersdone)
+        return 0;
+
+    if (namelen == sizeof(":status") - 1 &&
+        memcmp(name, ":status", namelen) == 0) {
+        /* :status starts every header block; an interim 1xx response
+         * is followed by the real one, so start over. */
+        st->status = apr_pstrmemdup(st->inbox, (const char *)value, valuelen);
+        apr_table_clear(st->headers);
+    }
+    else {
+        apr_table_addn(st->headers,
+                       apr_pstrmemdup(st->inbox, (const char *)name, namelen),
+                       apr_pstrmemdup(st->inbox, (const char *)value, valuelen));
+    }
+
+    return 0;
+}
+
+static int h2_on_data_chunk(nghttp2_session *session, uint8_t flags,
+                            int32_t stream_id, const uint8_t *data,
+                            size_t len, void *user_data)
+{
+    h2_stream_t *st;
+    apr_size_t room;
+    char *cp;
+
+    st = nghttp2_session_get_stream_user_data(session, stream_id);
+    if (!st)
+        return 0;
+
+    st->heard = apr_time_now();
+    if (!st->wantresponse)
+        return 0;
+
+    while (len) {
+        cp = flood_response_room(&st->in, &room, st->inbox);
+        if (room > len)
+            room = len;
+        memcpy(cp, data, room);
+        flood_response_grow(&st->in, room);
+        data += room;
+        len -= room;
+    }
+
+    return 0;
+}
+
+static int h2_on_stream_close(nghttp2_session *session, int32_t stream_id,
+                              uint32_t error_code, void *user_data)
+{
+    h2_conn_t *c = user_data;
+    h2_stream_t *st;
+
+    st = nghttp2_session_get_stream_user_data(session, stream_id);
+    if (!st)
+        return 0;
+
+    if (error_code != NGHTTP2_NO_ERROR) {
+        apr_file_printf(local_stderr, "h2 stream %d closed: %s.\n",
+                        stream_id, nghttp2_http2_strerror(error_code));
+        st->rv = APR_EGENERAL;
+    }
+    h2_stream_done(c, st);
+
+    return 0;
+}
+
+static int h2_on_frame_recv(nghttp2_session *session,
+                            const nghttp2_frame *frame, void *user_data)
+{
+    h2_conn_t *c = user_data;
+    h2_stream_t *st;
+
+    /* Streams the server won't process are closed for us by nghttp2;
+     * we only have to stop starting new ones. */
+    if (frame->hd.type == NGHTTP2_GOAWAY)
+        c->dead = 1;
+
+    /* A header block that isn't an interim 1xx one is the response's. */
+    if (frame->hd.type == NGHTTP2_HEADERS) {
+        st = nghttp2_session_get_stream_user_data(session,
+                                                  frame->hd.stream_id);
+        if (st && st->status && st->status[0] != '1')
+            st->headersdone = 1;
+    }
+
+    return 0;
+}
+
+static ssize_t h2_read_body(nghttp2_session *session, int32_t stream_id,
+                            uint8_t *buf, size_t length, uint32_t *data_flags,
+                            nghttp2_data_source *source, void *user_data)
+{
+    h2_stream_t *st = source->ptr;
+    apr_size_t len;
+
+    len = st->bodylen < length ? st->bodylen : length;
+    memcpy(buf, st->body, len);
+    st->body += len;
+    st->bodylen -= len;
+
+    if (!st->bodylen)
+        *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+
+    return len;
+}
+
+/* Take what has been read for st out of its inbox: show it to the
+ * request's sink, copy it into the owner's pool if the body is wanted,
+ * and empty the inbox.  Call with c locked, from the owner. */
+static void h2_stream_take(h2_stream_t *st)
+{
+    flood_seg_t *seg;
+    apr_size_t room, off, n;
+    char *cp;
+
+    /* Until the headers are in, the inbox holds nothing else. */
+    if (!st->headersdone)
+        return;
+
+    if (!st->resp->rbuf) {
+        h2_build_resp(st->status, st->headers, st->resp, st->pool);
+        if (st->sink)
+            st->sink(st->sinkctx, st->resp->rbuf, st->resp->rbufsize);
+    }
+
+    for (seg = st->in.seg; seg; seg = seg->next) {
+        if (st->sink)
+            st->sink(st->sinkctx, seg->data, seg->len);
+        for (off = 0; st->keep && off < seg->len; off += n) {
+            cp = flood_response_room(st->resp, &room, st->pool);
+            n = seg->len - off < room ? seg->len - off : room;
+            memcpy(cp, seg->data + off, n);
+            flood_response_grow(st->resp, n);
+        }
+    }
+
+    st->in.seg = st->in.lastseg = NULL;
+    st->in.seglen = 0;
+    st->status = NULL;
+    st->headers = NULL;
+    apr_pool_clear(st->inbox);
+}
+
+/* Write whatever nghttp2 has queued.  Frames are small, so gather them
+ * up rather than paying a syscall for each one.  Call with c locked. */
+static apr_status_t h2_conn_flush(h2_conn_t *c)
+{
+    char out[FLOOD_IOBUF];
+    const uint8_t *data;
+    apr_size_t outlen = 0;
+    ssize_t len;
+    request_t r;
+    apr_status_t rv = APR_SUCCESS;
+
+    /* The socket layer writes requests; lend it our buffers. */
+    memset(&r, 0, sizeof(r));
+
+    while ((len = nghttp2_session_mem_send(c->session, &data)) > 0) {
+        if (outlen + len > sizeof(out) && outlen) {
+            r.rbuf = out;
+            r.rbufsize = outlen;
+            if ((rv = h2_write_socket(c, &r)) != APR_SUCCESS)
+                return rv;
+            outlen = 0;
+        }
+        if (len > sizeof(out)) {
+            r.rbuf = (void *)data;
+            r.rbufsize = len;
+            if ((rv = h2_write_socket(c, &r)) != APR_SUCCESS)
+                return rv;
+        }
+        else {
+            memcpy(out + outlen, data, len);
+            outlen += len;
+        }
+    }
+
+    if (len < 0) {
+        apr_file_printf(local_stderr, "h2 send failed: %s.\n",
+                        nghttp2_strerror(len));
+        return APR_EGENERAL;
+    }
+
+    if (outlen) {
+        r.rbuf = out;
+        r.rbufsize = outlen;
+        rv = h2_write_socket(c, &r);
+    }
+
+    return rv;
+}
+
+/* How long we may go on waiting for st, and what to report if that
+ * runs out; deadline_wait() for a stream.  Call with c locked. */
+static apr_interval_time_t h2_stream_wait(h2_stream_t *st,
+                                          apr_status_t *expired)
+{
+    apr_interval_time_t t;
+    apr_time_t now = apr_time_now();
+
+    t = st->heard + st->wait - now;
+    *expired = APR_TIMEUP;
+    if (!st->firstbyte && st->firstbytedue &&
+        st->firstbytedue - now < t) {
+        t = st->firstbytedue - now;
+        *expired = FLOOD_EFIRSTBYTE;
+    }
+    if (st->deadline && st->deadline - now < t) {
+        t = st->deadline - now;
+        *expired = FLOOD_ETOTALTIME;
+    }
+
+    return t;
+}
+
+/* We have given up on st: reset it, leaving the rest of the connection
+ * alone.  Call with c locked. */
+static void h2_stream_cancel(h2_conn_t *c, h2_stream_t *st, apr_status_t rv)
+{
+    apr_status_t frv;
+
+    nghttp2_submit_rst_stream(c->session, NGHTTP2_FLAG_NONE, st->id,
+                              NGHTTP2_CANCEL);
+    /* Whatever still comes for it is dropped. */
+    nghttp2_session_set_stream_user_data(c->session, st->id, NULL);
+    h2_stream_done(c, st);
+    st->rv = rv;
+
+    if ((frv = h2_conn_flush(c)) != APR_SUCCESS)
+        h2_conn_fail(c, frv);
+}
+
+/* Read one batch of frames off the connection on behalf of every stream
+ * open on it, waiting for them no longer than t.  Nothing arriving in
+ * that time is for the streams to judge, not the connection.  Call with
+ * c locked and nobody else reading. */
+static void h2_conn_pump(h2_conn_t *c, apr_interval_time_t t)
+{
+    char buf[FLOOD_IOBUF];
+    flood_socket_t *fs;
+    apr_size_t len;
+    apr_int32_t socketsRead;
+    apr_status_t rv;
+    ssize_t n;
+    int quiet = 0;            /* A boolean: nothing came in time */
+
+    c->reading = 1;
+
+    fs = c->ssl ? ssl_get_socket(c->s) : c->s;
+
+    /* Let the others write while we wait. */
+    if (!c->ssl || !ssl_pending_socket(c->s)) {
+        h2_conn_unlock(c);
+        rv = apr_poll(&fs->read_pollset, 1, &socketsRead, t);
+        h2_conn_lock(c);
+        if (APR_STATUS_IS_TIMEUP(rv) ||
+            (rv == APR_SUCCESS && socketsRead != 1)) {
+            quiet = 1;
+        }
+    }
+    else {
+        rv = APR_SUCCESS;
+    }
+
+    while (rv == APR_SUCCESS && !quiet) {
+        len = sizeof(buf);
+        if (c->ssl && ssl_pending_socket(c->s) &&
+            ssl_pending_socket(c->s) < len) {
+            len = ssl_pending_socket(c->s);
+        }
+
+        rv = h2_read_socket(c, buf, &len);
+        if (rv != APR_SUCCESS && (rv != APR_EOF || !len))
+            break;
+
+        if (c->ssl && !c->alpn_checked) {
+            const char *proto = ssl_get_alpn(c->s, c->pool);
+
+            c->alpn_checked = 1;
+            if (!proto || strcmp(proto, "h2") != 0) {
+                apr_file_printf(local_stderr,
+                                "Server did not agree to speak h2.\n");
+                rv = APR_ENOTIMPL;
+                break;
+            }
+        }
+
+        n = nghttp2_session_mem_recv(c->session, (const uint8_t *)buf, len);
+        if (n < 0) {
+            apr_file_printf(local_stderr, "h2 receive failed: %s.\n",
+                            nghttp2_strerror(n));
+            rv = APR_EGENERAL;
+            break;
+        }
+
+        /* Don't wait on the socket for what OpenSSL already has. */
+        if (rv != APR_SUCCESS || !c->ssl || !ssl_pending_socket(c->s))
+            break;
+    }
+
+    /* Acknowledge settings, update windows, reset what others gave up on
+     * meanwhile and so on. */
+    if (rv == APR_SUCCESS || quiet)
+        rv = h2_conn_flush(c);
+
+    c->reading = 0;
+
+    if (rv != APR_SUCCESS)
+        h2_conn_fail(c, rv);
+    else
+        h2_conn_wake(c);
+}
+
+static void h2_conn_close(h2_conn_t *c)
+{
+    if (c->s)
+        h2_close_socket(c);
+    if (c->session)
+        nghttp2_session_del(c->session);
+
+    h2_servers_lock_acquire();
+    apr_pool_destroy(c->pool);
+    h2_servers_lock_release();
+}
+
+static apr_status_t h2_conn_open(h2_conn_t **conn, request_t *req)
+{
+    apr_pool_t *pool;
+    h2_conn_t *c;
+    request_t r;
+    nghttp2_session_callbacks *callbacks;
+    nghttp2_settings_entry settings[2];
+    apr_status_t rv;
+
+    h2_servers_lock_acquire();
+    apr_pool_create(&pool, h2_pool);
+    h2_servers_lock_release();
+
+    c = apr_pcalloc(pool, sizeof(h2_conn_t));
+    c->pool = pool;
+    c->maxstreams = req->maxstreams > 0 ? req->maxstreams
+                                        : FLOOD_H2_MAX_STREAMS;
+
+    /* Offer h2 with ALPN, and keep our connection preface out of the
+     * early data.  We poll the descriptor ourselves, so no io_uring or
+     * Fast Open. */
+    r = *req;
+    r.alpn = "\x02h2";
+    r.earlydata = 0;
+    r.iouring = 0;
+    r.fastopen = 0;
+
+    if (strcasecmp(req->parsed_uri->scheme, "https") == 0) {
+#if FLOOD_HAS_OPENSSL
+        c->ssl = 1;
+        c->s = ssl_open_socket(pool, &r, &rv);
+#else
+        rv = APR_ENOTIMPL;
+#endif
+    }
+    else {
+        /* h2c with prior knowledge; there is no Upgrade dance. */
+        c->s = open_socket(pool, &r, &rv);
+    }
+
+    if (c->s == NULL) {
+        req->error = r.error;
+        h2_conn_close(c);
+        return rv;
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_create(&c->lock, APR_THREAD_MUTEX_DEFAULT, pool);
+    apr_thread_cond_create(&c->cond, pool);
+#endif
+
+    nghttp2_session_callbacks_new(&callbacks);
+    nghttp2_session_callbacks_set_on_begin_headers_callback(callbacks,
+                                                        h2_on_begin_headers);
+    nghttp2_session_callbacks_set_on_header_callback(callbacks, h2_on_header);
+    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks,
+                                                        h2_on_data_chunk);
+    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks,
+                                                        h2_on_stream_close);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks,
+                                                        h2_on_frame_recv);
+    nghttp2_session_client_new(&c->session, callbacks, c);
+    nghttp2_session_callbacks_del(callbacks);
+
+    settings[0].settings_id = NGHTTP2_SETTINGS_ENABLE_PUSH;
+    settings[0].value = 0;
+    settings[1].settings_id = NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE;
+    settings[1].value = H2_STREAM_WINDOW;
+    nghttp2_submit_settings(c->session, NGHTTP2_FLAG_NONE, settings, 2);
+    nghttp2_submit_window_update(c->session, NGHTTP2_FLAG_NONE, 0,
+                                 H2_CONN_WINDOW - 65535);
+
+    /* Nobody else knows about us yet, so this needs no lock.  Over TLS,
+     * this also completes the handshake. */
+    if ((rv = h2_conn_flush(c)) != APR_SUCCESS) {
+        h2_conn_close(c);
+        return rv;
+    }
+
+    *conn = c;
+    return APR_SUCCESS;
+}
+
+/* Give back our stream slot, and close the connection if it is dead and
+ * we were the last one on it. */
+static void h2_release(h2_socket_t *hsock)
+{
+    h2_conn_t *c = hsock->conn, **cp;
+    int close = 0;
+
+    if (!c)
+        return;
+
+    h2_servers_lock_acquire();
+    c->streams--;
+    if (c->dead && !c->streams) {
+        for (cp = &c->server->conns; *cp; cp = &(*cp)->next) {
+            if (*cp == c) {
+                *cp = c->next;
+                break;
+            }
+        }
+        close = 1;
+    }
+    h2_servers_lock_release();
+
+    if (close)
+        h2_conn_close(c);
+
+    hsock->conn = NULL;
+    hsock->stream = NULL;
+}
+
+/* nghttp2 wants its own header representation. */
+static nghttp2_nv *h2_make_nv(h2_field_t *fields, int nfields,
+                              apr_pool_t *pool)
+{
+    nghttp2_nv *nv;
+    int i;
+
+    nv = apr_palloc(pool, nfields * sizeof(nghttp2_nv));
+    for (i = 0; i < nfields; i++) {
+        nv[i].name = (uint8_t *)fields[i].name;
+        nv[i].namelen = strlen(fields[i].name);
+        nv[i].value = (uint8_t *)fields[i].value;
+        nv[i].valuelen = strlen(fields[i].value);
+        nv[i].flags = NGHTTP2_NV_FLAG_NONE;
+    }
+
+    return nv;
+}
+
+apr_status_t h2_init_socket(apr_pool_t *pool)
+{
+    apr_pool_create(&h2_pool, pool);
+    h2_servers = apr_hash_make(h2_pool);
+#if APR_HAS_THREADS
+    apr_thread_mutex_create(&h2_servers_lock, APR_THREAD_MUTEX_DEFAULT,
+                            h2_pool);
+#endif
+    return APR_SUCCESS;
+}
+
+static apr_status_t h2_inbox_cleanup(void *data)
+{
+    apr_pool_destroy((apr_pool_t *)data);
+    return APR_SUCCESS;
+}
+
+/**
+ * HTTP/2 implementation for socket_init.
+ */
+apr_status_t h2_socket_init(socket_t **sock, apr_pool_t *pool)
+{
+    h2_socket_t *new_hsock;
+    apr_status_t rv;
+
+    new_hsock = (h2_socket_t *)apr_pcalloc(pool, sizeof(h2_socket_t));
+    if (new_hsock == NULL)
+        return APR_ENOMEM;
+
+    /* The inbox is filled by whichever farmer reads for the connection,
+     * so it can't share our farmer's allocator.  It is only ever used
+     * with the connection locked. */
+    if ((rv = flood_mem_pool_create(&new_hsock->inbox)) != APR_SUCCESS)
+        return rv;
+    apr_pool_cleanup_register(pool, new_hsock->inbox, h2_inbox_cleanup,
+                              apr_pool_cleanup_null);
+
+    *sock = new_hsock;
+    return APR_SUCCESS;
+}
+
+/**
+ * HTTP/2 implementation for begin_conn.
+ */
+apr_status_t h2_begin_conn(socket_t *sock, request_t *req, apr_pool_t *pool)
+{
+    h2_socket_t *hsock = (h2_socket_t *)sock;
+    h2_server_t *server;
+    h2_conn_t *c;
+    const char *key;
+    apr_status_t rv;
+
+    if (req->parsed_proxy_uri) {
+        apr_file_printf(local_stderr,
+                        "The h2 socket group does not support proxies.\n");
+        return APR_ENOTIMPL;
+    }
+
+    key = apr_psprintf(pool, "%s://%s:%d%s", req->parsed_uri->scheme,
+                       req->parsed_uri->hostname, req->parsed_uri->port,
+                       req->unixsocket ? req->unixsocket : "");
+
+    /* Look for a connection to this server with a stream to spare. */
+    h2_servers_lock_acquire();
+    server = apr_hash_get(h2_servers, key, APR_HASH_KEY_STRING);
+    if (!server) {
+        server = apr_pcalloc(h2_pool, sizeof(h2_server_t));
+        apr_hash_set(h2_servers, apr_pstrdup(h2_pool, key),
+                     APR_HASH_KEY_STRING, server);
+    }
+    for (c = server->conns; c; c = c->next) {
+        if (!c->dead && c->streams < c->maxstreams) {
+            c->streams++;
+            break;
+        }
+    }
+    h2_servers_lock_release();
+
+    if (!c) {
+        /* Connect without holding up everybody else. */
+        if ((rv = h2_conn_open(&c, req)) != APR_SUCCESS)
+            return rv;
+
+        h2_servers_lock_acquire();
+        c->server = server;
+        c->streams = 1;
+        c->next = server->conns;
+        server->conns = c;
+        h2_servers_lock_release();
+    }
+
+    hsock->conn = c;
+    req->keepalive = 1;
+    return APR_SUCCESS;
+}
+
+/**
+ * HTTP/2 implementation for send_req.
+ */
+apr_status_t h2_send_req(socket_t *sock, request_t *req, apr_pool_t *pool)
+{
+    h2_socket_t *hsock = (h2_socket_t *)sock;
+    h2_conn_t *c = hsock->conn;
+    h2_stream_t *st;
+    h2_field_t *fields;
+    nghttp2_data_provider body;
+    int nfields;
+    apr_status_t rv;
+
+    /* Our last stream is over, and nobody reads for it any more. */
+    apr_pool_clear(hsock->inbox);
+
+    st = apr_pcalloc(pool, sizeof(h2_stream_t));
+    st->pool = pool;
+    /* A sink sees the body as it comes, so only keep it if asked to. */
+    st->keep = req->wantresponse;
+    st->sink = req->sink;
+    st->sinkctx = req->sinkctx;
+    st->wantresponse = st->keep || st->sink;
+    if (st->sink)
+        st->sink(st->sinkctx, NULL, 0);
+    st->inbox = hsock->inbox;
+    st->headers = apr_table_make(st->inbox, 25);
+    st->resp = apr_pcalloc(pool, sizeof(response_t));
+    st->deadline = req->deadline;
+    st->heard = apr_time_now();
+    st->firstbytedue = req->timeouts.firstbyte ?
+                       st->heard + req->timeouts.firstbyte : 0;
+    st->wait = req->timeouts.idle ? req->timeouts.idle : LOCAL_SOCKET_TIMEOUT;
+
+    if ((rv = h2_split_req(&fields, &nfields, &st->body, &st->bodylen,
+                           req, pool)) != APR_SUCCESS) {
+        h2_release(hsock);
+        return rv;
+    }
+
+    body.source.ptr = st;
+    body.read_callback = h2_read_body;
+
+    h2_conn_lock(c);
+    st->id = nghttp2_submit_request(c->session, NULL,
+                                    h2_make_nv(fields, nfields, pool), nfields,
+                                    st->bodylen ? &body : NULL, st);
+    if (st->id < 0) {
+        apr_file_printf(local_stderr, "h2 request failed: %s.\n",
+                        nghttp2_strerror(st->id));
+        rv = APR_EGENERAL;
+    }
+    else {
+        st->next = c->open;
+        c->open = st;
+        if ((rv = h2_conn_flush(c)) != APR_SUCCESS)
+            h2_conn_fail(c, rv);
+    }
+    h2_conn_unlock(c);
+
+    if (rv != APR_SUCCESS) {
+        h2_release(hsock);
+        return rv;
+    }
+
+    hsock->stream = st;
+    return APR_SUCCESS;
+}
+
+/**
+ * HTTP/2 implementation for recv_resp.
+ */
+apr_status_t h2_recv_resp(response_t **resp, socket_t *sock, apr_pool_t *pool)
+{
+    h2_socket_t *hsock = (h2_socket_t *)sock;
+    h2_conn_t *c = hsock->conn;
+    h2_stream_t *st = hsock->stream;
+    apr_interval_time_t t;
+    apr_status_t rv, expired;
+
+    h2_conn_lock(c);
+    for (;;) {
+        h2_stream_take(st);
+        if (st->done)
+            break;
+        if ((t = h2_stream_wait(st, &expired)) <= 0) {
+            h2_stream_cancel(c, st, expired);
+            break;
+        }
+        if (c->reading)
+            h2_conn_timedwait(c, t);
+        else
+            h2_conn_pump(c, t);
+    }
+    h2_conn_unlock(c);
+
+    rv = st->rv;
+    if (rv == APR_SUCCESS && !st->resp->rbuf)
+        rv = APR_EGENERAL;
+
+    if (rv != APR_SUCCESS) {
+        h2_release(hsock);
+        return rv;
+    }
+
+    *resp = st->resp;
+    (*resp)->firstbyte = st->firstbyte;
+    return APR_SUCCESS;
+}
+
+/**
+ * HTTP/2 implementation for end_conn.
+ */
+apr_status_t h2_end_conn(socket_t *sock, request_t *req, response_t *resp)
+{
+    h2_release((h2_socket_t *)sock);
+    return APR_SUCCESS;
+}
+
+/**
+ * HTTP/2 implementation for socket_destroy.
+ */
+apr_status_t h2_socket_destroy(socket_t *sock)
+{
+    return APR_SUCCESS;
+}
+
+#else /* FLOOD_HAS_NGHTTP2 */
+
+apr_status_t h2_init_socket(apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+apr_status_t h2_socket_init(socket_t **sock, apr_pool_t *pool)
+{
+    apr_file_printf(local_stderr,
+                    "flood was built without HTTP/2 support.\n");
+    return APR_ENOTIMPL;
+}
+
+apr_status_t h2_begin_conn(socket_t *sock, request_t *req, apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+apr_status_t h2_send_req(socket_t *sock, request_t *req, apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+apr_status_t h2_recv_resp(response_t **resp, socket_t *sock, apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+apr_status_t h2_end_conn(socket_t *sock, request_t *req, response_t *resp)
+{
+    return APR_ENOTIMPL;
+}
+
+apr_status_t h2_socket_destroy(socket_t *sock)
+{
+    return APR_ENOTIMPL;
+}
+
+#endif /* FLOOD_HAS_NGHTTP2 */
@@ -0,0 +1,1258 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+/* HTTP/3 socket group, on top of quiche.
+ *
+ * Connections are shared the way the h2 group shares them: farmers
+ * talking to the same server send their requests as concurrent streams
+ * on one QUIC connection, up to <maxstreams> of them.  Whichever farmer
+ * finds nobody reading the connection does the reading (and quiche's
+ * timers) for everybody, and the others sleep until their stream is
+ * complete or their request's timeouts run out, when they cancel just
+ * their own stream.  All I/O on a connection happens under its lock,
+ * except for the wait for a datagram.  The farmer that opens a
+ * connection does the handshake in begin_conn, so its timer->connect
+ * measures it; response_t.firstbyte marks the arrival of the response
+ * HEADERS, and timer->close the end of the stream.
+ */
+
+/* For sendmmsg() and recvmmsg(). */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <apr.h>
+#include <apr_general.h>
+#include <apr_strings.h>
+#include <apr_hash.h>
+#include <apr_file_io.h>
+#include <apr_network_io.h>
+#include <apr_portable.h>
+#include <apr_poll.h>
+
+#if APR_HAS_THREADS
+#include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
+#endif
+
+#if APR_HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "config.h"
+#include "flood_net.h"
+#include "flood_mem.h"
+#include "flood_socket_h2.h"
+#include "flood_socket_h3.h"
+
+extern apr_file_t *local_stderr;
+
+#if FLOOD_HAS_QUICHE
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#include <quiche.h>
+
+/* Largest datagram we send or are willing to receive. */
+#define H3_MAX_DATAGRAM 1350
+/* How many datagrams go to the kernel in one system call. */
+#define H3_BATCH 16
+/* Flow control credit we grant the server. */
+#define H3_STREAM_WINDOW (1 << 24)
+#define H3_CONN_WINDOW (1 << 30)
+/* H3_NO_ERROR, for closing the connection. */
+#define H3_NO_ERROR 0x100
+
+/* H3_REQUEST_CANCELLED, for streams we give up on. */
+#define H3_REQUEST_CANCELLED 0x10c
+
+typedef struct h3_server_t h3_server_t;
+typedef struct h3_conn_t h3_conn_t;
+typedef struct h3_stream_t h3_stream_t;
+
+/* Connections to one host:port. */
+struct h3_server_t {
+    h3_conn_t *conns;
+};
+
+struct h3_conn_t {
+    apr_pool_t *pool;
+    h3_server_t *server;
+    h3_conn_t *next;          /* other connections to the same server */
+    apr_socket_t *socket;
+    apr_os_sock_t fd;
+    apr_pollfd_t pollfd;
+    apr_sockaddr_t *local;
+    apr_sockaddr_t *peer;
+    quiche_config *config;
+    quiche_conn *conn;
+    quiche_h3_conn *h3;
+    int maxstreams;
+    int streams;              /* slots handed out, under h3_servers_lock */
+    h3_stream_t *open;        /* streams still waiting for a response */
+    int reading;              /* A boolean: someone is reading for us all */
+    int dead;                 /* A boolean: no new streams, close when idle */
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;
+#endif
+    uint8_t out[H3_BATCH * H3_MAX_DATAGRAM];
+    apr_size_t outlen[H3_BATCH];
+    uint8_t in[H3_BATCH][H3_MAX_DATAGRAM];
+};
+
+/* A request in flight, as for the h2 group: it comes from the pool of
+ * the farmer that sent it, and whoever reads for the connection puts
+ * what it reads in the inbox, for the owner to take into its own pool. */
+struct h3_stream_t {
+    int64_t id;
+    h3_stream_t *next;
+    apr_pool_t *pool;         /* the owner's */
+    const char *body;         /* request body not yet sent */
+    apr_size_t bodylen;
+    int wantresponse;         /* A boolean: read the body into the inbox */
+    int keep;                 /* A boolean: and then into the response */
+    response_sink_t sink;
+    void *sinkctx;
+    /* Filled in by the reader, from the inbox. */
+    apr_pool_t *inbox;
+    const char *status;
+    apr_table_t *headers;
+    int headersdone;          /* A boolean: the final header block is in */
+    response_t in;            /* body not yet taken, in segments */
+    /* The owner's. */
+    response_t *resp;
+    apr_time_t firstbyte;
+    /* The request's timeouts; heard is when the reader last got
+     * something for us. */
+    apr_time_t deadline;
+    apr_time_t firstbytedue;
+    apr_interval_time_t wait;
+    apr_time_t heard;
+    int done;                 /* A boolean */
+    apr_status_t rv;
+};
+
+typedef struct {
+    h3_conn_t *conn;
+    h3_stream_t *stream;
+    apr_pool_t *inbox;        /* for each stream of ours in turn */
+} h3_socket_t;
+
+static apr_pool_t *h3_pool;
+static apr_hash_t *h3_servers;
+
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *h3_servers_lock;
+#endif
+
+static void h3_servers_lock_acquire(void)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(h3_servers_lock);
+#endif
+}
+
+static void h3_servers_lock_release(void)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(h3_servers_lock);
+#endif
+}
+
+static void h3_conn_lock(h3_conn_t *c)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(c->lock);
+#endif
+}
+
+static void h3_conn_unlock(h3_conn_t *c)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(c->lock);
+#endif
+}
+
+static void h3_conn_timedwait(h3_conn_t *c, apr_interval_time_t t)
+{
+#if APR_HAS_THREADS
+    apr_thread_cond_timedwait(c->cond, c->lock, t);
+#endif
+}
+
+static void h3_conn_wake(h3_conn_t *c)
+{
+#if APR_HAS_THREADS
+    apr_thread_cond_broadcast(c->cond);
+#endif
+}
+
+#ifdef UDP_SEGMENT
+/* Cleared the first time the kernel or the NIC turns down GSO. */
+static int h3_gso = 1;
+#else
+static int h3_gso = 0;
+#endif
+
+#if FLOOD_HAS_SENDMMSG
+/* Send datagrams first..last-1, which start at off in c->out. */
+static apr_status_t h3_sendmmsg(h3_conn_t *c, int first, int last,
+                                apr_size_t off)
+{
+    struct mmsghdr msgs[H3_BATCH];
+    struct iovec iov[H3_BATCH];
+    int i, n, sent = 0;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = first, n = 0; i < last; i++, n++) {
+        iov[n].iov_base = c->out + off;
+        iov[n].iov_len = c->outlen[i];
+        msgs[n].msg_hdr.msg_iov = &iov[n];
+        msgs[n].msg_hdr.msg_iovlen = 1;
+        off += c->outlen[i];
+    }
+
+    while (sent < n) {
+        int rv = sendmmsg(c->fd, msgs + sent, n - sent, 0);
+        if (rv < 0) {
+            if (errno == EINTR)
+                continue;
+            /* A full socket buffer is just packet loss to QUIC. */
+            if (errno == EAGAIN || errno == ENOBUFS)
+                break;
+            return APR_FROM_OS_ERROR(errno);
+        }
+        sent += rv;
+    }
+
+    return APR_SUCCESS;
+}
+#else
+static apr_status_t h3_sendmmsg(h3_conn_t *c, int first, int last,
+                                apr_size_t off)
+{
+    int i;
+
+    for (i = first; i < last; i++) {
+        if (send(c->fd, c->out + off, c->outlen[i], 0) < 0 &&
+            errno != EAGAIN && errno != ENOBUFS && errno != EINTR)
+            return APR_FROM_OS_ERROR(errno);
+        off += c->outlen[i];
+    }
+
+    return APR_SUCCESS;
+}
+#endif
+
+#ifdef UDP_SEGMENT
+/* Hand the kernel one buffer of segsize datagrams and let it (or the
+ * NIC) cut it up.  Returns APR_ENOTIMPL if GSO isn't available. */
+static apr_status_t h3_send_gso(h3_conn_t *c, apr_size_t off, apr_size_t len,
+                                apr_size_t segsize)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cm;
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    iov.iov_base = c->out + off;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    *((uint16_t *)CMSG_DATA(cm)) = segsize;
+
+    while (sendmsg(c->fd, &msg, 0) < 0) {
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == ENOBUFS)
+            break;
+        if (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT) {
+            h3_gso = 0;
+            return APR_ENOTIMPL;
+        }
+        return APR_FROM_OS_ERROR(errno);
+    }
+
+    return APR_SUCCESS;
+}
+#endif
+
+/* Put n datagrams on the wire.  Runs of equal-sized datagrams (the last
+ * one may be shorter) go out as a single GSO send where we can; the rest
+ * go out in one sendmmsg(). */
+static apr_status_t h3_send(h3_conn_t *c, int n)
+{
+    apr_size_t off = 0, len;
+    apr_status_t rv;
+    int i = 0, j;
+
+    while (i < n) {
+        len = c->outlen[i];
+        j = i + 1;
+        if (h3_gso) {
+            while (j < n && c->outlen[j] == c->outlen[i])
+                len += c->outlen[j++];
+            if (j < n && c->outlen[j] < c->outlen[i])
+                len += c->outlen[j++];
+        }
+        else {
+            while (j < n)
+                len += c->outlen[j++];
+        }
+
+#ifdef UDP_SEGMENT
+        if (h3_gso && j - i > 1) {
+            rv = h3_send_gso(c, off, len, c->outlen[i]);
+            if (rv == APR_SUCCESS) {
+                off += len;
+                i = j;
+                continue;
+            }
+            if (rv != APR_ENOTIMPL)
+                return rv;
+        }
+#endif
+
+        if ((rv = h3_sendmmsg(c, i, j, off)) != APR_SUCCESS)
+            return rv;
+        off += len;
+        i = j;
+    }
+
+    return APR_SUCCESS;
+}
+
+/* Send everything quiche has queued, H3_BATCH datagrams at a time.  We
+ * don't pace; the datagrams go out as soon as quiche hands them over. */
+static apr_status_t h3_flush(h3_conn_t *c)
+{
+    quiche_send_info info;
+    apr_size_t off;
+    apr_status_t rv;
+    ssize_t len;
+    int n;
+
+    do {
+        off = 0;
+        for (n = 0; n < H3_BATCH; n++) {
+            len = quiche_conn_send(c->conn, c->out + off, H3_MAX_DATAGRAM,
+                                   &info);
+            if (len == QUICHE_ERR_DONE)
+                break;
+            if (len < 0) {
+                apr_file_printf(local_stderr, "QUIC send failed (%d).\n",
+                                (int)len);
+                return APR_EGENERAL;
+            }
+            c->outlen[n] = len;
+            off += len;
+        }
+
+        if (n && (rv = h3_send(c, n)) != APR_SUCCESS)
+            return rv;
+    }
+    while (n == H3_BATCH);
+
+    return APR_SUCCESS;
+}
+
+/* Feed quiche every datagram that is waiting on the socket. */
+static apr_status_t h3_recv(h3_conn_t *c)
+{
+    quiche_recv_info info;
+    int i, n;
+
+    info.from = (struct sockaddr *)&c->peer->sa;
+    info.from_len = c->peer->salen;
+    info.to = (struct sockaddr *)&c->local->sa;
+    info.to_len = c->local->salen;
+
+    for (;;) {
+#if FLOOD_HAS_SENDMMSG
+        /* recvmmsg() is older than sendmmsg(). */
+        struct mmsghdr msgs[H3_BATCH];
+        struct iovec iov[H3_BATCH];
+
+        memset(msgs, 0, sizeof(msgs));
+        for (i = 0; i < H3_BATCH; i++) {
+            iov[i].iov_base = c->in[i];
+            iov[i].iov_len = H3_MAX_DATAGRAM;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        n = recvmmsg(c->fd, msgs, H3_BATCH, MSG_DONTWAIT, NULL);
+#else
+        ssize_t len;
+
+        n = 0;
+        len = recv(c->fd, c->in[0], H3_MAX_DATAGRAM, MSG_DONTWAIT);
+        if (len >= 0)
+            n = 1;
+        else
+            n = -1;
+#endif
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return APR_SUCCESS;
+            return APR_FROM_OS_ERROR(errno);
+        }
+
+        for (i = 0; i < n; i++) {
+#if FLOOD_HAS_SENDMMSG
+            apr_size_t len = msgs[i].msg_len;
+#endif
+            /* Junk is quiche's to drop; it says so with an error. */
+            quiche_conn_recv(c->conn, c->in[i], len, &info);
+        }
+
+        if (n < H3_BATCH)
+            return APR_SUCCESS;
+    }
+}
+
+/* Flush, then wait no longer than t for the socket or for quiche's
+ * timer, and process whichever fired.  If neither did, *quiet says so.
+ * Call with c locked; it is unlocked while we wait, so that others can
+ * send meanwhile. */
+static apr_status_t h3_drive(h3_conn_t *c, apr_interval_time_t t, int *quiet)
+{
+    apr_int32_t socketsRead = 0;
+    apr_status_t rv;
+    uint64_t ms;
+    int timer = 0;            /* A boolean: t is quiche's */
+
+    if ((rv = h3_flush(c)) != APR_SUCCESS)
+        return rv;
+    if (quiche_conn_is_closed(c->conn))
+        return APR_EOF;
+
+    ms = quiche_conn_timeout_as_millis(c->conn);
+    if (ms != UINT64_MAX && (apr_interval_time_t)(ms * 1000) < t) {
+        t = ms * 1000;
+        timer = 1;
+    }
+
+    h3_conn_unlock(c);
+    rv = apr_poll(&c->pollfd, 1, &socketsRead, t > 0 ? t : 0);
+    h3_conn_lock(c);
+
+    if (rv == APR_SUCCESS && socketsRead) {
+        rv = h3_recv(c);
+    }
+    else if (rv == APR_SUCCESS || APR_STATUS_IS_TIMEUP(rv)) {
+        /* quiche knows whether its timer is really due; the others may
+         * have moved it while we waited. */
+        if (timer)
+            quiche_conn_on_timeout(c->conn);
+        else if (quiet)
+            *quiet = 1;
+        rv = APR_SUCCESS;
+    }
+
+    if (rv == APR_SUCCESS && quiche_conn_is_closed(c->conn))
+        rv = APR_EOF;
+
+    return rv;
+}
+
+static void h3_stream_done(h3_conn_t *c, h3_stream_t *st)
+{
+    h3_stream_t **sp;
+
+    for (sp = &c->open; *sp; sp = &(*sp)->next) {
+        if (*sp == st) {
+            *sp = st->next;
+            break;
+        }
+    }
+    st->done = 1;
+}
+
+static h3_stream_t *h3_stream_find(h3_conn_t *c, int64_t id)
+{
+    h3_stream_t *st;
+
+    for (st = c->open; st; st = st->next)
+        if (st->id == id)
+            return st;
+
+    return NULL;
+}
+
+/* The connection is unusable; fail everything still open on it. */
+static void h3_conn_fail(h3_conn_t *c, apr_status_t rv)
+{
+    h3_stream_t *st;
+
+    c->dead = 1;
+    for (st = c->open; st; st = st->next) {
+        st->done = 1;
+        st->rv = rv;
+    }
+    c->open = NULL;
+    h3_conn_wake(c);
+}
+
+static apr_status_t h3_conn_cleanup(void *data)
+{
+    h3_conn_t *c = data;
+
+    if (c->h3)
+        quiche_h3_conn_free(c->h3);
+    if (c->conn) {
+        if (!quiche_conn_is_closed(c->conn)) {
+            quiche_conn_close(c->conn, 1, H3_NO_ERROR, NULL, 0);
+            h3_flush(c);
+        }
+        quiche_conn_free(c->conn);
+    }
+    if (c->config)
+        quiche_config_free(c->config);
+    if (c->socket)
+        apr_socket_close(c->socket);
+
+    return APR_SUCCESS;
+}
+
+static void h3_conn_close(h3_conn_t *c)
+{
+    h3_servers_lock_acquire();
+    apr_pool_destroy(c->pool);
+    h3_servers_lock_release();
+}
+
+static apr_status_t h3_conn_open(h3_conn_t **conn, request_t *req)
+{
+    apr_pool_t *pool;
+    h3_conn_t *c;
+    quiche_h3_config *h3_config;
+    apr_uri_t *u = req->parsed_uri;
+    apr_interval_time_t t;
+    uint8_t scid[16];
+    apr_status_t rv;
+    int quiet;
+
+    /* Each connection gets a pool of its own, so a long run that keeps
+     * reconnecting doesn't pile up dead ones. */
+    h3_servers_lock_acquire();
+    rv = apr_pool_create(&pool, h3_pool);
+    h3_servers_lock_release();
+    if (rv != APR_SUCCESS)
+        return rv;
+
+    c = apr_pcalloc(pool, sizeof(h3_conn_t));
+    c->pool = pool;
+    c->maxstreams = req->maxstreams > 0 ? req->maxstreams
+                                        : FLOOD_H2_MAX_STREAMS;
+    apr_pool_cleanup_register(pool, c, h3_conn_cleanup,
+                              apr_pool_cleanup_null);
+
+    if ((rv = apr_sockaddr_info_get(&c->peer, u->hostname, APR_INET, u->port,
+                                    0, pool)) != APR_SUCCESS) {
+        req->error = FLOOD_ERR_DNS;
+        h3_conn_close(c);
+        return rv;
+    }
+    if ((rv = apr_socket_create(&c->socket, c->peer->family, SOCK_DGRAM,
+                                APR_PROTO_UDP, pool)) != APR_SUCCESS ||
+        (rv = apr_socket_connect(c->socket, c->peer)) != APR_SUCCESS ||
+        (rv = apr_socket_addr_get(&c->local, APR_LOCAL,
+                                  c->socket)) != APR_SUCCESS ||
+        (rv = apr_generate_random_bytes(scid, sizeof(scid))) != APR_SUCCESS) {
+        h3_conn_close(c);
+        return rv;
+    }
+    apr_os_sock_get(&c->fd, c->socket);
+
+    c->pollfd.desc_type = APR_POLL_SOCKET;
+    c->pollfd.desc.s = c->socket;
+    c->pollfd.reqevents = APR_POLLIN;
+    c->pollfd.p = pool;
+
+    /* Like the TLS layer, we don't verify the server. */
+    c->config = quiche_config_new(QUICHE_PROTOCOL_VERSION);
+    quiche_config_set_application_protos(c->config,
+        (uint8_t *)QUICHE_H3_APPLICATION_PROTOCOL,
+        sizeof(QUICHE_H3_APPLICATION_PROTOCOL) - 1);
+    quiche_config_verify_peer(c->config, 0);
+    quiche_config_set_max_idle_timeout(c->config,
+                                       LOCAL_SOCKET_TIMEOUT / 1000);
+    quiche_config_set_max_recv_udp_payload_size(c->config, H3_MAX_DATAGRAM);
+    quiche_config_set_max_send_udp_payload_size(c->config, H3_MAX_DATAGRAM);
+    quiche_config_set_initial_max_data(c->config, H3_CONN_WINDOW);
+    quiche_config_set_initial_max_stream_data_bidi_local(c->config,
+                                                         H3_STREAM_WINDOW);
+    quiche_config_set_initial_max_stream_data_bidi_remote(c->config,
+                                                          H3_STREAM_WINDOW);
+    quiche_config_set_initial_max_stream_data_uni(c->config,
+                                                  H3_STREAM_WINDOW);
+    quiche_config_set_initial_max_streams_bidi(c->config, 100);
+    quiche_config_set_initial_max_streams_uni(c->config, 100);
+    quiche_config_set_disable_active_migration(c->config, 1);
+
+    c->conn = quiche_connect(u->hostname, scid, sizeof(scid),
+                             (struct sockaddr *)&c->local->sa,
+                             c->local->salen,
+                             (struct sockaddr *)&c->peer->sa,
+                             c->peer->salen, c->config);
+    if (!c->conn) {
+        h3_conn_close(c);
+        return APR_EGENERAL;
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_create(&c->lock, APR_THREAD_MUTEX_DEFAULT, pool);
+    apr_thread_cond_create(&c->cond, pool);
+#endif
+
+    /* Nobody else knows about us yet, but h3_drive() lets go of the lock
+     * while it waits. */
+    t = req->timeouts.connect ? req->timeouts.connect : LOCAL_SOCKET_TIMEOUT;
+    rv = APR_SUCCESS;
+    h3_conn_lock(c);
+    while (rv == APR_SUCCESS && !quiche_conn_is_established(c->conn)) {
+        quiet = 0;
+        rv = h3_drive(c, t, &quiet);
+        if (rv == APR_SUCCESS && quiet)
+            rv = APR_TIMEUP;
+    }
+    h3_conn_unlock(c);
+    if (rv != APR_SUCCESS) {
+        h3_conn_close(c);
+        return rv;
+    }
+
+    h3_config = quiche_h3_config_new();
+    c->h3 = quiche_h3_conn_new_with_transport(c->conn, h3_config);
+    quiche_h3_config_free(h3_config);
+    if (!c->h3) {
+        apr_file_printf(local_stderr, "Server did not agree to speak h3.\n");
+        h3_conn_close(c);
+        return APR_ENOTIMPL;
+    }
+
+    *conn = c;
+    return APR_SUCCESS;
+}
+
+static int h3_on_header(uint8_t *name, size_t namelen,
+                        uint8_t *value, size_t valuelen, void *argp)
+{
+    h3_stream_t *st = argp;
+
+    if (namelen == sizeof(":status") - 1 &&
+        memcmp(name, ":status", namelen) == 0) {
+        /* An interim 1xx response is followed by the real one. */
+        st->status = apr_pstrmemdup(st->inbox, (const char *)value, valuelen);
+        apr_table_clear(st->headers);
+    }
+    else {
+        apr_table_addn(st->headers,
+                       apr_pstrmemdup(st->inbox, (const char *)name, namelen),
+                       apr_pstrmemdup(st->inbox, (const char *)value, valuelen));
+    }
+
+    return 0;
+}
+
+/* Take the response body off stream id, into st's inbox if it is still
+ * open and wants it; anything else is dropped. */
+static void h3_recv_body(h3_conn_t *c, h3_stream_t *st, int64_t id)
+{
+    int keep = st && st->wantresponse;
+    apr_size_t room;
+    char *cp;
+    ssize_t len;
+
+    if (st)
+        st->heard = apr_time_now();
+
+    for (;;) {
+        if (keep)
+            cp = flood_response_room(&st->in, &room, st->inbox);
+        else {
+            /* The datagrams have all been handed to quiche by now. */
+            cp = (char *)c->in[0];
+            room = H3_MAX_DATAGRAM;
+        }
+
+        len = quiche_h3_recv_body(c->h3, c->conn, id, (uint8_t *)cp, room);
+        if (len <= 0)
+            break;
+        if (keep)
+            flood_response_grow(&st->in, len);
+    }
+}
+
+static void h3_event(h3_conn_t *c, int64_t id, quiche_h3_event *ev)
+{
+    h3_stream_t *st = h3_stream_find(c, id), **sp;
+
+    switch (quiche_h3_event_type(ev))
+    {
+    case QUICHE_H3_EVENT_HEADERS:
+        /* Trailers come after the owner has taken the headers. */
+        if (st && !st->headersdone) {
+            st->heard = apr_time_now();
+            if (!st->firstbyte)
+                st->firstbyte = st->heard;
+            quiche_h3_event_for_each_header(ev, h3_on_header, st);
+            if (st->status && st->status[0] != '1')
+                st->headersdone = 1;
+        }
+        break;
+    case QUICHE_H3_EVENT_DATA:
+        h3_recv_body(c, st, id);
+        break;
+    case QUICHE_H3_EVENT_FINISHED:
+        if (st)
+            h3_stream_done(c, st);
+        break;
+    case QUICHE_H3_EVENT_RESET:
+        if (st) {
+            apr_file_printf(local_stderr, "h3 stream %d was reset.\n",
+                            (int)id);
+            st->rv = APR_EGENERAL;
+            h3_stream_done(c, st);
+        }
+        break;
+    case QUICHE_H3_EVENT_GOAWAY:
+        /* id is the first stream the server won't process. */
+        c->dead = 1;
+        for (sp = &c->open; (st = *sp); ) {
+            if (st->id >= id) {
+                apr_file_printf(local_stderr,
+                                "h3 stream %d was refused.\n", (int)st->id);
+                *sp = st->next;
+                st->rv = APR_EGENERAL;
+                st->done = 1;
+            }
+            else {
+                sp = &st->next;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* Send as much of st's request body as flow control lets us. */
+static apr_status_t h3_stream_push(h3_conn_t *c, h3_stream_t *st)
+{
+    ssize_t len;
+
+    while (st->bodylen) {
+        len = quiche_h3_send_body(c->h3, c->conn, st->id,
+                                  (const uint8_t *)st->body, st->bodylen, 1);
+        if (len == 0 || len == QUICHE_H3_ERR_DONE)
+            break;
+        if (len < 0) {
+            apr_file_printf(local_stderr, "h3 request body failed (%d).\n",
+                            (int)len);
+            return APR_EGENERAL;
+        }
+        st->body += len;
+        st->bodylen -= len;
+    }
+
+    return APR_SUCCESS;
+}
+
+/* How long we may go on waiting for st, and what to report if that
+ * runs out.  Call with c locked. */
+static apr_interval_time_t h3_stream_wait(h3_stream_t *st,
+                                          apr_status_t *expired)
+{
+    apr_interval_time_t t;
+    apr_time_t now = apr_time_now();
+
+    t = st->heard + st->wait - now;
+    *expired = APR_TIMEUP;
+    if (!st->firstbyte && st->firstbytedue &&
+        st->firstbytedue - now < t) {
+        t = st->firstbytedue - now;
+        *expired = FLOOD_EFIRSTBYTE;
+    }
+    if (st->deadline && st->deadline - now < t) {
+        t = st->deadline - now;
+        *expired = FLOOD_ETOTALTIME;
+    }
+
+    return t;
+}
+
+/* We have given up on st: stop both directions of its stream, leaving
+ * the rest of the connection alone.  Call with c locked. */
+static void h3_stream_cancel(h3_conn_t *c, h3_stream_t *st, apr_status_t rv)
+{
+    apr_status_t frv;
+
+    quiche_conn_stream_shutdown(c->conn, st->id, QUICHE_SHUTDOWN_READ,
+                                H3_REQUEST_CANCELLED);
+    quiche_conn_stream_shutdown(c->conn, st->id, QUICHE_SHUTDOWN_WRITE,
+                                H3_REQUEST_CANCELLED);
+    h3_stream_done(c, st);
+    st->rv = rv;
+
+    if ((frv = h3_flush(c)) != APR_SUCCESS)
+        h3_conn_fail(c, frv);
+}
+
+/* Read what has come in on behalf of every stream open on the
+ * connection, waiting for it no longer than t, and send what the streams
+ * have to send.  Call with c locked and nobody else reading. */
+static void h3_conn_pump(h3_conn_t *c, apr_interval_time_t t)
+{
+    quiche_h3_event *ev;
+    h3_stream_t *st, *next;
+    int64_t id;
+    apr_status_t rv;
+
+    c->reading = 1;
+
+    rv = h3_drive(c, t, NULL);
+
+    if (rv == APR_SUCCESS) {
+        while ((id = quiche_h3_conn_poll(c->h3, c->conn, &ev)) >= 0) {
+            h3_event(c, id, ev);
+            quiche_h3_event_free(ev);
+        }
+        if (id != QUICHE_H3_ERR_DONE) {
+            apr_file_printf(local_stderr, "h3 receive failed (%d).\n",
+                            (int)id);
+            rv = APR_EGENERAL;
+        }
+    }
+
+    /* More flow control credit may have come for request bodies. */
+    if (rv == APR_SUCCESS) {
+        for (st = c->open; st; st = next) {
+            next = st->next;
+            if (st->bodylen && h3_stream_push(c, st) != APR_SUCCESS)
+                h3_stream_cancel(c, st, APR_EGENERAL);
+        }
+        rv = h3_flush(c);
+    }
+
+    c->reading = 0;
+
+    if (rv != APR_SUCCESS)
+        h3_conn_fail(c, rv);
+    else
+        h3_conn_wake(c);
+}
+
+/* Take what has been read for st out of its inbox: show it to the
+ * request's sink, copy it into the owner's pool if the body is wanted,
+ * and empty the inbox.  Call with c locked, from the owner. */
+static void h3_stream_take(h3_stream_t *st)
+{
+    flood_seg_t *seg;
+    apr_size_t room, off, n;
+    char *cp;
+
+    /* Until the headers are in, the inbox holds nothing else. */
+    if (!st->headersdone)
+        return;
+
+    if (!st->resp->rbuf) {
+        h2_build_resp(st->status, st->headers, st->resp, st->pool);
+        if (st->sink)
+            st->sink(st->sinkctx, st->resp->rbuf, st->resp->rbufsize);
+    }
+
+    for (seg = st->in.seg; seg; seg = seg->next) {
+        if (st->sink)
+            st->sink(st->sinkctx, seg->data, seg->len);
+        for (off = 0; st->keep && off < seg->len; off += n) {
+            cp = flood_response_room(st->resp, &room, st->pool);
+            n = seg->len - off < room ? seg->len - off : room;
+            memcpy(cp, seg->data + off, n);
+            flood_response_grow(st->resp, n);
+        }
+    }
+
+    st->in.seg = st->in.lastseg = NULL;
+    st->in.seglen = 0;
+    st->status = NULL;
+    st->headers = NULL;
+    apr_pool_clear(st->inbox);
+}
+
+/* Give back our stream slot, and close the connection if it is dead and
+ * we were the last one on it. */
+static void h3_release(h3_socket_t *hsock)
+{
+    h3_conn_t *c = hsock->conn, **cp;
+    int close = 0;
+
+    if (!c)
+        return;
+
+    h3_servers_lock_acquire();
+    c->streams--;
+    if (c->dead && !c->streams) {
+        for (cp = &c->server->conns; *cp; cp = &(*cp)->next) {
+            if (*cp == c) {
+                *cp = c->next;
+                break;
+            }
+        }
+        close = 1;
+    }
+    h3_servers_lock_release();
+
+    if (close)
+        h3_conn_close(c);
+
+    hsock->conn = NULL;
+    hsock->stream = NULL;
+}
+
+apr_status_t h3_init_socket(apr_pool_t *pool)
+{
+    apr_pool_create(&h3_pool, pool);
+    h3_servers = apr_hash_make(h3_pool);
+#if APR_HAS_THREADS
+    apr_thread_mutex_create(&h3_servers_lock, APR_THREAD_MUTEX_DEFAULT,
+                            h3_pool);
+#endif
+    return APR_SUCCESS;
+}
+
+static apr_status_t h3_inbox_cleanup(void *data)
+{
+    apr_pool_destroy((apr_pool_t *)data);
+    return APR_SUCCESS;
+}
+
+/**
+ * HTTP/3 implementation for socket_init.
+ */
+apr_status_t h3_socket_init(socket_t **sock, apr_pool_t *pool)
+{
+    h3_socket_t *new_hsock;
+    apr_status_t rv;
+
+    new_hsock = (h3_socket_t *)apr_pcalloc(pool, sizeof(h3_socket_t));
+    if (new_hsock == NULL)
+        return APR_ENOMEM;
+
+    /* Filled by whichever farmer reads for the connection; see
+     * h2_socket_init(). */
+    if ((rv = flood_mem_pool_create(&new_hsock->inbox)) != APR_SUCCESS)
+        return rv;
+    apr_pool_cleanup_register(pool, new_hsock->inbox, h3_inbox_cleanup,
+                              apr_pool_cleanup_null);
+
+    *sock = new_hsock;
+    return APR_SUCCESS;
+}
+
+/**
+ * HTTP/3 implementation for begin_conn.
+ */
+apr_status_t h3_begin_conn(socket_t *sock, request_t *req, apr_pool_t *pool)
+{
+    h3_socket_t *hsock = (h3_socket_t *)sock;
+    h3_server_t *server;
+    h3_conn_t *c;
+    const char *key;
+    apr_status_t rv;
+    int stale;
+
+    if (strcasecmp(req->parsed_uri->scheme, "https") != 0) {
+        apr_file_printf(local_stderr, "HTTP/3 needs https URLs (%s).\n",
+                        req->uri);
+        return APR_ENOTIMPL;
+    }
+    if (req->parsed_proxy_uri || req->unixsocket) {
+        apr_file_printf(local_stderr,
+                        "The h3 socket group does not support proxies "
+                        "or Unix domain sockets.\n");
+        return APR_ENOTIMPL;
+    }
+
+    key = apr_psprintf(pool, "%s:%d", req->parsed_uri->hostname,
+                       req->parsed_uri->port);
+
+    for (;;) {
+        /* Look for a connection to this server with a stream to spare. */
+        h3_servers_lock_acquire();
+        server = apr_hash_get(h3_servers, key, APR_HASH_KEY_STRING);
+        if (!server) {
+            server = apr_pcalloc(h3_pool, sizeof(h3_server_t));
+            apr_hash_set(h3_servers, apr_pstrdup(h3_pool, key),
+                         APR_HASH_KEY_STRING, server);
+        }
+        for (c = server->conns; c; c = c->next) {
+            if (!c->dead && c->streams < c->maxstreams) {
+                c->streams++;
+                break;
+            }
+        }
+        h3_servers_lock_release();
+
+        if (!c)
+            break;
+
+        /* One that sat idle may have timed out without anybody reading
+         * it to notice. */
+        h3_conn_lock(c);
+        quiche_conn_on_timeout(c->conn);
+        stale = c->dead || quiche_conn_is_closed(c->conn);
+        if (stale)
+            h3_conn_fail(c, APR_EOF);
+        h3_conn_unlock(c);
+
+        hsock->conn = c;
+        if (!stale) {
+            req->keepalive = 1;
+            return APR_SUCCESS;
+        }
+        h3_release(hsock);
+    }
+
+    /* Connect without holding up everybody else. */
+    if ((rv = h3_conn_open(&c, req)) != APR_SUCCESS)
+        return rv;
+
+    h3_servers_lock_acquire();
+    c->server = server;
+    c->streams = 1;
+    c->next = server->conns;
+    server->conns = c;
+    h3_servers_lock_release();
+
+    hsock->conn = c;
+    req->keepalive = 1;
+    return APR_SUCCESS;
+}
+
+/**
+ * HTTP/3 implementation for send_req.
+ */
+apr_status_t h3_send_req(socket_t *sock, request_t *req, apr_pool_t *pool)
+{
+    h3_socket_t *hsock = (h3_socket_t *)sock;
+    h3_conn_t *c = hsock->conn;
+    h3_stream_t *st;
+    quiche_h3_header *hdrs;
+    h2_field_t *fields;
+    apr_interval_time_t t;
+    int i, nfields;
+    apr_status_t rv, expired;
+
+    /* Our last stream is over, and nobody reads for it any more. */
+    apr_pool_clear(hsock->inbox);
+
+    st = apr_pcalloc(pool, sizeof(h3_stream_t));
+    st->pool = pool;
+    /* A sink sees the body as it comes, so only keep it if asked to. */
+    st->keep = req->wantresponse;
+    st->sink = req->sink;
+    st->sinkctx = req->sinkctx;
+    st->wantresponse = st->keep || st->sink;
+    if (st->sink)
+        st->sink(st->sinkctx, NULL, 0);
+    st->inbox = hsock->inbox;
+    st->headers = apr_table_make(st->inbox, 25);
+    st->resp = apr_pcalloc(pool, sizeof(response_t));
+    st->deadline = req->deadline;
+    st->heard = apr_time_now();
+    st->firstbytedue = req->timeouts.firstbyte ?
+                       st->heard + req->timeouts.firstbyte : 0;
+    st->wait = req->timeouts.idle ? req->timeouts.idle : LOCAL_SOCKET_TIMEOUT;
+
+    if ((rv = h2_split_req(&fields, &nfields, &st->body, &st->bodylen,
+                           req, pool)) != APR_SUCCESS) {
+        h3_release(hsock);
+        return rv;
+    }
+
+    hdrs = apr_palloc(pool, nfields * sizeof(quiche_h3_header));
+    for (i = 0; i < nfields; i++) {
+        hdrs[i].name = (const uint8_t *)fields[i].name;
+        hdrs[i].name_len = strlen(fields[i].name);
+        hdrs[i].value = (const uint8_t *)fields[i].value;
+        hdrs[i].value_len = strlen(fields[i].value);
+    }
+
+    h3_conn_lock(c);
+    /* Wait for the server to let us open another stream. */
+    while (!c->dead &&
+           (st->id = quiche_h3_send_request(c->h3, c->conn, hdrs, nfields,
+                                            !st->bodylen)) ==
+           QUICHE_H3_ERR_STREAM_BLOCKED) {
+        if ((t = h3_stream_wait(st, &expired)) <= 0) {
+            rv = expired;
+            break;
+        }
+        if (c->reading)
+            h3_conn_timedwait(c, t);
+        else
+            h3_conn_pump(c, t);
+    }
+
+    if (rv == APR_SUCCESS && c->dead) {
+        apr_file_printf(local_stderr, "h3 connection went away.\n");
+        rv = APR_EGENERAL;
+    }
+    else if (rv == APR_SUCCESS && st->id < 0) {
+        apr_file_printf(local_stderr, "h3 request failed (%d).\n",
+                        (int)st->id);
+        rv = APR_EGENERAL;
+    }
+    else if (rv == APR_SUCCESS) {
+        st->next = c->open;
+        c->open = st;
+        /* What flow control holds back, the reader sends later. */
+        if (h3_stream_push(c, st) != APR_SUCCESS)
+            h3_stream_cancel(c, st, APR_EGENERAL);
+        else if ((rv = h3_flush(c)) != APR_SUCCESS)
+            h3_conn_fail(c, rv);
+        rv = st->done ? st->rv : APR_SUCCESS;
+    }
+    h3_conn_unlock(c);
+
+    if (rv != APR_SUCCESS) {
+        h3_release(hsock);
+        return rv;
+    }
+
+    hsock->stream = st;
+    return APR_SUCCESS;
+}
+
+/**
+ * HTTP/3 implementation for recv_resp.
+ */
+apr_status_t h3_recv_resp(response_t **resp, socket_t *sock, apr_pool_t *pool)
+{
+    h3_socket_t *hsock = (h3_socket_t *)sock;
+    h3_conn_t *c = hsock->conn;
+    h3_stream_t *st = hsock->stream;
+    apr_interval_time_t t;
+    apr_status_t rv, expired;
+
+    h3_conn_lock(c);
+    for (;;) {
+        h3_stream_take(st);
+        if (st->done)
+            break;
+        if ((t = h3_stream_wait(st, &expired)) <= 0) {
+            h3_stream_cancel(c, st, expired);
+            break;
+        }
+        if (c->reading)
+            h3_conn_timedwait(c, t);
+        else
+            h3_conn_pump(c, t);
+    }
+    h3_conn_unlock(c);
+
+    rv = st->rv;
+    if (rv == APR_SUCCESS && !st->resp->rbuf)
+        rv = APR_EGENERAL;
+
+    if (rv != APR_SUCCESS) {
+        h3_release(hsock);
+        return rv;
+    }
+
+    *resp = st->resp;
+    (*resp)->firstbyte = st->firstbyte;
+    return APR_SUCCESS;
+}
+
+/**
+ * HTTP/3 implementation for end_conn.
+ */
+apr_status_t h3_end_conn(socket_t *sock, request_t *req, response_t *resp)
+{
+    h3_release((h3_socket_t *)sock);
+    return APR_SUCCESS;
+}
+
+/**
+ * HTTP/3 implementation for socket_destroy.
+ */
+apr_status_t h3_socket_destroy(socket_t *sock)
+{
+    return APR_SUCCESS;
+}
+
+#else /* FLOOD_HAS_QUICHE */
+
+apr_status_t h3_init_socket(apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+apr_status_t h3_socket_init(socket_t **sock, apr_pool_t *pool)
+{
+    apr_file_printf(local_stderr,
+                    "flood was built without HTTP/3 support.\n");
+    return APR_ENOTIMPL;
+}
+
+apr_status_t h3_begin_conn(socket_t *sock, request_t *req, apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+apr_status_t h3_send_req(socket_t *sock, request_t *req, apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+apr_status_t h3_recv_resp(response_t **resp, socket_t *sock, apr_pool_t *pool)
+{
+    return APR_ENOTIMPL;
+}
+
+apr_status_t h3_end_conn(socket_t *sock, request_t *req, response_t *resp)
+{
+    return APR_ENOTIMPL;
+}
+
+apr_status_t h3_socket_destroy(socket_t *sock)
+{
+    return APR_ENOTIMPL;
+}
+
+#endif /* FLOOD_HAS_QUICHE */
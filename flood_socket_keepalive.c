@@ -28,14 +28,12 @@
 #include <assert.h>
 
 #include "config.h"
+#include "flood_body.h"
 #include "flood_net.h"
 #include "flood_net_ssl.h"
+#include "flood_farmer.h"
 #include "flood_socket_keepalive.h"
 
-#define ksock_read_socket(ksock, buf, lenaddr) \
-    ksock->ssl ? ssl_read_socket(ksock->s, buf, lenaddr) : \
-                 read_socket(ksock->s, buf, lenaddr)
-
 #define ksock_write_socket(ksock, req) \
     ksock->ssl ? ssl_write_socket(ksock->s, req) : \
                  write_socket(ksock->s, req)
@@ -52,12 +50,106 @@
 typedef struct {
     void *s;
     apr_pollfd_t *p;
+    apr_pool_t *pool;     /* lives as long as the profile runs */
+    apr_pool_t *connpool; /* holds the connection we opened ourselves */
     int reopen_socket; /* A boolean */
     int wantresponse;  /* A boolean */
     int ssl;           /* A boolean */
     method_e method;   /* The method of the request. */
+    response_sink_t sink;
+    void *sinkctx;
 } keepalive_socket_t;
 
+/* Everything read off the connection goes through here, so that the
+ * request's sink sees all of it, however the response is framed. */
+static apr_status_t ksock_read_socket(keepalive_socket_t *ksock, char *buf,
+                                      apr_size_t *buflen)
+{
+    apr_status_t status;
+
+    status = ksock->ssl ? ssl_read_socket(ksock->s, buf, buflen) :
+                          read_socket(ksock->s, buf, buflen);
+    /* Only what really came off the wire. */
+    if (ksock->sink && *buflen && (status == APR_SUCCESS || status == APR_EOF))
+        ksock->sink(ksock->sinkctx, buf, *buflen);
+
+    return status;
+}
+
+/* A connection opened during the farmer's warm-up.  It lives in the
+ * farmer's pool, and is parked there between runs of the profile. */
+typedef struct keepalive_conn_t {
+    void *s;
+    int ssl;                      /* A boolean */
+    const char *key;
+    farmer_ctx_t *ctx;
+    keepalive_socket_t *ksock;    /* who is using it, if anyone */
+    struct keepalive_conn_t *next;
+} keepalive_conn_t;
+
+static const char *keepalive_conn_key(request_t *req, apr_pool_t *pool)
+{
+    apr_uri_t *u = req->parsed_proxy_uri ? req->parsed_proxy_uri
+                                         : req->parsed_uri;
+
+    return apr_psprintf(pool, "%s://%s:%d%s", req->parsed_uri->scheme,
+                        u->hostname, u->port,
+                        req->unixsocket ? req->unixsocket : "");
+}
+
+static void keepalive_park(keepalive_conn_t *conn)
+{
+    conn->ksock = NULL;
+    conn->next = apr_hash_get(conn->ctx->conns, conn->key,
+                              APR_HASH_KEY_STRING);
+    apr_hash_set(conn->ctx->conns, conn->key, APR_HASH_KEY_STRING, conn);
+}
+
+/* At the end of a run of the profile, park the connection again unless
+ * it has been closed. */
+static apr_status_t keepalive_unlease(void *data)
+{
+    keepalive_conn_t *conn = data;
+
+    if (conn->ksock->s == conn->s && !conn->ksock->reopen_socket)
+        keepalive_park(conn);
+
+    return APR_SUCCESS;
+}
+
+/* Give ksock a warm connection to req's server, if the farmer has one
+ * that is still open. */
+static int keepalive_lease(keepalive_socket_t *ksock, request_t *req,
+                           apr_pool_t *pool)
+{
+    farmer_ctx_t *ctx = farmer_ctx_get(pool);
+    keepalive_conn_t *conn;
+    const char *key;
+
+    if (!ctx)
+        return 0;
+
+    key = keepalive_conn_key(req, pool);
+    while ((conn = apr_hash_get(ctx->conns, key, APR_HASH_KEY_STRING))) {
+        apr_hash_set(ctx->conns, conn->key, APR_HASH_KEY_STRING, conn->next);
+
+        ksock->s = conn->s;
+        ksock->ssl = conn->ssl;
+        if (ksock_check_socket(ksock, pool) == APR_SUCCESS) {
+            conn->ksock = ksock;
+            apr_pool_cleanup_register(ksock->pool, conn, keepalive_unlease,
+                                      apr_pool_cleanup_null);
+            return 1;
+        }
+
+        /* The server gave up on it while it was parked. */
+        ksock_close_socket(ksock);
+    }
+
+    ksock->s = NULL;
+    return 0;
+}
+
 /**
  * Keep-alive implementation for socket_init.
  */
@@ -70,6 +162,9 @@ apr_status_t keepalive_socket_init(socket_t **sock, apr_pool_t *pool)
         return APR_ENOMEM;
     new_ksock->s = NULL;
     new_ksock->p = NULL;
+    new_ksock->pool = pool;
+    if (apr_pool_create(&new_ksock->connpool, pool) != APR_SUCCESS)
+        return APR_ENOMEM;
     new_ksock->reopen_socket = 1;
     new_ksock->wantresponse = 1;
     new_ksock->ssl = 0;
@@ -89,6 +184,7 @@ apr_status_t keepalive_begin_conn(socket_t *sock, request_t *req, apr_pool_t *po
         apr_status_t e;
         e = ksock_check_socket(ksock, pool);
         if (e != APR_SUCCESS) {
+            ksock_close_socket(ksock);
             ksock->reopen_socket = 1;
         }
     }
@@ -106,15 +202,21 @@ apr_status_t keepalive_begin_conn(socket_t *sock, request_t *req, apr_pool_t *po
             ksock->ssl = 0;
         }
 
-        /* The return types are not identical, so it can't be a ternary
-         * operation. */
-        if (ksock->ssl)
-            ksock->s = ssl_open_socket(pool, req, &rv);
-        else
-            ksock->s = open_socket(pool, req, &rv);
+        /* A connection from the warm-up saves us the setup. */
+        if (!keepalive_lease(ksock, req, pool)) {
+            /* Whatever we opened last time has been closed. */
+            apr_pool_clear(ksock->connpool);
 
-        if (ksock->s == NULL)
-            return rv;
+            /* The return types are not identical, so it can't be a
+             * ternary operation. */
+            if (ksock->ssl)
+                ksock->s = ssl_open_socket(ksock->connpool, req, &rv);
+            else
+                ksock->s = open_socket(ksock->connpool, req, &rv);
+
+            if (ksock->s == NULL)
+                return rv;
+        }
 
         ksock->reopen_socket = 0; /* we just opened it */
     }
@@ -122,6 +224,59 @@ apr_status_t keepalive_begin_conn(socket_t *sock, request_t *req, apr_pool_t *po
     return APR_SUCCESS;
 }
 
+/**
+ * Keep-alive implementation for warmup_conn.
+ */
+apr_status_t keepalive_warmup_conn(socket_t *sock, request_t *req, apr_pool_t *pool)
+{
+    keepalive_socket_t *ksock = (keepalive_socket_t *)sock;
+    farmer_ctx_t *ctx = farmer_ctx_get(pool);
+    keepalive_conn_t *conn;
+    request_t r;
+    apr_status_t rv;
+
+    if (!ctx)
+        return APR_ENOTIMPL;
+
+    conn = apr_pcalloc(ctx->pool, sizeof(keepalive_conn_t));
+    conn->ctx = ctx;
+    conn->key = keepalive_conn_key(req, ctx->pool);
+
+    /* Finish the whole TLS handshake now, rather than leave part of it
+     * to the first request as early data would. */
+    r = *req;
+    r.earlydata = 0;
+
+    if (strcasecmp(req->parsed_uri->scheme, "https") == 0) {
+#if FLOOD_HAS_OPENSSL
+        conn->ssl = 1;
+        conn->s = ssl_open_socket(ctx->pool, &r, &rv);
+#else
+        return APR_ENOTIMPL;
+#endif
+    }
+    else {
+        conn->s = open_socket(ctx->pool, &r, &rv);
+    }
+
+    if (conn->s == NULL)
+        return rv;
+
+    /* Make sure the server didn't hang up on us straight away. */
+    ksock->s = conn->s;
+    ksock->ssl = conn->ssl;
+    rv = ksock_check_socket(ksock, pool);
+    if (rv != APR_SUCCESS) {
+        ksock_close_socket(ksock);
+    }
+    else {
+        keepalive_park(conn);
+    }
+    ksock->s = NULL;
+
+    return rv;
+}
+
 /**
  * Keep-alive implementation for send_req.
  */
@@ -130,6 +285,10 @@ apr_status_t keepalive_send_req(socket_t *sock, request_t *req, apr_pool_t *pool
     keepalive_socket_t *ksock = (keepalive_socket_t *)sock;
     ksock->wantresponse = req->wantresponse;
     ksock->method = req->method;
+    ksock->sink = req->sink;
+    ksock->sinkctx = req->sinkctx;
+    if (ksock->sink)
+        ksock->sink(ksock->sinkctx, NULL, 0);
     return ksock->ssl ? ssl_write_socket(ksock->s, req) :
                         write_socket(ksock->s, req);
 }
@@ -273,65 +432,49 @@ static apr_status_t keepalive_read_chunk(response_t *resp,
     }
     while (status == APR_SUCCESS);
 
-    return APR_SUCCESS;
+    return status;
 }
 
 static apr_status_t keepalive_load_resp(response_t *resp, 
                                         keepalive_socket_t *sock,
                                         apr_size_t remaining, apr_pool_t *pool)
 {
-    /* Ugh, we want everything. */
-    int currentalloc, remain;
+    /* Ugh, we want everything.  What follows the first read goes
+     * straight into segments, which are never moved. */
+    int remain;
     apr_size_t i;
-    char *cp, *op, b[MAX_DOC_LENGTH];
+    char *cp;
     apr_status_t status;
+    flood_body_t framing;
 
-    if (remaining > 0)
-    {
-        remain = 1;
-        currentalloc = remaining + resp->rbufsize;
-    }
-    else
-    {
-        remain = 0;
-        currentalloc = MAX_DOC_LENGTH + resp->rbufsize;
-    }
+    remain = remaining > 0;
 
-    cp = apr_palloc(pool, currentalloc);
-    memcpy(cp, resp->rbuf, resp->rbufsize);
-    resp->rbuf = cp;
-    cp = resp->rbuf + resp->rbufsize;
+    /* A chunked body ends with its last chunk, not the connection. */
+    if (resp->chunked) {
+        flood_body_init(&framing, NULL, NULL);
+        flood_body_feed(&framing, resp->rbuf, resp->rbufsize);
+        if (flood_body_done(&framing))
+            return APR_SUCCESS;
+    }
 
     do
     {
-        if (!remain)
-            i = MAX_DOC_LENGTH - 1;
-        else
-        {
-            if (remaining > MAX_DOC_LENGTH - 1)
-                i = MAX_DOC_LENGTH - 1;
-            else
-                i = remaining;
-        }
-
-        status = ksock_read_socket(sock, b, &i);
-        if (resp->rbufsize + i > currentalloc)
-        {
-            /* You can think why this always work. */
-            currentalloc *= 2;
-            op = resp->rbuf;
-            resp->rbuf = apr_palloc(pool, currentalloc);
-            memcpy(resp->rbuf, op, cp - op);
-            cp = resp->rbuf + (cp - op);
+        cp = flood_response_room(resp, &i, pool);
+        if (remain && remaining < i)
+            i = remaining;
+
+        status = ksock_read_socket(sock, cp, &i);
+        if (status == APR_SUCCESS || status == APR_EOF) {
+            flood_response_grow(resp, i);
+            remaining -= i;
+            if (resp->chunked) {
+                flood_body_feed(&framing, cp, i);
+                if (flood_body_done(&framing))
+                    break;
+            }
         }
-
-        memcpy(cp, b, i);
-        resp->rbufsize += i;
-        cp += i;
-        remaining -= i;
     }
-    while (status != APR_EGENERAL && status != APR_EOF && 
-           status != APR_TIMEUP && (!remain || remaining));
+    while (status == APR_SUCCESS && (!remain || remaining));
 
     return status;
 }
@@ -343,8 +486,7 @@ apr_status_t keepalive_recv_resp(response_t **resp, socket_t *sock, apr_pool_t *
 {
     keepalive_socket_t *ksock = (keepalive_socket_t *)sock;
     char *cl, *ecl, cls[17];
-    char *current_line;
-    apr_size_t i;
+    apr_size_t i, len;
     response_t *new_resp;
     apr_status_t status;
     long content_length = 0, chunk_length;
@@ -353,7 +495,7 @@ apr_status_t keepalive_recv_resp(response_t **resp, socket_t *sock, apr_pool_t *
     new_resp = apr_pcalloc(pool, sizeof(response_t));
     new_resp->rbuftype = POOL;
     new_resp->rbufsize = MAX_DOC_LENGTH - 1;
-    new_resp->rbuf = apr_palloc(pool, new_resp->rbufsize);
+    new_resp->rbuf = apr_palloc(pool, MAX_DOC_LENGTH);
 
     status = ksock_read_socket(ksock, new_resp->rbuf, &new_resp->rbufsize);
 
@@ -362,34 +504,11 @@ apr_status_t keepalive_recv_resp(response_t **resp, socket_t *sock, apr_pool_t *
     }
 
     /* FIXME: Assume we got the full header for now. */
-    new_resp->headers = apr_table_make(pool, 25);
-    current_line = new_resp->rbuf;
-    do {
-        char *end_of_line, *header_end, *header_key, *header_val;
-        int line_length, key_length;
-
-        end_of_line = strstr(current_line, CRLF);
-        if (!end_of_line || end_of_line == current_line) {
-            break;
-        }
-        line_length = end_of_line - current_line;
-
-        header_end = memchr(current_line, ':', line_length);
-        if (header_end) {
-            key_length = header_end - current_line;
- 
-            header_key = apr_pstrmemdup(pool, current_line, key_length);
-            header_val = apr_pstrmemdup(pool, current_line + key_length + 2,
-                                        line_length - key_length - 2);
-            apr_table_set(new_resp->headers, header_key, header_val);
-        }
-        current_line += line_length + sizeof(CRLF) - 1;
-    }
-    while((current_line - new_resp->rbuf) < new_resp->rbufsize);
+    flood_index_headers(new_resp, pool);
 
     /* If this exists, we aren't keepalive anymore. */
-    header = apr_table_get(new_resp->headers, "Connection");
-    if (header && !strcasecmp(header, "Close")) {
+    header = flood_header_known(new_resp, FLOOD_HEADER_CONNECTION, &len);
+    if (header && len == 5 && !strncasecmp(header, "Close", 5)) {
         new_resp->keepalive = 0; 
     }
     else {
@@ -403,23 +522,20 @@ apr_status_t keepalive_recv_resp(response_t **resp, socket_t *sock, apr_pool_t *
         return APR_SUCCESS;
     }
 
-    header = apr_table_get(new_resp->headers, "Transfer-Encoding");
-    if (header && !strcasecmp(header, "Chunked"))
+    header = flood_header_known(new_resp, FLOOD_HEADER_TRANSFER_ENCODING,
+                                &len);
+    if (header && len == 7 && !strncasecmp(header, "Chunked", 7))
     {
         new_resp->chunked = 1;
         new_resp->chunk = NULL;
         chunk_length = 0;
 
         /* Find where headers ended */
-        cl = current_line;
-
-        if (cl) {
-            /* Skip over the CRLF chars */
-            cl += sizeof(CRLF)-1;
-        }
+        cl = new_resp->headerlen ? new_resp->rbuf + new_resp->headerlen
+                                 : NULL;
 
         /* We have a partial chunk and we aren't at the end. */
-        if (cl && *cl && (cl - (char*)new_resp->rbuf) < new_resp->rbufsize) {
+        if (cl && (cl - (char*)new_resp->rbuf) < new_resp->rbufsize && *cl) {
             int remaining;
     
             do {
@@ -464,7 +580,8 @@ apr_status_t keepalive_recv_resp(response_t **resp, socket_t *sock, apr_pool_t *
     }
     else
     {
-        header = apr_table_get(new_resp->headers, "Content-Length");
+        header = flood_header_known(new_resp, FLOOD_HEADER_CONTENT_LENGTH,
+                                    &len);
         if (!header)
         {
             new_resp->keepalive = 0; 
@@ -472,12 +589,10 @@ apr_status_t keepalive_recv_resp(response_t **resp, socket_t *sock, apr_pool_t *
 
         if (header)
         {
-            cl = (char*)header;
-            ecl = cl + strlen(cl);
-            if (ecl && ecl - cl < 16)
+            if (len < 16)
             {
-                strncpy(cls, cl, ecl - cl);
-                cls[ecl-cl] = '\0';
+                memcpy(cls, header, len);
+                cls[len] = '\0';
                 content_length = strtol(cls, &ecl, 10);
                 if (*ecl != '\0')
                     new_resp->keepalive = 0; 
@@ -486,25 +601,21 @@ apr_status_t keepalive_recv_resp(response_t **resp, socket_t *sock, apr_pool_t *
 
         if (new_resp->keepalive)
         {
-            /* Find where we ended */
-            ecl = current_line;
-
             /* We didn't get full headers.  Crap. */
-            if (!ecl)
+            if (!new_resp->headerlen)
                 new_resp->keepalive = 0; 
-            {
-                ecl += sizeof(CRLF) - 1;
-                content_length -= new_resp->rbufsize - (ecl - (char*)new_resp->rbuf);
-            } 
+            else
+                content_length -= new_resp->rbufsize - new_resp->headerlen;
         }
     }
    
     if (ksock->wantresponse)
     {
-        if (new_resp->keepalive)
-            status = keepalive_load_resp(new_resp, ksock, content_length, pool);
-        else
+        /* With a Content-Length, the first read may have had it all. */
+        if (new_resp->chunked || !new_resp->keepalive)
             status = keepalive_load_resp(new_resp, ksock, 0, pool);
+        else if (content_length > 0)
+            status = keepalive_load_resp(new_resp, ksock, content_length, pool);
     }
     else
     {
@@ -516,8 +627,7 @@ apr_status_t keepalive_recv_resp(response_t **resp, socket_t *sock, apr_pool_t *
         }
         else if (new_resp->keepalive)
         {
-            while (content_length && status != APR_EGENERAL &&
-                   status != APR_EOF && status != APR_TIMEUP) {
+            while (content_length > 0 && status == APR_SUCCESS) {
                 if (content_length > MAX_DOC_LENGTH - 1)
                     i = MAX_DOC_LENGTH - 1;
                 else
@@ -530,14 +640,21 @@ apr_status_t keepalive_recv_resp(response_t **resp, socket_t *sock, apr_pool_t *
         }
         else
         {
-            while (status != APR_EGENERAL && status != APR_EOF && 
-                   status != APR_TIMEUP) {
+            while (status == APR_SUCCESS) {
                 i = MAX_DOC_LENGTH - 1;
                 status = ksock_read_socket(ksock, b, &i);
             }
         }
     }
 
+    /* Whatever stopped the read leaves the connection of no more use:
+     * closed, or part way through a response we've lost track of. */
+    if (status != APR_SUCCESS) {
+        new_resp->keepalive = 0;
+        if (status != APR_EOF)
+            return status;
+    }
+
     *resp = new_resp;
 
     return APR_SUCCESS;
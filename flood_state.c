@@ -0,0 +1,94 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#include <apr_strings.h>
+#include <apr_hash.h>
+
+#if APR_HAVE_STRING_H
+#include <string.h>     /* memcpy */
+#endif
+
+#include "config.h"
+#include "flood_state.h"
+
+/* The smallest buffer a variable gets, so that a value that creeps up a
+ * byte at a time doesn't take a new one each time. */
+#define FLOOD_STATE_VALUE_MIN 16
+
+typedef struct {
+    char *value;
+    apr_size_t size;    /* of the buffer value is in */
+} state_var_t;
+
+struct flood_state_t {
+    apr_pool_t *pool;
+    apr_hash_t *vars;   /* name -> state_var_t */
+    apr_size_t bytes;
+};
+
+flood_state_t *flood_state_create(apr_pool_t *pool)
+{
+    flood_state_t *state = apr_pcalloc(pool, sizeof(flood_state_t));
+
+    state->pool = pool;
+    state->vars = apr_hash_make(pool);
+    return state;
+}
+
+void flood_state_set(flood_state_t *state, const char *name,
+                     apr_ssize_t namelen, const char *value, apr_size_t len)
+{
+    state_var_t *var;
+    char *key;
+
+    if (namelen == APR_HASH_KEY_STRING)
+        namelen = strlen(name);
+
+    if (!(var = apr_hash_get(state->vars, name, namelen))) {
+        var = apr_pcalloc(state->pool, sizeof(state_var_t));
+        key = apr_pstrmemdup(state->pool, name, namelen);
+        apr_hash_set(state->vars, key, namelen, var);
+        state->bytes += sizeof(state_var_t) + namelen + 1;
+    }
+
+    /* Grow by doubling at least, so that a value that keeps getting
+     * longer leaves behind no more than it ends up taking. */
+    if (len + 1 > var->size) {
+        var->size = var->size * 2 > len + 1 ? var->size * 2 : len + 1;
+        if (var->size < FLOOD_STATE_VALUE_MIN)
+            var->size = FLOOD_STATE_VALUE_MIN;
+        var->value = apr_palloc(state->pool, var->size);
+        state->bytes += var->size;
+    }
+
+    memcpy(var->value, value, len);
+    var->value[len] = '\0';
+}
+
+const char *flood_state_get(const flood_state_t *state, const char *name,
+                            apr_ssize_t namelen)
+{
+    state_var_t *var = apr_hash_get(state->vars, name, namelen);
+
+    return var ? var->value : NULL;
+}
+
+apr_size_t flood_state_bytes(const flood_state_t *state)
+{
+    return state->bytes;
+}
@@ -0,0 +1,56 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Originally developed by Aaron Bannert and Justin Erenkrantz, eBuilt.
+ */
+
+#ifndef __flood_state_h
+#define __flood_state_h
+
+#include <apr_pools.h>
+#include <apr_hash.h>
+
+/* The variables a profile carries from one request to the next: values
+ * taken from responses, made up at random or set by a co-process.  Each
+ * variable keeps one buffer, replaced only when a longer value comes
+ * along, so that setting the same variables request after request holds
+ * memory flat. */
+typedef struct flood_state_t flood_state_t;
+
+/**
+ * Make an empty set of variables, allocated from pool.
+ */
+flood_state_t *flood_state_create(apr_pool_t *pool);
+
+/**
+ * Set the variable name, namelen bytes long (or APR_HASH_KEY_STRING), to
+ * the len bytes at value.  Values got before are overwritten, so they
+ * must be copied if they are to be kept.
+ */
+void flood_state_set(flood_state_t *state, const char *name,
+                     apr_ssize_t namelen, const char *value, apr_size_t len);
+
+/**
+ * The NUL-terminated value of the variable, or NULL if it isn't set.
+ */
+const char *flood_state_get(const flood_state_t *state, const char *name,
+                            apr_ssize_t namelen);
+
+/**
+ * How many bytes of the pool the variables take.
+ */
+apr_size_t flood_state_bytes(const flood_state_t *state);
+
+#endif  /* __flood_state_h */
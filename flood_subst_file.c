@@ -54,18 +54,10 @@ subst_rec_t* subst_file_get(const char* varname, subst_rec_t* subst_list) {
 
 void subst_file_err(const char* msgtext, const char* vartext, apr_status_t errcode) {
   char errtext[SUBST_FILE_ERROR_BUF];
-  apr_pool_t *err_pool;
-
-  if (apr_pool_create(&err_pool, NULL) != APR_SUCCESS) {
-    printf("Failed apr_pool_create\n");
-    exit(-1);
-  }
 
   apr_strerror(errcode, (char *) &errtext, SUBST_FILE_ERROR_BUF);
 
   apr_file_printf(local_stderr, "%s %s %s\n", msgtext, vartext, errtext);
-
-  apr_pool_destroy(err_pool);
 }
 
 int subst_file_open(apr_file_t** subst_file, const char* fname,